@@ -61,6 +61,7 @@
 
 static int32_t cachesize = 0;
 int32_t cachecount = 0;
+int32_t cacheevictions = 0;
 uint8_t  zerochar = 0;
 uint8_t* cachestart = NULL;
 int32_t cacnum = 0, agecount = 0;
@@ -139,7 +140,7 @@ void allocache (uint8_t** newhandle, int32_t newbytes, uint8_t  *newlockptr)
 
 		/* Suck things out */
 	for(sucklen=-newbytes,suckz=bestz;sucklen<0;sucklen+=cac[suckz++].leng)
-		if (*cac[suckz].lock) *cac[suckz].hand = 0;
+		if (*cac[suckz].lock) { *cac[suckz].hand = 0; cacheevictions++; }
 
 		/* Remove all blocks except 1 */
 	suckz -= (bestz+1); cacnum -= suckz;
@@ -196,7 +197,7 @@ void suckcache (int32_t *suckptr)
 		}
 }
 
-IRAM_ATTR void agecache(void)
+HOT_CODE(agecache) void agecache(void)
 {
 	int32_t cnt;
 	uint8_t  ch;
@@ -48,6 +48,13 @@
 #include "network.h"
 #include "icon.h"
 
+#ifdef DUKE3D_RP2350
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "HDMI.h"
+#endif
+
 // NATIVE TIMER FUNCTION DECLARATION
 /*
  FCS: The timer section sadly uses Native high precision calls to implement timer functions.
@@ -108,6 +115,7 @@ static int32_t mouse_relative_x = 0;
 static int32_t mouse_relative_y = 0;
 static short mouse_buttons = 0;
 static unsigned int lastkey = 0;
+static uint32_t lastkeytime = 0;
 /* so we can make use of setcolor16()... - DDOI */
 static uint8_t  drawpixel_color=0;
 
@@ -508,6 +516,12 @@ static int sdl_key_filter(const SDL_Event *event)
     if (!handle_keypad_enter_hack(event))
         lastkey = scancodes[event->key.keysym.sym];
 
+#ifdef DUKE3D_RP2350
+    lastkeytime = event->key.timestamp; // PS/2 arrival time, microseconds
+#else
+    lastkeytime = getticks()*1000;
+#endif
+
 //	printf("key.keysym.sym=%d\n", event->key.keysym.sym);
 
     if (lastkey == 0x0000)   /* No DOS equivalent defined. */
@@ -704,6 +718,12 @@ uint8_t  _readlastkeyhit(void)
 } /* _readlastkeyhit */
 
 
+uint32_t _readlastkeytime(void)
+{
+    return(lastkeytime);
+} /* _readlastkeytime */
+
+
 
 #if (!defined __DATE__)
 #define __DATE__ "a long, int32_t time ago"
@@ -1465,6 +1485,116 @@ void _updateScreenRect(int32_t x, int32_t y, int32_t w, int32_t h)
 
 //int counter= 0 ;
 //char bmpName[256];
+//
+// Frame pacing. framecap > 0 presents on every framecap-th HDMI vsync
+// (1 = 60 fps, 2 = 30 fps) and sleeps until then instead of rendering
+// frames nobody sees. The game calls framepacemarkinput() when it takes
+// the input the frame is built from; the latency is measured from there to the
+// vsync that starts scanning the frame out.
+//
+// framepaceidle, when set, runs before the wait and may keep working while
+// framepacespare() is positive: up to shortly before the vsync the frame is
+// due on, or for a short slice when frames are not capped.
+//
+int framecap = 0;
+uint32_t framepaceframeus = 0, framepacelatencyus = 0;
+void (*framepaceidle)(void) = NULL;
+static uint32_t framepaceinputus = 0;
+static uint32_t framepacedeadline = 0;
+
+void framepacemarkinput(void)
+{
+#ifdef DUKE3D_RP2350
+    framepaceinputus = time_us_32();
+#endif
+}
+
+int32_t framepacespare(void)
+{
+#ifdef DUKE3D_RP2350
+    return (int32_t)(framepacedeadline-time_us_32());
+#else
+    return 0;
+#endif
+}
+
+#ifdef DUKE3D_RP2350
+#define FRAMEPACE_VSYNC_US 16667 // 60 Hz HDMI
+#define FRAMEPACE_IDLE_US   2000 // idle slice when frames are not capped
+#define FRAMEPACE_MARGIN_US 1500 // idle work stops this long before the vsync
+
+static uint32_t framepacevsync = 0, framepacelastus = 0;
+
+static void framepacewait(void)
+{
+    uint32_t due;
+
+    if (framecap <= 0) {
+        framepacedeadline = time_us_32()+FRAMEPACE_IDLE_US;
+        if (framepaceidle)
+            framepaceidle();
+        framepacevsync = graphics_get_vsync_count();
+        return;
+    }
+
+    due = framepacevsync+framecap;
+    framepacedeadline = graphics_get_vsync_time()+
+        (int32_t)(due-graphics_get_vsync_count())*FRAMEPACE_VSYNC_US-FRAMEPACE_MARGIN_US;
+    if (framepaceidle)
+        framepaceidle();
+    while ((int32_t)(graphics_get_vsync_count()-due) < 0) {
+        faketimerhandler();
+        __wfi();
+    }
+    framepacevsync = graphics_get_vsync_count();
+}
+
+static void framepacepresented(void)
+{
+    uint32_t now = time_us_32();
+    uint32_t vsyncus = graphics_get_vsync_time();
+    uint32_t photon;
+
+    // Scan-out of the new frame starts at the next vsync after the copy
+    photon = vsyncus+((now-vsyncus)/FRAMEPACE_VSYNC_US+1)*FRAMEPACE_VSYNC_US;
+    if (framepacelastus)
+        framepaceframeus += ((int32_t)(now-framepacelastus)-(int32_t)framepaceframeus)>>3;
+    framepacelastus = now;
+    if (framepaceinputus)
+        framepacelatencyus += ((int32_t)(photon-framepaceinputus)-(int32_t)framepacelatencyus)>>3;
+}
+#endif
+
+//
+// XIP cache hit rate over the last second, in tenths of a percent, and the
+// size of the code HOT_CODE() moved to SRAM (see src/hot_functions.h). The
+// counters also see PSRAM traffic, which shares the cache with flash.
+//
+uint32_t xiphitpermille = 0, hottextbytes = 0;
+
+#ifdef DUKE3D_RP2350
+static uint32_t xipsamplestart = 0;
+
+static void xipcachesample(void)
+{
+    extern char __hot_text_start__[], __hot_text_end__[];
+    uint32_t now = time_us_32();
+    uint32_t hit, acc;
+
+    if (now-xipsamplestart < 1000000)
+        return;
+    xipsamplestart = now;
+
+    hit = xip_ctrl_hw->ctr_hit;
+    acc = xip_ctrl_hw->ctr_acc;
+    xip_ctrl_hw->ctr_hit = 0;
+    xip_ctrl_hw->ctr_acc = 0;
+    if (acc)
+        xiphitpermille = (uint32_t)((uint64_t)hit*1000/acc);
+    hottextbytes = __hot_text_end__-__hot_text_start__;
+}
+#endif
+
 void _nextpage(void)
 
 {
@@ -1472,8 +1602,16 @@ void _nextpage(void)
 
     _handle_events();
 
+#ifdef DUKE3D_RP2350
+    framepacewait();
+#endif
     
     SDL_UpdateRect(surface, 0, 0, 0, 0);
+
+#ifdef DUKE3D_RP2350
+    framepacepresented();
+    xipcachesample();
+#endif
     
     //sprintf(bmpName,"%d.bmp",counter++);
     //SDL_SaveBMP(surface,bmpName);
@@ -1509,7 +1647,7 @@ void setcolor16(uint8_t col)
 	drawpixel_color = col;
 }
 
-IRAM_ATTR void drawpixel16(int32_t offset)
+HOT_CODE(drawpixel16) void drawpixel16(int32_t offset)
 {
     drawpixel((uint8_t*)surface->pixels + offset, drawpixel_color);
 } /* drawpixel16 */
@@ -1552,7 +1690,7 @@ void fillscreen16(int32_t offset, int32_t color, int32_t blocksize)
 
 /* Most of this line code is taken from Abrash's "Graphics Programming Blackbook".
 Remember, sharing code is A Good Thing. AH */
-IRAM_ATTR static __inline void DrawHorizontalRun (uint8_t  **ScreenPtr, int XAdvance, int RunLength, uint8_t  Color)
+HOT_CODE(DrawHorizontalRun) static __inline void DrawHorizontalRun (uint8_t  **ScreenPtr, int XAdvance, int RunLength, uint8_t  Color)
 {
     int i;
     uint8_t  *WorkingScreenPtr = *ScreenPtr;
@@ -1566,7 +1704,7 @@ IRAM_ATTR static __inline void DrawHorizontalRun (uint8_t  **ScreenPtr, int XAdv
     *ScreenPtr = WorkingScreenPtr;
 }
 
-IRAM_ATTR static __inline void DrawVerticalRun (uint8_t  **ScreenPtr, int XAdvance, int RunLength, uint8_t  Color)
+HOT_CODE(DrawVerticalRun) static __inline void DrawVerticalRun (uint8_t  **ScreenPtr, int XAdvance, int RunLength, uint8_t  Color)
 {
     int i;
     uint8_t  *WorkingScreenPtr = *ScreenPtr;
@@ -1580,7 +1718,7 @@ IRAM_ATTR static __inline void DrawVerticalRun (uint8_t  **ScreenPtr, int XAdvan
     *ScreenPtr = WorkingScreenPtr;
 }
 
-IRAM_ATTR void drawline16(int32_t XStart, int32_t YStart, int32_t XEnd, int32_t YEnd, uint8_t  Color)
+HOT_CODE(drawline16) void drawline16(int32_t XStart, int32_t YStart, int32_t XEnd, int32_t YEnd, uint8_t  Color)
 {
     int Temp, AdjUp, AdjDown, ErrorTerm, XAdvance, XDelta, YDelta;
     int WholeStep, InitialPixelCount, FinalPixelCount, i, RunLength;
@@ -1787,10 +1925,44 @@ void *_getVideoBase(void)
 
 
 static int64_t timerfreq=0;
-static int32_t timerlastsample=0;
+static volatile int32_t timerlastsample=0;
 static int timerticspersec=0;
 static void (*usertimercallback)(void) = NULL;
 
+#ifdef DUKE3D_RP2350
+// The game clock runs off a hardware alarm, so ticks land on time even
+// while a long frame is rendering and faketimerhandler() sees them there.
+// The alarm is aimed at each tick boundary rather than repeated at a
+// rounded period, so it cannot drift away from them.
+static alarm_id_t timeralarm;
+static int64_t timeralarmat;
+static volatile int32_t timerpending = 0;
+
+// First microsecond of tick n
+static int64_t timertickstart(int32_t n)
+{
+	return ((int64_t)n*timerfreq+timerticspersec-1) / timerticspersec;
+}
+
+static int64_t timeralarmhandler(alarm_id_t id, void *user_data)
+{
+	int32_t n = (int32_t)((int64_t)time_us_64()*timerticspersec / timerfreq) - timerlastsample;
+	int64_t next;
+
+	if (n>0) {
+		totalclock += n;
+		timerlastsample += n;
+		timerpending += n;
+	}
+
+	// Positive: relative to when this alarm was due
+	next = timertickstart(timerlastsample+1);
+	n = (int32_t)(next-timeralarmat);
+	timeralarmat = next;
+	return n;
+}
+#endif
+
 //  This timer stuff is all Ken's idea.
 
 //
@@ -1839,6 +2011,12 @@ int inittimer(int tickspersecond)
 	timerlastsample = (int32_t)(t*timerticspersec / timerfreq);
 
 	usertimercallback = NULL;
+
+#ifdef DUKE3D_RP2350
+	timerpending = 0;
+	timeralarmat = timertickstart(timerlastsample+1);
+	timeralarm = add_alarm_at(from_us_since_boot((uint64_t)timeralarmat), timeralarmhandler, NULL, true);
+#endif
     
 	return 0;
 }
@@ -1850,6 +2028,9 @@ void uninittimer(void)
 {
 	if (!timerfreq) return;
 
+#ifdef DUKE3D_RP2350
+	cancel_alarm(timeralarm);
+#endif
 	timerfreq=0;
 	timerticspersec = 0;
 }
@@ -1857,13 +2038,22 @@ void uninittimer(void)
 //
 // sampletimer() -- update totalclock
 //
-IRAM_ATTR void sampletimer(void)
+HOT_CODE(sampletimer) void sampletimer(void)
 {
 	int64_t i;
 	int32_t n;
 	
 	if (!timerfreq) return;
 
+#ifdef DUKE3D_RP2350
+	// totalclock is stepped by the alarm; only the callbacks run here
+	{
+		uint32_t irq = save_and_disable_interrupts();
+		n = timerpending;
+		timerpending = 0;
+		restore_interrupts(irq);
+	}
+#else
 	TIMER_GetPlatformTicks(&i);
     
     
@@ -1872,10 +2062,46 @@ IRAM_ATTR void sampletimer(void)
 		totalclock += n;
 		timerlastsample += n;
 	}
+#endif
 
 	if (usertimercallback) for (; n>0; n--) usertimercallback();
 }
 
+//
+// adjusttotalclock() -- step totalclock from game code
+//
+void adjusttotalclock(int32_t n)
+{
+#ifdef DUKE3D_RP2350
+	// The alarm steps totalclock too; keep it out of the read-modify-write
+	uint32_t irq = save_and_disable_interrupts();
+	totalclock += n;
+	restore_interrupts(irq);
+#else
+	totalclock += n;
+#endif
+}
+
+//
+// gettimerfrac() -- how far the clock is into the current totalclock tick, 0-65535
+//
+int32_t gettimerfrac(void)
+{
+	int64_t i;
+	int32_t last;
+
+	if (!timerfreq) return 0;
+
+	// Measured from the tick totalclock last stepped to, so a tick that has
+	// started but not been counted yet holds at the end instead of wrapping
+	last = timerlastsample;
+	TIMER_GetPlatformTicks(&i);
+	i = (i*timerticspersec - (int64_t)last*timerfreq) * 65536 / timerfreq;
+	if (i < 0) return 0;
+	if (i > 65535) return 65535;
+	return (int32_t)i;
+}
+
 
 /*
    getticks() -- returns the windows ticks count
@@ -1889,6 +2115,17 @@ uint32_t getticks(void)
 }
 
 
+//
+// getmicroticks() -- microseconds since start-up, wraps every ~71 minutes
+//
+uint32_t getmicroticks(void)
+{
+	int64_t i;
+	TIMER_GetPlatformTicks(&i);
+	return (uint32_t)(i*1000000/timerfreq);
+}
+
+
 //
 // gettimerfreq() -- returns the number of ticks per second the timer is configured to generate
 //
@@ -1931,6 +2168,18 @@ void TIMER_GetPlatformTicks(int64_t* t)
 {
     QueryPerformanceCounter((LARGE_INTEGER*)t);
 }
+#elif defined(DUKE3D_RP2350)
+// Microsecond timebase, shared with the tick alarm
+int TIMER_GetPlatformTicksInOneSecond(int64_t* t)
+{
+    *t = 1000000;
+    return 1;
+}
+
+HOT_CODE(TIMER_GetPlatformTicks) void TIMER_GetPlatformTicks(int64_t* t)
+{
+    *t = (int64_t)time_us_64();
+}
 #else
 //FCS: Let's try to use SDL again: Maybe SDL library is accurate enough now.
 int TIMER_GetPlatformTicksInOneSecond(int64_t* t)
@@ -1939,7 +2188,7 @@ int TIMER_GetPlatformTicksInOneSecond(int64_t* t)
     return 1;
 }
     
-IRAM_ATTR void TIMER_GetPlatformTicks(int64_t* t)
+HOT_CODE(TIMER_GetPlatformTicks) void TIMER_GetPlatformTicks(int64_t* t)
 {
     *t = SDL_GetTicks();
 }
@@ -87,6 +87,7 @@ void readmousexy(short *x, short *y);
 void readmousebstatus(short *bstatus);
 void keyhandler(void);
 uint8_t  _readlastkeyhit(void);
+uint32_t _readlastkeytime(void); /* microseconds */
 
 /* timer krap. */
 int inittimer(int);
@@ -99,6 +100,7 @@ void timerhandler(void);
 int32_t _setgamemode(uint8_t  davidoption, int32_t daxdim, int32_t daydim);
 
 uint32_t getticks();
+uint32_t getmicroticks(void);
 
 void drawline16(int32_t XStart, int32_t YStart, int32_t XEnd, int32_t YEnd, uint8_t  Color);
 void setcolor16(uint8_t color);
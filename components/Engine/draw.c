@@ -17,6 +17,7 @@
 #define PIXEL_ALLOWED() (pixelsAllowed-- > 0)
 #endif
 
+#include <string.h>
 #include "platform.h"
 #include "build.h"
 #include "draw.h"
@@ -65,7 +66,7 @@ void sethlinesizes(int32_t i1, int32_t _bits, uint8_t * textureAddress)
 
 //FCS:   Draw ceiling/floors
 //Draw a line from destination in the framebuffer to framebuffer-numPixels
-IRAM_ATTR void hlineasm4(int32_t numPixels, int32_t shade, uint32_t i4, uint32_t i5, uint8_t *dest){
+HOT_CODE(hlineasm4) void hlineasm4(int32_t numPixels, int32_t shade, uint32_t i4, uint32_t i5, uint8_t *dest){
 
     int32_t shifter = ((256-machxbits_al) & 0x1f);
     uint32_t source;
@@ -113,7 +114,7 @@ void setuprhlineasm4(int32_t i1, int32_t i2, int32_t i3, int32_t i4, int32_t i5,
 } 
 
 
-IRAM_ATTR void rhlineasm4(int32_t i1, uint8_t* texture, int32_t i3, uint32_t i4, uint32_t i5, int32_t dest)
+HOT_CODE(rhlineasm4) void rhlineasm4(int32_t i1, uint8_t* texture, int32_t i3, uint32_t i4, uint32_t i5, int32_t dest)
 {
     uint32_t ebp = dest - i1;
     uint32_t rmach6b = ebp-1;
@@ -163,7 +164,7 @@ void setuprmhlineasm4(int32_t i1, int32_t i2, int32_t i3, int32_t i4, int32_t ti
 
 
 //FCS: ????
-IRAM_ATTR void rmhlineasm4(int32_t i1, intptr_t shade, int32_t colorIndex, int32_t i4, int32_t i5, int32_t dest)
+HOT_CODE(rmhlineasm4) void rmhlineasm4(int32_t i1, intptr_t shade, int32_t colorIndex, int32_t i4, int32_t i5, int32_t dest)
 {
     uint32_t ebp = dest - i1;
     uint32_t rmach6b = ebp-1;
@@ -218,7 +219,7 @@ void setBytesPerLine(int32_t _bytesperline)
 static uint8_t  mach3_al;
 
 //FCS:  RENDER TOP AND BOTTOM COLUMN
-IRAM_ATTR int32_t prevlineasm1(int32_t i1, uint8_t* palette, int32_t i3, int32_t i4, uint8_t  *source, uint8_t  *dest)
+HOT_CODE(prevlineasm1) int32_t prevlineasm1(int32_t i1, uint8_t* palette, int32_t i3, int32_t i4, uint8_t  *source, uint8_t  *dest)
 {
 
 
@@ -244,7 +245,7 @@ IRAM_ATTR int32_t prevlineasm1(int32_t i1, uint8_t* palette, int32_t i3, int32_t
 
 
 //FCS: This is used to draw wall border vertical lines
-IRAM_ATTR int32_t vlineasm1(int32_t vince, uint8_t* palookupoffse, int32_t numPixels, int32_t vplce, uint8_t* texture, uint8_t* dest)
+HOT_CODE(vlineasm1) int32_t vlineasm1(int32_t vince, uint8_t* palookupoffse, int32_t numPixels, int32_t vplce, uint8_t* texture, uint8_t* dest)
 {
     uint32_t temp;
 
@@ -269,7 +270,7 @@ IRAM_ATTR int32_t vlineasm1(int32_t vince, uint8_t* palookupoffse, int32_t numPi
 } 
 
 
-IRAM_ATTR int32_t tvlineasm1(int32_t i1, uint8_t  * texture, int32_t numPixels, int32_t i4, uint8_t  *source, uint8_t  *dest)
+HOT_CODE(tvlineasm1) int32_t tvlineasm1(int32_t i1, uint8_t  * texture, int32_t numPixels, int32_t i4, uint8_t  *source, uint8_t  *dest)
 {
     uint8_t shiftValue = (globalshiftval & 0x1f);
     
@@ -316,7 +317,7 @@ void setuptvlineasm2(int32_t i1, int32_t i2, int32_t i3)
 } /* */
 
 
-IRAM_ATTR void tvlineasm2(uint32_t i1, uint32_t i2, uintptr_t i3, uintptr_t i4, uint32_t i5, uintptr_t i6)
+HOT_CODE(tvlineasm2) void tvlineasm2(uint32_t i1, uint32_t i2, uintptr_t i3, uintptr_t i4, uint32_t i5, uintptr_t i6)
 {
 	uint32_t ebp = i1;
 	uint32_t tran2inca = i2;
@@ -385,7 +386,7 @@ IRAM_ATTR void tvlineasm2(uint32_t i1, uint32_t i2, uintptr_t i3, uintptr_t i4,
 
 
 static uint8_t  machmv;
-IRAM_ATTR int32_t mvlineasm1(int32_t vince, uint8_t* palookupoffse, int32_t i3, int32_t vplce, uint8_t* texture, uint8_t  *dest)
+HOT_CODE(mvlineasm1) int32_t mvlineasm1(int32_t vince, uint8_t* palookupoffse, int32_t i3, int32_t vplce, uint8_t* texture, uint8_t  *dest)
 {
     uint32_t temp;
 
@@ -407,13 +408,141 @@ IRAM_ATTR int32_t mvlineasm1(int32_t vince, uint8_t* palookupoffse, int32_t i3,
 }
 
 
+/*
+ * Masked columns walked by opaque runs, see tilegetspans() in tiles.c.
+ * runs holds nruns sorted (start, end) texel rows of the column. Rows in
+ * the gaps are stepped over without being read. Rows from the tile height
+ * up to the power of two the shift assumes are drawn texel by texel as
+ * before.
+ */
+#define RUN_GAP 0
+#define RUN_OPAQUE 1
+#define RUN_PAD 2
+
+// Pixels until the texel row leaves the segment vplce is in
+static inline uint32_t runsegment(uint32_t vplce, int32_t shift, uint32_t vince,
+                                  const uint16_t *runs, int32_t nruns, int32_t height, int32_t *kind)
+{
+    uint32_t y, last;
+    uint64_t end;
+    int32_t r;
+
+    y = vplce>>shift;
+    if (y >= (uint32_t)height)
+    {
+        *kind = RUN_PAD;
+        end = (uint64_t)1<<(32-shift);
+    }
+    else
+    {
+        for(r=0; (r < nruns) && (runs[r*2+1] <= y); r++);
+        if ((r < nruns) && (runs[r*2] <= y))
+        {
+            *kind = RUN_OPAQUE;
+            end = runs[r*2+1];
+        }
+        else
+        {
+            *kind = RUN_GAP;
+            end = (r < nruns) ? runs[r*2] : height;
+        }
+    }
+    last = (uint32_t)((end<<shift)-1);
+    return (last-vplce)/vince+1;
+}
+
+HOT_CODE(mvlineasm1runs) int32_t mvlineasm1runs(int32_t vince, uint8_t* palookupoffse, int32_t i3, int32_t vplce, uint8_t* texture, uint8_t *dest,
+                                                const uint16_t *runs, int32_t nruns, int32_t height)
+{
+    int32_t numPixels, kind;
+    uint32_t k;
+
+    if (vince <= 0)
+        return mvlineasm1(vince,palookupoffse,i3,vplce,texture,dest);
+
+    numPixels = i3+1;
+    while (numPixels > 0)
+    {
+        k = runsegment(vplce,machmv,vince,runs,nruns,height,&kind);
+        if (k > (uint32_t)numPixels)
+            k = numPixels;
+        numPixels -= k;
+
+        if (kind == RUN_GAP)
+        {
+            vplce += k*vince;
+            dest += k*bytesperline;
+            continue;
+        }
+        if (kind == RUN_PAD)
+        {
+            vplce = mvlineasm1(vince,palookupoffse,k-1,vplce,texture,dest);
+            dest += k*bytesperline;
+            continue;
+        }
+        do {
+            if (PIXEL_ALLOWED())
+                *dest = palookupoffse[texture[((uint32_t)vplce)>>machmv]];
+            vplce += vince;
+            dest += bytesperline;
+        } while (--k);
+    }
+    return vplce;
+}
+
+HOT_CODE(tvlineasm1runs) int32_t tvlineasm1runs(int32_t i1, uint8_t  * texture, int32_t numPixels, int32_t i4, uint8_t  *source, uint8_t  *dest,
+                                                const uint16_t *runs, int32_t nruns, int32_t height)
+{
+    uint8_t shiftValue = (globalshiftval & 0x1f);
+    int32_t kind;
+    uint32_t k;
+    uint16_t colorIndex;
+
+    if (i1 <= 0)
+        return tvlineasm1(i1,texture,numPixels,i4,source,dest);
+
+    numPixels++;
+    while (numPixels > 0)
+    {
+        k = runsegment(i4,shiftValue,i1,runs,nruns,height,&kind);
+        if (k > (uint32_t)numPixels)
+            k = numPixels;
+        numPixels -= k;
+
+        if (kind == RUN_GAP)
+        {
+            i4 += k*i1;
+            dest += k*bytesperline;
+            continue;
+        }
+        if (kind == RUN_PAD)
+        {
+            i4 = tvlineasm1(i1,texture,k-1,i4,source,dest);
+            dest += k*bytesperline;
+            continue;
+        }
+        do {
+            colorIndex = texture[source[((uint32_t)i4)>>shiftValue]];
+            colorIndex |= ((*dest)<<8);
+            if (transrev)
+                colorIndex = ((colorIndex>>8)|(colorIndex<<8));
+            if (PIXEL_ALLOWED())
+                *dest = transluc[colorIndex];
+            i4 += i1;
+            dest += bytesperline;
+        } while (--k);
+    }
+    return i4;
+}
+
+
 void setupvlineasm(int32_t i1)
 {
     mach3_al = (i1&0x1f);
 }
 
 //FCS This is used to fill the inside of a wall (so it draws VERTICAL column, always).
-IRAM_ATTR void vlineasm4(int32_t columnIndex, intptr_t framebuffer)
+HOT_CODE(vlineasm4) void vlineasm4(int32_t columnIndex, intptr_t framebuffer)
 {
 
 	if (!RENDER_DRAW_WALL_INSIDE)
@@ -453,7 +582,7 @@ void setupmvlineasm(int32_t i1)
 } 
 
 
-IRAM_ATTR void mvlineasm4(int32_t column, intptr_t framebufferOffset)
+HOT_CODE(mvlineasm4) void mvlineasm4(int32_t column, intptr_t framebufferOffset)
 {
     int i;
     uint32_t temp;
@@ -517,7 +646,7 @@ static int32_t smach_eax;
 static int32_t smach2_eax;
 static int32_t smach5_eax;
 static int32_t smach_ecx;
-IRAM_ATTR void setupspritevline(int32_t i1, int32_t i2, int32_t i3, int32_t i4, int32_t i5, int32_t i6)
+HOT_CODE(setupspritevline) void setupspritevline(int32_t i1, int32_t i2, int32_t i3, int32_t i4, int32_t i5, int32_t i6)
 {
     spal_eax = i1;
     smach_eax = (i5<<16);
@@ -527,7 +656,7 @@ IRAM_ATTR void setupspritevline(int32_t i1, int32_t i2, int32_t i3, int32_t i4,
 } 
 
 
-IRAM_ATTR void spritevline(int32_t i1, uint32_t i2, int32_t i3, uint32_t i4, uint8_t* source, uint8_t* dest)
+HOT_CODE(spritevline) void spritevline(int32_t i1, uint32_t i2, int32_t i3, uint32_t i4, uint8_t* source, uint8_t* dest)
 {
     
 
@@ -574,7 +703,7 @@ static int32_t msmach_eax;
 static int32_t msmach2_eax;
 static int32_t msmach5_eax;
 static int32_t msmach_ecx;
-IRAM_ATTR void msetupspritevline(int32_t i1, int32_t i2, int32_t i3, int32_t i4, int32_t i5, int32_t i6)
+HOT_CODE(msetupspritevline) void msetupspritevline(int32_t i1, int32_t i2, int32_t i3, int32_t i4, int32_t i5, int32_t i6)
 {
     mspal_eax = i1;
     msmach_eax = (i5<<16);
@@ -584,7 +713,7 @@ IRAM_ATTR void msetupspritevline(int32_t i1, int32_t i2, int32_t i3, int32_t i4,
 } 
 
 
-IRAM_ATTR void mspritevline(int32_t colorIndex, int32_t i2, int32_t i3, int32_t i4, uint8_t  * source, uint8_t  * dest)
+HOT_CODE(mspritevline) void mspritevline(int32_t colorIndex, int32_t i2, int32_t i3, int32_t i4, uint8_t  * source, uint8_t  * dest)
 {
  
 setup:
@@ -635,7 +764,7 @@ uint32_t tsmach_eax1;
 uint32_t adder;
 uint32_t tsmach_eax3;
 uint32_t tsmach_ecx;
-IRAM_ATTR void tsetupspritevline(uint8_t * palette, int32_t i2, int32_t i3, int32_t i4, int32_t i5)
+HOT_CODE(tsetupspritevline) void tsetupspritevline(uint8_t * palette, int32_t i2, int32_t i3, int32_t i4, int32_t i5)
 {
 	tspal = palette;
 	tsmach_eax1 = i5 << 16;
@@ -648,7 +777,7 @@ IRAM_ATTR void tsetupspritevline(uint8_t * palette, int32_t i2, int32_t i3, int3
 /*
  FCS: Draw a sprite vertical line of pixels.
  */
-IRAM_ATTR void DrawSpriteVerticalLine(int32_t i2, int32_t numPixels, uint32_t i4, uint8_t  * texture, uint8_t  * dest)
+HOT_CODE(DrawSpriteVerticalLine) void DrawSpriteVerticalLine(int32_t i2, int32_t numPixels, uint32_t i4, uint8_t  * texture, uint8_t  * dest)
 {
     uint8_t colorIndex;
     
@@ -695,6 +824,89 @@ IRAM_ATTR void DrawSpriteVerticalLine(int32_t i2, int32_t numPixels, uint32_t i4
 		
 	}
 } 
+
+
+/*
+ One framebuffer row of an unrotated rotatesprite at an integer scale.
+ Tiles are column-major, so consecutive texels of a row are 'stride'
+ apart. Each texel covers 'scale' pixels; the first one has 'phase' of
+ them already drawn. Four pixels are built up and stored as one word.
+ */
+#define BLITFETCH(t) do { if (left == 0) { source += stride; left = scale; } left--; (t) = *source; } while (0)
+
+static inline uint8_t blitpixel(uint8_t texel, uint8_t *palette, int32_t mode, uint8_t dest)
+{
+    uint16_t val;
+
+    if (mode == BLIT_OPAQUE)
+        return palette[texel];
+    if (texel == 255)
+        return dest;
+    if (mode == BLIT_MASKED)
+        return palette[texel];
+
+    val = palette[texel] | (dest<<8);
+    if (transrev)
+        val = ((val>>8)|(val<<8));
+    return transluc[val];
+}
+
+HOT_CODE(blitrow) void blitrow(uint8_t *source, int32_t stride, int32_t phase, int32_t scale, int32_t count, uint8_t *palette, int32_t mode, uint8_t *dest)
+{
+    int32_t left = scale-phase;
+    uint8_t t0, t1, t2, t3;
+    uint32_t word;
+
+    while ((count > 0) && ((uintptr_t)dest&3))
+    {
+        BLITFETCH(t0);
+        *dest = blitpixel(t0,palette,mode,*dest);
+        dest++;
+        count--;
+    }
+
+    for (; count >= 4; count -= 4, dest += 4)
+    {
+        BLITFETCH(t0);
+        BLITFETCH(t1);
+        BLITFETCH(t2);
+        BLITFETCH(t3);
+
+        if ((mode == BLIT_MASKED) && ((t0 == 255) || (t1 == 255) || (t2 == 255) || (t3 == 255)))
+        {
+            if ((t0 & t1 & t2 & t3) == 255)
+                continue;
+            if (t0 != 255) dest[0] = palette[t0];
+            if (t1 != 255) dest[1] = palette[t1];
+            if (t2 != 255) dest[2] = palette[t2];
+            if (t3 != 255) dest[3] = palette[t3];
+            continue;
+        }
+
+        if (mode == BLIT_TRANS)
+        {
+            memcpy(&word,dest,4);
+            word = blitpixel(t0,palette,mode,word&255) |
+                   (blitpixel(t1,palette,mode,(word>>8)&255)<<8) |
+                   (blitpixel(t2,palette,mode,(word>>16)&255)<<16) |
+                   ((uint32_t)blitpixel(t3,palette,mode,word>>24)<<24);
+        }
+        else
+            word = palette[t0] | (palette[t1]<<8) | (palette[t2]<<16) | ((uint32_t)palette[t3]<<24);
+        memcpy(dest,&word,4);
+    }
+
+    while (count > 0)
+    {
+        BLITFETCH(t0);
+        *dest = blitpixel(t0,palette,mode,*dest);
+        dest++;
+        count--;
+    }
+}
+
+#undef BLITFETCH
+
 /* END---------------  SPRITE RENDERING METHOD (USED TO BE HIGHLY OPTIMIZED ASSEMBLY) ----------------------------*/
 
 
@@ -49,6 +49,8 @@ int32_t tvlineasm1(int32_t,uint8_t  *,int32_t,int32_t,uint8_t  *,uint8_t  * dest
 void setuptvlineasm2(int32_t,int32_t,int32_t);
 void tvlineasm2(uint32_t,uint32_t,uintptr_t,uintptr_t,uint32_t,uintptr_t);
 int32_t mvlineasm1(int32_t,uint8_t*,int32_t,int32_t,uint8_t* texture,uint8_t* dest);
+int32_t mvlineasm1runs(int32_t,uint8_t*,int32_t,int32_t,uint8_t* texture,uint8_t* dest,const uint16_t *runs,int32_t nruns,int32_t height);
+int32_t tvlineasm1runs(int32_t,uint8_t  *,int32_t,int32_t,uint8_t  *,uint8_t  * dest,const uint16_t *runs,int32_t nruns,int32_t height);
 void setupvlineasm(int32_t);
 void vlineasm4(int32_t,intptr_t);
 void setupmvlineasm(int32_t);
@@ -59,6 +61,10 @@ void msetupspritevline(int32_t,int32_t,int32_t,int32_t,int32_t,int32_t);
 void mspritevline(int32_t,int32_t,int32_t,int32_t,uint8_t  *,uint8_t  *);
 void tsetupspritevline(uint8_t *,int32_t,int32_t,int32_t,int32_t);
 void DrawSpriteVerticalLine(int32_t,int32_t,uint32_t,uint8_t* ,uint8_t*);
+#define BLIT_OPAQUE 0
+#define BLIT_MASKED 1
+#define BLIT_TRANS  2
+void blitrow(uint8_t *source,int32_t stride,int32_t phase,int32_t scale,int32_t count,uint8_t *palette,int32_t mode,uint8_t *dest);
 void mhline(uint8_t  *,int32_t,int32_t,int32_t,int32_t,uint8_t*);
 void mhlineskipmodify(uint32_t,int32_t,int32_t,uint8_t*);
 void msethlineshift(int32_t,int32_t);
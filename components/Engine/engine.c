@@ -282,6 +282,27 @@ EXT_RAM_ATTR static int32_t colnext[256];
 static uint8_t  coldist[8] = {0,1,2,3,4,3,2,1};
 static int32_t colscan[27];
 
+/*
+ * Inverse colour map: nearest palette index for each 6-bit colour with the
+ * low bit dropped (32x32x32). Built at loadpalette() and kept on SD keyed by
+ * the palette CRC, so later boots only read it.
+ */
+#define INVCOLBITS 5
+#define INVCOLFILE "palinv.dat"
+#define INVCOLMAGIC 0x564e4950 /* "PINV" */
+static uint8_t *invcolmap;
+
+/* makepalookup() inputs per palette, so rebuilding the same tint is free.
+   The output also depends on palette[] and palookup[0]; loadpalette()
+   drops every key when it reads them. */
+typedef struct
+{
+    uint32_t crc;
+    int8_t r, g, b;
+    uint8_t valid;
+} palookupkey_t;
+EXT_RAM_ATTR static palookupkey_t palookupkeys[MAXPALOOKUPS];
+
 static int16_t clipnum, hitwalls[4];
 int32_t hitscangoalx = (1<<29)-1, hitscangoaly = (1<<29)-1;
 
@@ -324,6 +345,7 @@ static int32_t mirrorsx1, mirrorsy1, mirrorsx2, mirrorsy2;
 int32_t totalclocklock;
 
 uint16_t mapCRC;
+char loadedboardname[128];
 
 #include "draw.h"
 
@@ -718,13 +740,66 @@ static void prepwall(int32_t z, walltype *wal)
 }
 
 
-IRAM_ATTR static int32_t getpalookup(int32_t davis, int32_t dashade)
+HOT_CODE(getpalookup) static int32_t getpalookup(int32_t davis, int32_t dashade)
 {
     return(min(max(dashade+(davis>>8),0),numpalookups-1));
 }
 
+/*
+ * Mip level selection, see tiles.c. globalmipbase[] holds where each level
+ * of globalpicnum starts; setupmips() returns how many may be sampled.
+ * mipfetchfull/mipfetchactual estimate the texel bytes mipped surfaces
+ * touched in the last frame at full resolution and at the chosen levels.
+ */
+static uint8_t *globalmipbase[TILEMIP_MAXLEVELS+1];
+static int32_t globalmipmax, globalmiplevel;
+static uint32_t mipfetchfullnow = 0, mipfetchactualnow = 0;
+uint32_t mipfetchfull = 0, mipfetchactual = 0;
+
+static int32_t setupmips(void)
+{
+    int32_t m, levels, xsiz, ysiz;
+
+    globalmipbase[0] = tiles[globalpicnum].data;
+    globalmiplevel = 0;
+    levels = min(tilemips[globalpicnum],mipmaplevels);
+    if (levels <= 0)
+        return(0);
+
+    xsiz = tiles[globalpicnum].dim.width;
+    ysiz = tiles[globalpicnum].dim.height;
+    for(m=1; m<=levels; m++)
+        globalmipbase[m] = globalmipbase[m-1]+(xsiz>>(m-1))*(ysiz>>(m-1));
+    return(levels);
+}
+
+// Level at which one step of 'step' (texel units << shift) is about one texel
+static inline int32_t miplevel(int32_t step, int32_t shift, int32_t maxlevel)
+{
+    int32_t level;
+
+    level = 31-__builtin_clz(klabs(step)|1)-shift;
+    return(min(max(level,0),maxlevel));
+}
+
+// Texels per pixel, 16.16, for a step in texel units << shift
+static inline uint32_t miptexels(int32_t step, int32_t shift)
+{
+    return((uint32_t)(((uint64_t)klabs(step)<<16)>>shift));
+}
+
+// Texel bytes a run of numpixels touches, full size and at 'level'
+static inline void mipcount(int32_t numpixels, uint32_t texels, int32_t limit, int32_t level)
+{
+    uint32_t span;
+
+    span = (uint32_t)(((uint64_t)texels*numpixels)>>16);
+    mipfetchfullnow += min(span,(uint32_t)limit);
+    mipfetchactualnow += min(span>>level,(uint32_t)limit>>(level<<1));
+}
+
 
-IRAM_ATTR static void hline (int32_t xr, int32_t yp)
+HOT_CODE(hline) static void hline (int32_t xr, int32_t yp)
 {
     int32_t xl, r, s;
 
@@ -738,11 +813,25 @@ IRAM_ATTR static void hline (int32_t xr, int32_t yp)
     asm2 = globaly2*r;
     s = (getpalookup(mulscale16(r,globvis),globalshade)<<8);
 
+    if (globalmipmax)
+    {
+        int32_t xbits = picsiz[globalpicnum]&15, ybits = picsiz[globalpicnum]>>4, level;
+
+        level = max(miplevel(asm1,32-xbits,globalmipmax),miplevel(asm2,32-ybits,globalmipmax));
+        if (level != globalmiplevel)
+        {
+            globalmiplevel = level;
+            sethlinesizes(xbits-level,ybits-level,globalmipbase[level]);
+        }
+        mipcount(xr-xl+1,max(miptexels(asm1,32-xbits),miptexels(asm2,32-ybits)),
+                 tiles[globalpicnum].dim.width*tiles[globalpicnum].dim.height,level);
+    }
+
     hlineasm4(xr-xl,s,globalx2*r+globalypanning,globaly1*r+globalxpanning,ylookup[yp]+xr+frameoffset);
 }
 
 
-IRAM_ATTR static void slowhline (int32_t xr, int32_t yp)
+HOT_CODE(slowhline) static void slowhline (int32_t xr, int32_t yp)
 {
     int32_t xl, r;
 
@@ -890,6 +979,7 @@ static void ceilscan (int32_t x1, int32_t x2, int32_t sectnum)
     globalx2 = (globalx2-globaly2)*halfxdimen;
 
     sethlinesizes(picsiz[globalpicnum]&15,picsiz[globalpicnum]>>4,globalbufplc);
+    globalmipmax = setupmips();
 
     globalx2 += globaly2*(x1-1);
     globaly1 += globalx1*(x1-1);
@@ -1139,6 +1229,7 @@ static void florscan (int32_t x1, int32_t x2, int32_t sectnum)
 
     //Setup the drawing routine paramters
     sethlinesizes(picsiz[globalpicnum]&15,picsiz[globalpicnum]>>4,globalbufplc);
+    globalmipmax = setupmips();
 
     globalx2 += globaly2*(x1-1);
     globaly1 += globalx1*(x1-1);
@@ -1283,7 +1374,7 @@ static void florscan (int32_t x1, int32_t x2, int32_t sectnum)
  *
  *  --ryan.
  */
-IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
+HOT_CODE(wallscan) static void wallscan(int32_t x1, int32_t x2,
                      int16_t *uwal, int16_t *dwal,
                      int32_t *swal, int32_t *lwal)
 {
@@ -1291,6 +1382,7 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
     intptr_t i;
     uint8_t* fpalookup;
     int32_t y1ve[4], y2ve[4], u4, d4, z, tileWidth, tsizy;
+    int32_t col[4], level, mipmax;
     uint8_t  bad;
 
     tileWidth = tiles[globalpicnum].dim.width;
@@ -1321,6 +1413,12 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
 
     setupvlineasm(globalshiftval);
 
+    // Mip levels are addressed by shifting, so power-of-two tiles only
+    mipmax = setupmips();
+    if (!xnice || !ynice)
+        mipmax = 0;
+    level = 0;
+
     //Starting on the left column of the wall, check the occlusion arrays.
     x = x1;
     while ((umost[x] > dmost[x]) && (x <= x2))
@@ -1335,6 +1433,9 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
 
         palookupoffse[0] = fpalookup+(getpalookup((int32_t)mulscale16(swal[x],globvis),globalshade)<<8);
 
+        vince[0] = swal[x]*globalyscale;
+        vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
+
         bufplce[0] = lwal[x] + globalxpanning;
         
         if (bufplce[0] >= tileWidth)
@@ -1345,15 +1446,19 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
                 bufplce[0] &= tileWidth;
         }
 
+        if (mipmax)
+        {
+            level = miplevel(vince[0],globalshiftval,mipmax);
+            setupvlineasm(globalshiftval+level);
+            mipcount(y2ve[0]-y1ve[0],miptexels(vince[0],globalshiftval),tiles[globalpicnum].dim.height,level);
+        }
+
         if (ynice == 0)
             bufplce[0] *= tsizy;
         else
-            bufplce[0] <<= tsizy;
-
-        vince[0] = swal[x]*globalyscale;
-        vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
+            bufplce[0] = (bufplce[0]>>level)<<(tsizy-level);
 
-        vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0]+tiles[globalpicnum].data,x+frameoffset+ylookup[y1ve[0]]);
+        vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0]+globalmipbase[level],x+frameoffset+ylookup[y1ve[0]]);
     }
     
     for(; x<=x2-3; x+=4)
@@ -1375,11 +1480,7 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
                 if (xnice == 0) i %= tileWidth;
                 else i &= tileWidth;
             }
-            if (ynice == 0)
-                i *= tsizy;
-            else
-                i <<= tsizy;
-            bufplce[z] = tiles[globalpicnum].data+i;
+            col[z] = i;
 
             vince[z] = swal[x+z]*globalyscale;
             vplce[z] = globalzd + vince[z]*(y1ve[z]-globalhoriz+1);
@@ -1388,6 +1489,28 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
         if (bad == 15)
             continue;
 
+        // vlineasm4() shares one shift, so the group takes the sharpest
+        // level any of its columns wants
+        if (mipmax)
+        {
+            level = mipmax;
+            for(z=3; z>=0; z--)
+                if (!(bad&pow2char[z]))
+                    level = min(level,miplevel(vince[z],globalshiftval,mipmax));
+            setupvlineasm(globalshiftval+level);
+            for(z=3; z>=0; z--)
+                if (!(bad&pow2char[z]))
+                    mipcount(y2ve[z]-y1ve[z]+1,miptexels(vince[z],globalshiftval),tiles[globalpicnum].dim.height,level);
+        }
+        for(z=3; z>=0; z--)
+        {
+            if (ynice == 0)
+                i = col[z]*tsizy;
+            else
+                i = (col[z]>>level)<<(tsizy-level);
+            bufplce[z] = globalmipbase[level]+i;
+        }
+
         palookupoffse[0] = fpalookup+(getpalookup((int32_t)mulscale16(swal[x],globvis),globalshade)<<8);
         palookupoffse[3] = fpalookup+(getpalookup((int32_t)mulscale16(swal[x+3],globvis),globalshade)<<8);
 
@@ -1450,6 +1573,9 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
 
         palookupoffse[0] = fpalookup+(getpalookup((int32_t)mulscale16(swal[x],globvis),globalshade)<<8);
 
+        vince[0] = swal[x]*globalyscale;
+        vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
+
         bufplce[0] = lwal[x] + globalxpanning;
         if (bufplce[0] >= tileWidth) {
             if (xnice == 0)
@@ -1457,23 +1583,29 @@ IRAM_ATTR static void wallscan(int32_t x1, int32_t x2,
             else
                 bufplce[0] &= tileWidth;
         }
+
+        if (mipmax)
+        {
+            level = miplevel(vince[0],globalshiftval,mipmax);
+            setupvlineasm(globalshiftval+level);
+            mipcount(y2ve[0]-y1ve[0],miptexels(vince[0],globalshiftval),tiles[globalpicnum].dim.height,level);
+        }
         
         if (ynice == 0) bufplce[0]
             *= tsizy;
         else
-            bufplce[0] <<= tsizy;
-
-        vince[0] = swal[x]*globalyscale;
-        vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
+            bufplce[0] = (bufplce[0]>>level)<<(tsizy-level);
 
-        vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0]+tiles[globalpicnum].data,x+frameoffset+ylookup[y1ve[0]]);
+        vlineasm1(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0]+globalmipbase[level],x+frameoffset+ylookup[y1ve[0]]);
     }
+    if (mipmax)
+        setupvlineasm(globalshiftval);
     faketimerhandler();
 }
 
 
 /* this renders masking sprites. See wallscan(). --ryan. */
-IRAM_ATTR static void maskwallscan(int32_t x1, int32_t x2,
+HOT_CODE(maskwallscan) static void maskwallscan(int32_t x1, int32_t x2,
                          short *uwal, short *dwal,
                          int32_t *swal, int32_t *lwal)
 {
@@ -1483,6 +1615,7 @@ IRAM_ATTR static void maskwallscan(int32_t x1, int32_t x2,
     int32_t y1ve[4], y2ve[4], u4, d4, dax, z, tileWidth, tileHeight;
     uint8_t*  p;
     uint8_t  bad;
+    uint16_t *spans;
 
     tileWidth = tiles[globalpicnum].dim.width;
     tileHeight = tiles[globalpicnum].dim.height;
@@ -1496,6 +1629,7 @@ IRAM_ATTR static void maskwallscan(int32_t x1, int32_t x2,
         return;
 
     TILE_MakeAvailable(globalpicnum);
+    spans = tilegetspans(globalpicnum);
 
     startx = x1;
 
@@ -1516,6 +1650,37 @@ IRAM_ATTR static void maskwallscan(int32_t x1, int32_t x2,
 
     p = x+frameoffset;
 
+    // With the opaque runs known every column is walked on its own
+    if (spans != NULL)
+    {
+        int32_t spanheight = tiles[globalpicnum].dim.height;
+        uint16_t *runs = spans+tiles[globalpicnum].dim.width+1;
+
+        for(; x<=x2; x++,p++)
+        {
+            y1ve[0] = max(uwal[x],startumost[x+windowx1]-windowy1);
+            y2ve[0] = min(dwal[x],startdmost[x+windowx1]-windowy1);
+            if (y2ve[0] <= y1ve[0]) continue;
+
+            palookupoffse[0] = fpalookup+(getpalookup((int32_t)mulscale16(swal[x],globvis),globalshade)<<8);
+
+            i = lwal[x] + globalxpanning;
+            if (i >= tileWidth) {
+                if (xnice == 0) i %= tileWidth;
+                else i &= tileWidth;
+            }
+            bufplce[0] = tiles[globalpicnum].data+(ynice ? (i<<tileHeight) : i*tileHeight);
+
+            vince[0] = swal[x]*globalyscale;
+            vplce[0] = globalzd + vince[0]*(y1ve[0]-globalhoriz+1);
+
+            mvlineasm1runs(vince[0],palookupoffse[0],y2ve[0]-y1ve[0]-1,vplce[0],bufplce[0],p+ylookup[y1ve[0]],
+                           runs+spans[i]*2,spans[i+1]-spans[i],spanheight);
+        }
+        faketimerhandler();
+        return;
+    }
+
     for(; (x<=x2)&&((p-(uint8_t*)NULL)&3); x++,p++)
     {
         y1ve[0] = max(uwal[x],startumost[x+windowx1]-windowy1);
@@ -1635,7 +1800,7 @@ IRAM_ATTR static void maskwallscan(int32_t x1, int32_t x2,
 }
 
 /* renders parallaxed skies/floors  --ryan. */
-IRAM_ATTR static void parascan(int32_t dax1, int32_t dax2, int32_t sectnum,uint8_t  dastat, int32_t bunch)
+HOT_CODE(parascan) static void parascan(int32_t dax1, int32_t dax2, int32_t sectnum,uint8_t  dastat, int32_t bunch)
 {
     sectortype *sec;
     int32_t j, k, l, m, n, x, z, wallnum, nextsectnum, globalhorizbak;
@@ -2701,7 +2866,7 @@ static void dosetaspect(void)
 
   Return: pvWallID1 in the potentially visible wall list is in front of pvWallID2 (in the same potentially visible list)
 */
-IRAM_ATTR int wallfront(int32_t pvWallID1, int32_t pvWallID2)
+HOT_CODE(wallfront) int wallfront(int32_t pvWallID1, int32_t pvWallID2)
 {
     walltype *wal;
     int32_t x11, y11, x21, y21, x12, y12, x22, y22, dx, dy, t1, t2;
@@ -3094,7 +3259,7 @@ void drawrooms(int32_t daposx, int32_t daposy, int32_t daposz,short daang, int32
 }
 
 
-IRAM_ATTR static int spritewallfront (spritetype *s, int32_t w)
+HOT_CODE(spritewallfront) static int spritewallfront (spritetype *s, int32_t w)
 {
     walltype *wal;
     int32_t x1, y1;
@@ -3107,7 +3272,10 @@ IRAM_ATTR static int spritewallfront (spritetype *s, int32_t w)
 }
 
 
-IRAM_ATTR static void transmaskvline(int32_t x)
+// Opaque runs of the tile transmaskwallscan() is drawing, or NULL
+static uint16_t *globalspans;
+
+HOT_CODE(transmaskvline) static void transmaskvline(int32_t x)
 {
     int32_t vplc, vinc, i, palookupoffs;
     intptr_t bufplc, p;
@@ -3134,12 +3302,17 @@ IRAM_ATTR static void transmaskvline(int32_t x)
 
     p = ylookup[y1v]+x+frameoffset;
 
-    tvlineasm1(vinc,palookupoffs,y2v-y1v,vplc,bufplc,p);
+    if (globalspans != NULL)
+        tvlineasm1runs(vinc,palookupoffs,y2v-y1v,vplc,bufplc,p,
+                       globalspans+tiles[globalpicnum].dim.width+1+globalspans[i]*2,
+                       globalspans[i+1]-globalspans[i],tiles[globalpicnum].dim.height);
+    else
+        tvlineasm1(vinc,palookupoffs,y2v-y1v,vplc,bufplc,p);
 
     transarea += y2v-y1v;
 }
 
-IRAM_ATTR static void transmaskvline2 (int32_t x)
+HOT_CODE(transmaskvline2) static void transmaskvline2 (int32_t x)
 {
     int32_t y1, y2, x2;
     intptr_t i;
@@ -3221,7 +3394,7 @@ IRAM_ATTR static void transmaskvline2 (int32_t x)
     faketimerhandler();
 }
 
-IRAM_ATTR static void transmaskwallscan(int32_t x1, int32_t x2)
+HOT_CODE(transmaskwallscan) static void transmaskwallscan(int32_t x1, int32_t x2)
 {
     int32_t x;
 
@@ -3233,61 +3406,30 @@ IRAM_ATTR static void transmaskwallscan(int32_t x1, int32_t x2)
         return;
 
     TILE_MakeAvailable(globalpicnum);
+    globalspans = tilegetspans(globalpicnum);
 
     x = x1;
     while ((startumost[x+windowx1] > startdmost[x+windowx1]) && (x <= x2)) x++;
-    if ((x <= x2) && (x&1)) transmaskvline(x), x++;
-    while (x < x2) transmaskvline2(x), x += 2;
+    if (globalspans == NULL)
+    {
+        if ((x <= x2) && (x&1)) transmaskvline(x), x++;
+        while (x < x2) transmaskvline2(x), x += 2;
+    }
     while (x <= x2) transmaskvline(x), x++;
     faketimerhandler();
 }
 
-int loadboard(char  *filename, int32_t *daposx, int32_t *daposy,
-              int32_t *daposz, short *daang, short *dacursectnum)
+/* Reads the sector, wall and sprite records of a v7 map. */
+static void loadboardrecords(short fil, sectortype *sec, walltype *wal, spritetype *spr,
+                             short *nsect, short *nwall, short *nspr)
 {
     int x;
-    short fil, i, numsprites;
     sectortype *sect;
     spritetype *s;
     walltype *w;
 
-    x = 0;
-
-    // FIX_00058: Save/load game crash in both single and multiplayer
-    // We have to reset those arrays since the same
-    // arrays are used as temporary space in the
-    // compilecons() function like "label = (uint8_t  *)&sprite[0];"
-    // to save memory space I guess.
-    // Not reseting the array will leave dumps fooling
-    // the function saveplayer(), eg at if(actorscrptr[PN] == 0)
-    // where PN is sprite[i].picnum was beyong actorscrptr[] size)
-    memset(sprite, 0, sizeof(sprite));
-    memset(sector, 0, sizeof(sector));
-    memset(wall, 0, sizeof(wall));
-
-    if ((fil = kopen4load(filename, 0)) == -1)
-    {
-        mapversion = 7L;
-        return(-1);
-    }
-
-    kread32(fil,&mapversion);
-    if (mapversion != 7L) return(-1);
-
-    initspritelists();
-
-    clearbuf(&show2dsector[0],(int32_t)((MAXSECTORS+3)>>5),0L);
-    clearbuf(&show2dsprite[0],(int32_t)((MAXSPRITES+3)>>5),0L);
-    clearbuf(&show2dwall[0],(int32_t)((MAXWALLS+3)>>5),0L);
-
-    kread32(fil,daposx);
-    kread32(fil,daposy);
-    kread32(fil,daposz);
-    kread16(fil,daang);
-    kread16(fil,dacursectnum);
-    kread16(fil,&numsectors);
-
-    for (x = 0, sect = &sector[0]; x < numsectors; x++, sect++)
+    kread16(fil,nsect);
+    for (x = 0, sect = sec; x < *nsect; x++, sect++)
     {
         kread16(fil,&sect->wallptr);
         kread16(fil,&sect->wallnum);
@@ -3314,8 +3456,8 @@ int loadboard(char  *filename, int32_t *daposx, int32_t *daposy,
         kread16(fil,&sect->extra);
     }
 
-    kread16(fil,&numwalls);
-    for (x = 0, w = &wall[0]; x < numwalls; x++, w++)
+    kread16(fil,nwall);
+    for (x = 0, w = wal; x < *nwall; x++, w++)
     {
         kread32(fil,&w->x);
         kread32(fil,&w->y);
@@ -3336,8 +3478,8 @@ int loadboard(char  *filename, int32_t *daposx, int32_t *daposy,
         kread16(fil,&w->extra);
     }
 
-    kread16(fil,&numsprites);
-    for (x = 0, s = &sprite[0]; x < numsprites; x++, s++)
+    kread16(fil,nspr);
+    for (x = 0, s = spr; x < *nspr; x++, s++)
     {
         kread32(fil,&s->x);
         kread32(fil,&s->y);
@@ -3363,7 +3505,47 @@ int loadboard(char  *filename, int32_t *daposx, int32_t *daposy,
         kread16(fil,&s->hitag);
         kread16(fil,&s->extra);
     }
+}
+
+int loadboard(char  *filename, int32_t *daposx, int32_t *daposy,
+              int32_t *daposz, short *daang, short *dacursectnum)
+{
+    short fil, i, numsprites;
+
+    // FIX_00058: Save/load game crash in both single and multiplayer
+    // We have to reset those arrays since the same
+    // arrays are used as temporary space in the
+    // compilecons() function like "label = (uint8_t  *)&sprite[0];"
+    // to save memory space I guess.
+    // Not reseting the array will leave dumps fooling
+    // the function saveplayer(), eg at if(actorscrptr[PN] == 0)
+    // where PN is sprite[i].picnum was beyong actorscrptr[] size)
+    memset(sprite, 0, sizeof(sprite));
+    memset(sector, 0, sizeof(sector));
+    memset(wall, 0, sizeof(wall));
+
+    if ((fil = kopen4load(filename, 0)) == -1)
+    {
+        mapversion = 7L;
+        return(-1);
+    }
 
+    kread32(fil,&mapversion);
+    if (mapversion != 7L) return(-1);
+
+    initspritelists();
+
+    clearbuf(&show2dsector[0],(int32_t)((MAXSECTORS+3)>>5),0L);
+    clearbuf(&show2dsprite[0],(int32_t)((MAXSPRITES+3)>>5),0L);
+    clearbuf(&show2dwall[0],(int32_t)((MAXWALLS+3)>>5),0L);
+
+    kread32(fil,daposx);
+    kread32(fil,daposy);
+    kread32(fil,daposz);
+    kread16(fil,daang);
+    kread16(fil,dacursectnum);
+
+    loadboardrecords(fil, sector, wall, sprite, &numsectors, &numwalls, &numsprites);
 
     for(i=0; i<numsprites; i++)
         insertsprite(sprite[i].sectnum,sprite[i].statnum);
@@ -3379,10 +3561,50 @@ int loadboard(char  *filename, int32_t *daposx, int32_t *daposy,
     mapCRC += crc16((uint8_t *)wall, numwalls*sizeof(walltype));
     mapCRC += crc16((uint8_t *)sprite, numsprites*sizeof(spritetype));
 
+    strncpy(loadedboardname, filename, sizeof(loadedboardname)-1);
+    loadedboardname[sizeof(loadedboardname)-1] = 0;
+
+    resetcanseecache();
+    resetzrangecache();
+
     return(0);
 }
 
 
+/*
+ * Reads the records of a map into caller-supplied MAXSECTORS/MAXWALLS/
+ * MAXSPRITES arrays without touching the live board. Used as the reference
+ * image for delta-encoded save games. Returns the map CRC or -1.
+ */
+int32_t loadboardbase(char *filename, sectortype *sec, walltype *wal, spritetype *spr)
+{
+    short fil, nsect, nwall, nspr, dummy16;
+    int32_t version, dummy32;
+    uint16_t crc;
+
+    memset(sec, 0, sizeof(sectortype)*MAXSECTORS);
+    memset(wal, 0, sizeof(walltype)*MAXWALLS);
+    memset(spr, 0, sizeof(spritetype)*MAXSPRITES);
+
+    if ((fil = kopen4load(filename, 0)) == -1) return(-1);
+    kread32(fil,&version);
+    if (version != 7L) { kclose(fil); return(-1); }
+
+    kread32(fil,&dummy32);
+    kread32(fil,&dummy32);
+    kread32(fil,&dummy32);
+    kread16(fil,&dummy16);
+    kread16(fil,&dummy16);
+    loadboardrecords(fil, sec, wal, spr, &nsect, &nwall, &nspr);
+    kclose(fil);
+
+    crc = crc16((uint8_t *)sec, nsect*sizeof(sectortype));
+    crc += crc16((uint8_t *)wal, nwall*sizeof(walltype));
+    crc += crc16((uint8_t *)spr, nspr*sizeof(spritetype));
+    return(crc);
+}
+
+
 static void write32(int f, int32_t val)
 {
     val = BUILDSWAP_INTEL32(val);
@@ -3619,6 +3841,46 @@ static void initfastcolorlookup(int32_t rscale, int32_t gscale, int32_t bscale)
     colscan[26] = i;
 }
 
+static int getclosestcolsearch(int32_t r, int32_t g, int32_t b);
+
+static void initinvcolmap(void)
+{
+    int32_t fil, i, r, g, b, hdr[2];
+    uint32_t crc;
+    FILE *out;
+
+    if (invcolmap == NULL && (invcolmap = (uint8_t *)kkmalloc(1<<(INVCOLBITS*3))) == NULL)
+        return;
+    crc = crc32_update(palette, 768, 0);
+
+    if ((fil = kopen4load(INVCOLFILE,0)) != -1)
+    {
+        if (kread(fil,hdr,8) == 8 && hdr[0] == INVCOLMAGIC && (uint32_t)hdr[1] == crc &&
+            kread(fil,invcolmap,1<<(INVCOLBITS*3)) == 1<<(INVCOLBITS*3))
+        {
+            kclose(fil);
+            return;
+        }
+        kclose(fil);
+    }
+
+    /* Cell values are spread over 0..63 so both ends are exact */
+    i = 0;
+    for(r=0; r<(1<<INVCOLBITS); r++)
+        for(g=0; g<(1<<INVCOLBITS); g++)
+            for(b=0; b<(1<<INVCOLBITS); b++)
+                invcolmap[i++] = getclosestcolsearch((r<<1)|(r>>4),(g<<1)|(g>>4),(b<<1)|(b>>4));
+
+    if ((out = fopen(INVCOLFILE,"wb")) != NULL)
+    {
+        hdr[0] = INVCOLMAGIC;
+        hdr[1] = crc;
+        fwrite(hdr,8,1,out);
+        fwrite(invcolmap,1<<(INVCOLBITS*3),1,out);
+        fclose(out);
+    }
+}
+
 EXT_RAM_ATTR extern uint8_t lastPalette[768];
 static void loadpalette(void)
 {
@@ -3658,6 +3920,9 @@ static void loadpalette(void)
 
     kread(fil,palookup[globalpal],numpalookups<<8);
 
+    // Every derived palookup was built from the old palette and shade table
+    memset(palookupkeys,0,sizeof(palookupkeys));
+
 
     /*kread(fil,transluc,65536);*/
     for (k = 0; k < (65536 / 4); k++)
@@ -3668,6 +3933,7 @@ static void loadpalette(void)
     kclose(fil);
 
     initfastcolorlookup(30L,59L,11L);
+    initinvcolmap();
 
     paletteloaded = 1;
 
@@ -3844,7 +4110,90 @@ static int clippoly4(int32_t cx1, int32_t cy1, int32_t cx2, int32_t cy2)
 
 
 
-IRAM_ATTR static void  dorotatesprite (int32_t sx, int32_t sy, int32_t z, short a, short picnum,
+/*
+ * Unrotated rotatesprite at an integer scale z: every texel covers a
+ * (z>>16) pixel square, so the clipped rectangle is drawn row by row with
+ * blitrow() instead of clipping a polygon and stepping columns. Column c
+ * shows texel ((c<<16)+65535-gx1)/z, the same mapping as the general path.
+ * Returns 0 when the sprite has to take the general path.
+ */
+static uint32_t rotatespriteblitsnow = 0, rotatespritedrawsnow = 0;
+uint32_t rotatespriteblits = 0, rotatespritedraws = 0;
+
+static int blitrotatesprite(int32_t gx1, int32_t gy1, int32_t z, short picnum,
+                            int8_t dashade, uint8_t  dapalnum, uint8_t  dastat, int32_t cx1,
+                            int32_t cy1, int32_t cx2, int32_t cy2)
+{
+    int32_t x, y, x1, y1, x2, y2, q, tx, ty, phase, scale, mode;
+    short tileWidht, tileHeight;
+    uint8_t* bufplc;
+    uint8_t* palookupoffs;
+
+    tileWidht = tiles[picnum].dim.width;
+    tileHeight = tiles[picnum].dim.height;
+    scale = (z>>16);
+
+    if ((scale*tileWidht >= 32768) || (scale*tileHeight >= 32768))
+        return 0;
+    if ((vidoption == 1) && (dastat&128) && (origbuffermode == 0))
+        return 0;
+
+    x1 = max(gx1>>16,cx1);
+    y1 = max(gy1>>16,cy1);
+    x2 = min((gx1+tileWidht*z)>>16,cx2+1);
+    y2 = min((gy1+tileHeight*z)>>16,cy2+1);
+    if ((x2 <= x1) || (y2 <= y1))
+        return 1;
+
+    /* Rows are drawn whole, so any column clip below the rectangle bails */
+    if ((dastat&8) == 0)
+        for(x=x1; x<x2; x++)
+            if ((startumost[x] > y1) || (startdmost[x] < y2))
+                return 0;
+
+    if ((vidoption != 1) || (origbuffermode != 0))
+        if (dastat&8)
+            permanentupdate = 1;
+
+    TILE_MakeAvailable(picnum);
+
+    setgotpic(picnum);
+    bufplc = tiles[picnum].data;
+
+    palookupoffs = palookup[dapalnum] + (getpalookup(0L,(int32_t)dashade)<<8);
+
+    if (dastat&1)
+    {
+        mode = BLIT_TRANS;
+        settrans((dastat&32) ? TRANS_REVERSE : TRANS_NORMAL);
+        transarea += (x2-x1)*(y2-y1);
+    }
+    else if (dastat&64)
+        mode = BLIT_OPAQUE;
+    else
+        mode = BLIT_MASKED;
+
+    q = (x1<<16)+65535-gx1;
+    tx = q/z;
+    phase = (q-tx*z)>>16;
+
+    for(y=y1; y<y2; y++)
+    {
+        ty = ((y<<16)+65535-gy1)/z;
+        if (dastat&4)
+            ty = tileHeight-1-ty;
+
+        blitrow(bufplc+tx*tileHeight+ty,tileHeight,phase,scale,x2-x1,palookupoffs,mode,ylookup[y]+x1+frameplace);
+
+        if ((y&31) == 0) faketimerhandler();
+    }
+
+    rotatespriteblitsnow++;
+    return 1;
+}
+
+
+HOT_CODE(dorotatesprite) static void  dorotatesprite (int32_t sx, int32_t sy, int32_t z, short a, short picnum,
                             int8_t dashade, uint8_t  dapalnum, uint8_t  dastat, int32_t cx1,
                             int32_t cy1, int32_t cx2, int32_t cy2)
 {
@@ -3972,6 +4321,12 @@ IRAM_ATTR static void  dorotatesprite (int32_t sx, int32_t sy, int32_t z, short
     gx1 = pvWalls[0].cameraSpaceCoo[0][VEC_X];
     gy1 = pvWalls[0].cameraSpaceCoo[0][VEC_Y];   /* back up these before clipping */
 
+    rotatespritedrawsnow++;
+    if (((a&2047) == 0) && (xv == xv2) && ((xv&65535) == 0) && (xv > 0) &&
+        ((yxaspect == 65536) || (((dastat&2) == 0) && (dastat&8))))
+        if (blitrotatesprite(gx1,gy1,xv,picnum,dashade,dapalnum,dastat,cx1,cy1,cx2,cy2))
+            return;
+
     if ((npoints = clippoly4(cx1<<16,cy1<<16,(cx2+1)<<16,(cy2+1)<<16)) < 3) return;
 
     lx = pvWalls[0].cameraSpaceCoo[0][VEC_X];
@@ -4395,7 +4750,7 @@ IRAM_ATTR static void  dorotatesprite (int32_t sx, int32_t sy, int32_t z, short
 }
 
 
-IRAM_ATTR void nextpage(void)
+HOT_CODE(nextpage) void nextpage(void)
 {
     int32_t i;
     permfifotype *per;
@@ -4412,6 +4767,14 @@ IRAM_ATTR void nextpage(void)
 
     _nextpage();  /* video driver specific. */
 
+    tilecacheupdate();
+    mipfetchfull = mipfetchfullnow;
+    mipfetchactual = mipfetchactualnow;
+    mipfetchfullnow = mipfetchactualnow = 0;
+    rotatespriteblits = rotatespriteblitsnow;
+    rotatespritedraws = rotatespritedrawsnow;
+    rotatespriteblitsnow = rotatespritedrawsnow = 0;
+
 
     if (qsetmode == 200)
     {
@@ -4442,7 +4805,7 @@ IRAM_ATTR void nextpage(void)
 
 
 
-IRAM_ATTR int clipinsidebox(int32_t x, int32_t y, short wallnum, int32_t walldist)
+HOT_CODE(clipinsidebox) int clipinsidebox(int32_t x, int32_t y, short wallnum, int32_t walldist)
 {
     walltype *wal;
     int32_t x1, y1, x2, y2, r;
@@ -4477,7 +4840,7 @@ IRAM_ATTR int clipinsidebox(int32_t x, int32_t y, short wallnum, int32_t walldis
     return((x2 >= y2)<<1);
 }
 
-IRAM_ATTR static int clipinsideboxline(int32_t x, int32_t y, int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t walldist)
+HOT_CODE(clipinsideboxline) static int clipinsideboxline(int32_t x, int32_t y, int32_t x1, int32_t y1, int32_t x2, int32_t y2, int32_t walldist)
 {
     int32_t r;
 
@@ -4511,7 +4874,7 @@ IRAM_ATTR static int clipinsideboxline(int32_t x, int32_t y, int32_t x1, int32_t
 }
 
 
-IRAM_ATTR void drawline256 (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint8_t  col)
+HOT_CODE(drawline256) void drawline256 (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint8_t  col)
 {
     int32_t dx, dy, i, j, inc, plc, daend;
     uint8_t* p;
@@ -4609,7 +4972,7 @@ IRAM_ATTR void drawline256 (int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint
  If it is an even nymber of time:(x,y) is outside the sector.
  */
 
-IRAM_ATTR int inside(int32_t x, int32_t y, short sectnum)
+HOT_CODE(inside) int inside(int32_t x, int32_t y, short sectnum)
 {
     walltype *wal;
     int32_t i, x1, y1, x2, y2;
@@ -4662,7 +5025,7 @@ IRAM_ATTR int inside(int32_t x, int32_t y, short sectnum)
 }
 
 
-IRAM_ATTR int getangle(int32_t xvect, int32_t yvect)
+HOT_CODE(getangle) int getangle(int32_t xvect, int32_t yvect)
 {
     if ((xvect|yvect) == 0)
         return(0);
@@ -4816,7 +5179,7 @@ static void drawmaskwall(short damaskwallcnt)
 
 
 
-IRAM_ATTR static void ceilspritehline (int32_t x2, int32_t y)
+HOT_CODE(ceilspritehline) static void ceilspritehline (int32_t x2, int32_t y)
 {
     int32_t x1, v, bx, by;
 
@@ -4847,7 +5210,7 @@ IRAM_ATTR static void ceilspritehline (int32_t x2, int32_t y)
 }
 
 
-IRAM_ATTR static void ceilspritescan (int32_t x1, int32_t x2)
+HOT_CODE(ceilspritescan) static void ceilspritescan (int32_t x1, int32_t x2)
 {
     int32_t x, y1, y2, twall, bwall;
 
@@ -4884,7 +5247,7 @@ IRAM_ATTR static void ceilspritescan (int32_t x1, int32_t x2)
     faketimerhandler();
 }
 
-IRAM_ATTR static void drawsprite (int32_t snum)
+HOT_CODE(drawsprite) static void drawsprite (int32_t snum)
 {
     spritetype *tspr;
     sectortype *sec;
@@ -5917,30 +6280,172 @@ void drawmasks(void)
 }
 
 
-int setsprite(short spritenum, int32_t newx, int32_t newy, int32_t newz)
+/*
+ * Uniform grid of sprite positions for proximity queries.
+ *
+ * Sprites are filed by the 1024-unit cell of their position. setsprite()
+ *  and changespritesect() refile them, insertsprite() parks them unfiled
+ *  (callers set x/y after inserting) and deletesprite() drops them. Game
+ *  code also moves sprites by writing x/y directly, so the grid is rebuilt
+ *  from the status lists on the first query after flushspritehash(),
+ *  which the game calls between its movement passes, and queries widen
+ *  their square by SPRITEHASH_SLACK to cover moves made since.
+ *
+ * The grid wraps every SPRITEHASH_DIM cells; queries check each sprite's
+ *  live position, so aliasing only costs time.
+ */
+#define SPRITEHASH_SHIFT 10
+#define SPRITEHASH_BITS 5
+#define SPRITEHASH_DIM (1<<SPRITEHASH_BITS)
+#define SPRITEHASH_UNFILED (SPRITEHASH_DIM*SPRITEHASH_DIM)
+#define SPRITEHASH_SLACK 1024
+
+static short spritehashhead[SPRITEHASH_UNFILED+1];
+EXT_RAM_ATTR static short spritehashnext[MAXSPRITES] __psram_bss("spritehashnext");
+EXT_RAM_ATTR static short spritehashprev[MAXSPRITES] __psram_bss("spritehashprev");
+EXT_RAM_ATTR static short spritehashbucket[MAXSPRITES] __psram_bss("spritehashbucket");
+EXT_RAM_ATTR uint32_t spritehashtouched[MAXSPRITES] __psram_bss("spritehashtouched");
+uint32_t spritehashclock = 0;
+uint32_t spritehashqueries, spritehashfound;
+static uint8_t spritehashstale = 1;
+
+static inline short spritehashcell(int32_t x, int32_t y)
 {
-    short tempsectnum;
+    return(((x>>SPRITEHASH_SHIFT)&(SPRITEHASH_DIM-1)) +
+           (((y>>SPRITEHASH_SHIFT)&(SPRITEHASH_DIM-1))<<SPRITEHASH_BITS));
+}
 
-    sprite[spritenum].x = newx;
-    sprite[spritenum].y = newy;
-    sprite[spritenum].z = newz;
+static void spritehashlink(short i, short bucket)
+{
+    spritehashprev[i] = -1;
+    spritehashnext[i] = spritehashhead[bucket];
+    if (spritehashhead[bucket] >= 0)
+        spritehashprev[spritehashhead[bucket]] = i;
+    spritehashhead[bucket] = i;
+    spritehashbucket[i] = bucket;
+}
 
-    tempsectnum = sprite[spritenum].sectnum;
-    updatesector(newx,newy,&tempsectnum);
-    if (tempsectnum < 0)
-        return(-1);
-    if (tempsectnum != sprite[spritenum].sectnum)
-        changespritesect(spritenum,tempsectnum);
+static void spritehashunlink(short i)
+{
+    if (spritehashbucket[i] < 0)
+        return;
 
-    return(0);
+    if (spritehashhead[spritehashbucket[i]] == i)
+        spritehashhead[spritehashbucket[i]] = spritehashnext[i];
+    if (spritehashprev[i] >= 0) spritehashnext[spritehashprev[i]] = spritehashnext[i];
+    if (spritehashnext[i] >= 0) spritehashprev[spritehashnext[i]] = spritehashprev[i];
+    spritehashbucket[i] = -1;
 }
 
-
-void initspritelists(void)
+static void spritehashfile(short i, short bucket)
 {
-    int32_t i;
+    if (spritehashstale)
+        return;
 
-    for (i=0; i<MAXSECTORS; i++)   /* Init doubly-linked sprite sector lists */
+    spritehashtouched[i] = ++spritehashclock;
+    if (spritehashbucket[i] == bucket)
+        return;
+    spritehashunlink(i);
+    spritehashlink(i,bucket);
+}
+
+static void spritehashrebuild(void)
+{
+    int32_t i;
+    short j;
+
+    for(i=0; i<=SPRITEHASH_UNFILED; i++)
+        spritehashhead[i] = -1;
+    clearbufbyte(spritehashbucket,sizeof(spritehashbucket),-1L);
+
+    for(i=0; i<MAXSTATUS; i++)
+        for(j=headspritestat[i]; j>=0; j=nextspritestat[j])
+            spritehashlink(j,spritehashcell(sprite[j].x,sprite[j].y));
+
+    spritehashstale = 0;
+}
+
+
+void flushspritehash(void)
+{
+    spritehashstale = 1;
+}
+
+
+static int32_t spritehashscan(short bucket, int32_t x, int32_t y, int32_t r,
+                              short *list, int32_t maxlist, int32_t n)
+{
+    short i;
+
+    for(i=spritehashhead[bucket]; i>=0; i=spritehashnext[i])
+        if ((klabs(sprite[i].x-x) <= r) && (klabs(sprite[i].y-y) <= r))
+        {
+            if (n < maxlist) list[n] = i;
+            n++;
+        }
+    return(n);
+}
+
+
+/*
+ * Sprites whose live x and y are both within r of (x, y), in no
+ *  particular order. Returns how many there are; only the first maxlist
+ *  are stored, so callers scan the old way when it comes back larger.
+ */
+int32_t getspritesnear(int32_t x, int32_t y, int32_t r, short *list, int32_t maxlist)
+{
+    int32_t cx, cy, cx1, cy1, cx2, cy2, n;
+
+    if (spritehashstale)
+        spritehashrebuild();
+
+    cx1 = (x-r-SPRITEHASH_SLACK)>>SPRITEHASH_SHIFT;
+    cx2 = (x+r+SPRITEHASH_SLACK)>>SPRITEHASH_SHIFT;
+    cy1 = (y-r-SPRITEHASH_SLACK)>>SPRITEHASH_SHIFT;
+    cy2 = (y+r+SPRITEHASH_SLACK)>>SPRITEHASH_SHIFT;
+    if (cx2-cx1 >= SPRITEHASH_DIM) { cx1 = 0; cx2 = SPRITEHASH_DIM-1; }
+    if (cy2-cy1 >= SPRITEHASH_DIM) { cy1 = 0; cy2 = SPRITEHASH_DIM-1; }
+
+    n = 0;
+    for(cy=cy1; cy<=cy2; cy++)
+        for(cx=cx1; cx<=cx2; cx++)
+            n = spritehashscan((cx&(SPRITEHASH_DIM-1)) + ((cy&(SPRITEHASH_DIM-1))<<SPRITEHASH_BITS),
+                               x,y,r,list,maxlist,n);
+    n = spritehashscan(SPRITEHASH_UNFILED,x,y,r,list,maxlist,n);
+
+    spritehashqueries++;
+    spritehashfound += n;
+    return(n);
+}
+
+
+int setsprite(short spritenum, int32_t newx, int32_t newy, int32_t newz)
+{
+    short tempsectnum;
+
+    sprite[spritenum].x = newx;
+    sprite[spritenum].y = newy;
+    sprite[spritenum].z = newz;
+
+    if (sprite[spritenum].statnum < MAXSTATUS)
+        spritehashfile(spritenum,spritehashcell(newx,newy));
+
+    tempsectnum = sprite[spritenum].sectnum;
+    updatesector(newx,newy,&tempsectnum);
+    if (tempsectnum < 0)
+        return(-1);
+    if (tempsectnum != sprite[spritenum].sectnum)
+        changespritesect(spritenum,tempsectnum);
+
+    return(0);
+}
+
+
+void initspritelists(void)
+{
+    int32_t i;
+
+    for (i=0; i<MAXSECTORS; i++)   /* Init doubly-linked sprite sector lists */
         headspritesect[i] = -1;
     
     headspritesect[MAXSECTORS] = 0;
@@ -5965,13 +6470,20 @@ void initspritelists(void)
     }
     prevspritestat[0] = -1;
     nextspritestat[MAXSPRITES-1] = -1;
+
+    flushspritehash();
 }
 
 
 int insertsprite(short sectnum, short statnum)
 {
+    short i;
+
     insertspritestat(statnum);
-    return(insertspritesect(sectnum));
+    i = insertspritesect(sectnum);
+    if ((i >= 0) && (!spritehashstale))
+        spritehashfile(i,SPRITEHASH_UNFILED);
+    return(i);
 }
 
 
@@ -6027,6 +6539,8 @@ int insertspritestat(short statnum)
 
 int deletesprite(short spritenum)
 {
+    if ((!spritehashstale) && (sprite[spritenum].statnum < MAXSTATUS))
+        spritehashunlink(spritenum);
     deletespritestat(spritenum);
     return(deletespritesect(spritenum));
 }
@@ -6081,6 +6595,8 @@ int changespritesect(short spritenum, short newsectnum)
     if (sprite[spritenum].sectnum == MAXSECTORS) return(-1);
     if (deletespritesect(spritenum) < 0) return(-1);
     insertspritesect(newsectnum);
+    if (sprite[spritenum].statnum < MAXSTATUS)
+        spritehashfile(spritenum,spritehashcell(sprite[spritenum].x,sprite[spritenum].y));
     return(0);
 }
 
@@ -6163,17 +6679,51 @@ int nextsectorneighborz(short sectnum, int32_t thez,
 }
 
 
-int cansee(int32_t x1, int32_t y1, int32_t z1, short sect1,
-           int32_t x2, int32_t y2, int32_t z2, short sect2)
+/*
+ * cansee() front end. The wall walk below is exact but it is the single
+ *  most called engine query in a busy level, so two caches sit in front:
+ *
+ *  - a small memo of exact (x,y,z,sect) pairs. The game flushes it with
+ *    flushcanseecache() whenever sector heights or blocking walls may
+ *    have changed, so a hit always returns what the walk would have.
+ *  - a lazily built sector-pair reject table. Two sectors whose portal
+ *    graph, restricted to the bounding box both sectors span, does not
+ *    connect them can never see each other. Only the walk's "no" answers
+ *    are taken from it; anything reachable still walks.
+ *
+ * Sectors whose walls dragpoint() moves are marked dynamic; they always
+ *  pass the box test and invalidate the table rows built without them.
+ */
+#define CANSEEMEMOSIZ 64
+#define CANSEEPVSROW (MAXSECTORS>>2)
+
+typedef struct
+{
+    int32_t x1, y1, z1, x2, y2, z2;
+    short sect1, sect2;
+    uint16_t epoch;
+    uint8_t result, filler;
+} canseememotype;
+
+int canseecachemode = 3;
+uint32_t canseecalls, canseememohits, canseepvsrejects;
+
+EXT_RAM_ATTR static canseememotype canseememo[CANSEEMEMOSIZ] __psram_bss("canseememo");
+EXT_RAM_ATTR static int32_t canseebox[MAXSECTORS][4] __psram_bss("canseebox");
+EXT_RAM_ATTR static uint16_t canseerowepoch[MAXSECTORS] __psram_bss("canseerowepoch");
+EXT_RAM_ATTR static short canseequeue[MAXSECTORS] __psram_bss("canseequeue");
+static uint8_t canseedynamic[MAXSECTORS>>3], canseevisited[MAXSECTORS>>3];
+static uint8_t *canseepvs = NULL;
+static uint16_t canseeepoch = 1, canseepvsepoch = 1;
+
+static int canseewalk(int32_t x1, int32_t y1, int32_t z1, short sect1,
+                      int32_t x2, int32_t y2, int32_t z2, short sect2)
 {
     sectortype *sec;
     walltype *wal, *wal2;
     int32_t i, cnt, nexts, x, y, z, cz, fz, dasectnum, dacnt, danum;
     int32_t x21, y21, z21, x31, y31, x34, y34, bot, t;
 
-    if ((x1 == x2) && (y1 == y2))
-        return(sect1 == sect2);
-
     x21 = x2-x1;
     y21 = y2-y1;
     z21 = z2-z1;
@@ -6231,6 +6781,185 @@ int cansee(int32_t x1, int32_t y1, int32_t z1, short sect1,
     return(0);
 }
 
+void flushcanseecache(void)
+{
+    if (++canseeepoch == 0)
+    {
+        clearbufbyte(canseememo,sizeof(canseememo),0L);
+        canseeepoch = 1;
+    }
+}
+
+
+void resetcanseecache(void)
+{
+    int32_t i, j, startwall, endwall;
+    walltype *wal;
+
+    for(i=0; i<numsectors; i++)
+    {
+        startwall = sector[i].wallptr;
+        endwall = startwall+sector[i].wallnum;
+        canseebox[i][0] = canseebox[i][1] = 0x7fffffff;
+        canseebox[i][2] = canseebox[i][3] = 0x80000000;
+        for(j=startwall,wal=&wall[startwall]; j<endwall; j++,wal++)
+        {
+            if (wal->x < canseebox[i][0]) canseebox[i][0] = wal->x;
+            if (wal->y < canseebox[i][1]) canseebox[i][1] = wal->y;
+            if (wal->x > canseebox[i][2]) canseebox[i][2] = wal->x;
+            if (wal->y > canseebox[i][3]) canseebox[i][3] = wal->y;
+        }
+    }
+    clearbufbyte(canseedynamic,sizeof(canseedynamic),0L);
+
+    if ((canseepvs == NULL) && ((canseepvs = (uint8_t *)kkmalloc(MAXSECTORS*CANSEEPVSROW)) == NULL))
+        printf("cansee: no memory for sector pair table, using the wall walk only.\n");
+    clearbufbyte(canseerowepoch,sizeof(canseerowepoch),0L);
+    canseepvsepoch = 1;
+
+    flushcanseecache();
+}
+
+
+static void markcanseedynamic(short wallnum)
+{
+    int32_t s;
+
+    s = sectorofwall(wallnum);
+    if ((s < 0) || (canseedynamic[s>>3]&pow2char[s&7]))
+        return;
+    canseedynamic[s>>3] |= pow2char[s&7];
+
+    /* rows built while this sector had a fixed box are stale now */
+    if (++canseepvsepoch == 0)
+    {
+        clearbufbyte(canseerowepoch,sizeof(canseerowepoch),0L);
+        canseepvsepoch = 1;
+    }
+    flushcanseecache();
+}
+
+
+/* Portal flood from sect1 towards sect2, only through sectors overlapping bx. */
+static int canseereachable(short sect1, short sect2, int32_t *bx)
+{
+    int32_t head, tail, s, n, cnt;
+    walltype *wal;
+
+    clearbufbyte(canseevisited,sizeof(canseevisited),0L);
+    canseevisited[sect1>>3] |= pow2char[sect1&7];
+    canseequeue[0] = sect1;
+    head = 0;
+    tail = 1;
+    while (head < tail)
+    {
+        s = canseequeue[head++];
+        for(cnt=sector[s].wallnum,wal=&wall[sector[s].wallptr]; cnt>0; cnt--,wal++)
+        {
+            n = wal->nextsector;
+            if ((n < 0) || (canseevisited[n>>3]&pow2char[n&7]))
+                continue;
+            if (n == sect2)
+                return(1);
+            canseevisited[n>>3] |= pow2char[n&7];
+            if (!(canseedynamic[n>>3]&pow2char[n&7]))
+            {
+                if ((canseebox[n][2] < bx[0]) || (canseebox[n][0] > bx[2])) continue;
+                if ((canseebox[n][3] < bx[1]) || (canseebox[n][1] > bx[3])) continue;
+            }
+            canseequeue[tail++] = n;
+        }
+    }
+    return(0);
+}
+
+
+static int canseesectors(int32_t x1, int32_t y1, short sect1,
+                         int32_t x2, int32_t y2, short sect2)
+{
+    int32_t bx[4], *b1, *b2, lo, hi;
+    uint8_t *row;
+
+    if ((canseedynamic[sect1>>3]&pow2char[sect1&7]) || (canseedynamic[sect2>>3]&pow2char[sect2&7]))
+        return(1);
+
+    /* the segment only stays inside the boxes if both ends are in their own */
+    b1 = canseebox[sect1];
+    b2 = canseebox[sect2];
+    if ((x1 < b1[0]) || (x1 > b1[2]) || (y1 < b1[1]) || (y1 > b1[3])) return(1);
+    if ((x2 < b2[0]) || (x2 > b2[2]) || (y2 < b2[1]) || (y2 > b2[3])) return(1);
+
+    lo = min(sect1,sect2);
+    hi = max(sect1,sect2);
+    row = &canseepvs[lo*CANSEEPVSROW];
+    if (canseerowepoch[lo] != canseepvsepoch)
+    {
+        clearbufbyte(row,CANSEEPVSROW,0L);
+        canseerowepoch[lo] = canseepvsepoch;
+    }
+
+    /* first half of a row: pair tested; second half: pair connected */
+    if (!(row[hi>>3]&pow2char[hi&7]))
+    {
+        bx[0] = min(b1[0],b2[0]);
+        bx[1] = min(b1[1],b2[1]);
+        bx[2] = max(b1[2],b2[2]);
+        bx[3] = max(b1[3],b2[3]);
+        row[hi>>3] |= pow2char[hi&7];
+        if (canseereachable(sect1,sect2,bx))
+            row[(MAXSECTORS>>3)+(hi>>3)] |= pow2char[hi&7];
+    }
+    return((row[(MAXSECTORS>>3)+(hi>>3)]&pow2char[hi&7]) != 0);
+}
+
+
+HOT_CODE(cansee) int cansee(int32_t x1, int32_t y1, int32_t z1, short sect1,
+           int32_t x2, int32_t y2, int32_t z2, short sect2)
+{
+    canseememotype *m = NULL;
+    uint32_t h;
+    int r;
+
+    canseecalls++;
+
+    if ((x1 == x2) && (y1 == y2))
+        return(sect1 == sect2);
+
+    if ((canseecachemode&2) && (canseepvs != NULL) && (sect1 != sect2) &&
+        ((unsigned)sect1 < (unsigned)numsectors) && ((unsigned)sect2 < (unsigned)numsectors) &&
+        !canseesectors(x1,y1,sect1,x2,y2,sect2))
+    {
+        canseepvsrejects++;
+        return(0);
+    }
+
+    if (canseecachemode&1)
+    {
+        h = (uint32_t)(x1^(y1<<3)^(x2<<7)^(y2<<11)^(z1>>6)^(z2>>2)^sect1^(sect2<<5));
+        h ^= (h>>13)^(h>>22);
+        m = &canseememo[h&(CANSEEMEMOSIZ-1)];
+        if ((m->epoch == canseeepoch) && (m->x1 == x1) && (m->y1 == y1) && (m->z1 == z1) &&
+            (m->x2 == x2) && (m->y2 == y2) && (m->z2 == z2) &&
+            (m->sect1 == sect1) && (m->sect2 == sect2))
+        {
+            canseememohits++;
+            return(m->result);
+        }
+    }
+
+    r = canseewalk(x1,y1,z1,sect1,x2,y2,z2,sect2);
+
+    if (m != NULL)
+    {
+        m->x1 = x1; m->y1 = y1; m->z1 = z1;
+        m->x2 = x2; m->y2 = y2; m->z2 = z2;
+        m->sect1 = sect1; m->sect2 = sect2;
+        m->epoch = canseeepoch;
+        m->result = (uint8_t)r;
+    }
+    return(r);
+}
+
 
 int lintersect(int32_t x1, int32_t y1, int32_t z1, int32_t x2, int32_t y2, int32_t z2,
                int32_t x3, int32_t y3, int32_t x4, int32_t y4, int32_t *intx,
@@ -6306,355 +7035,483 @@ int rintersect(int32_t x1, int32_t y1, int32_t z1, int32_t vx, int32_t vy, int32
 }
 
 
-int hitscan(int32_t xs, int32_t ys, int32_t zs, short sectnum,
-            int32_t vx, int32_t vy, int32_t vz,
-            short *hitsect, short *hitwall, short *hitsprite,
-            int32_t *hitx, int32_t *hity, int32_t *hitz, uint32_t  cliptype)
+/*
+ * Per-ray sector lists of hitscan_batch(). Each ray floods its own list in
+ * the order a lone hitscan() would, so ties between hits in different
+ * sectors resolve the same way.
+ */
+EXT_RAM_ATTR static short hitscansectorlist[MAXHITSCANRAYS][MAXCLIPNUM];
+static short hitscansectnum[MAXHITSCANRAYS];
+
+/*
+ * One sector of a hitscan for the rays listed in 'active'. The work that
+ * does not depend on the ray (slope planes, wall back faces, sprite sizes
+ * and corners) is done once, then every ray is tested in the order
+ * hitscan() always used: ceiling, floor, walls, sprites.
+ */
+static void hitscansector(int32_t xs, int32_t ys, int32_t zs, short dasector,
+                          hitscantype *rays, const uint8_t *active, int32_t numactive,
+                          uint32_t  cliptype)
 {
     sectortype *sec;
     walltype *wal, *wal2;
     spritetype *spr;
+    hitscantype *ray;
     int32_t z, zz, x1, y1=0, z1=0, x2, y2, x3, y3, x4, y4, intx, inty, intz;
     int32_t topt, topu, bot, dist, offx, offy, cstat;
-    int32_t i, j, k, l, tilenum, xoff, yoff, dax, day, daz, daz2;
+    int32_t i, j, k, l, r, tilenum, xoff, yoff, dax, day, daz, daz2, num;
     int32_t ang, cosang, sinang, xspan, yspan, xrepeat, yrepeat;
     int32_t dawalclipmask, dasprclipmask;
-    short tempshortcnt, tempshortnum, dasector, startwall, endwall;
-    short nextsector;
+    short startwall, endwall, nextsector;
+    short *list;
     uint8_t  clipyou;
 
-    *hitsect = -1;
-    *hitwall = -1;
-    *hitsprite = -1;
-    if (sectnum < 0) return(-1);
-
-    *hitx = hitscangoalx;
-    *hity = hitscangoaly;
-
     dawalclipmask = (cliptype&65535);
     dasprclipmask = (cliptype>>16);
 
-    clipsectorlist[0] = sectnum;
-    tempshortcnt = 0;
-    tempshortnum = 1;
-    do
-    {
-        dasector = clipsectorlist[tempshortcnt];
-        sec = &sector[dasector];
+    sec = &sector[dasector];
 
+    if (sec->ceilingstat&2)
+    {
+        wal = &wall[sec->wallptr];
+        wal2 = &wall[wal->point2];
+        dax = wal2->x-wal->x;
+        day = wal2->y-wal->y;
+        i = nsqrtasm(dax*dax+day*day);
+        if (i == 0) return;
+        i = divscale15(sec->ceilingheinum,i);
+        dax *= i;
+        day *= i;
+        k = ((sec->ceilingz-zs)<<8)+dmulscale15(dax,ys-wal->y,-day,xs-wal->x);
+    }
+    for(r=0; r<numactive; r++)
+    {
+        ray = &rays[active[r]];
         x1 = 0x7fffffff;
         if (sec->ceilingstat&2)
         {
-            wal = &wall[sec->wallptr];
-            wal2 = &wall[wal->point2];
-            dax = wal2->x-wal->x;
-            day = wal2->y-wal->y;
-            i = nsqrtasm(dax*dax+day*day);
-            if (i == 0) continue;
-            i = divscale15(sec->ceilingheinum,i);
-            dax *= i;
-            day *= i;
-
-            j = (vz<<8)-dmulscale15(dax,vy,-day,vx);
+            j = (ray->vz<<8)-dmulscale15(dax,ray->vy,-day,ray->vx);
             if (j != 0)
             {
-                i = ((sec->ceilingz-zs)<<8)+dmulscale15(dax,ys-wal->y,-day,xs-wal->x);
+                i = k;
                 if (((i^j) >= 0) && ((klabs(i)>>1) < klabs(j)))
                 {
                     i = divscale30(i,j);
-                    x1 = xs + mulscale30(vx,i);
-                    y1 = ys + mulscale30(vy,i);
-                    z1 = zs + mulscale30(vz,i);
+                    x1 = xs + mulscale30(ray->vx,i);
+                    y1 = ys + mulscale30(ray->vy,i);
+                    z1 = zs + mulscale30(ray->vz,i);
                 }
             }
         }
-        else if ((vz < 0) && (zs >= sec->ceilingz))
+        else if ((ray->vz < 0) && (zs >= sec->ceilingz))
         {
             z1 = sec->ceilingz;
             i = z1-zs;
-            if ((klabs(i)>>1) < -vz)
+            if ((klabs(i)>>1) < -ray->vz)
             {
-                i = divscale30(i,vz);
-                x1 = xs + mulscale30(vx,i);
-                y1 = ys + mulscale30(vy,i);
+                i = divscale30(i,ray->vz);
+                x1 = xs + mulscale30(ray->vx,i);
+                y1 = ys + mulscale30(ray->vy,i);
             }
         }
-        if ((x1 != 0x7fffffff) && (klabs(x1-xs)+klabs(y1-ys) < klabs((*hitx)-xs)+klabs((*hity)-ys)))
+        if ((x1 != 0x7fffffff) && (klabs(x1-xs)+klabs(y1-ys) < klabs(ray->hitx-xs)+klabs(ray->hity-ys)))
             if (inside(x1,y1,dasector) != 0)
             {
-                *hitsect = dasector;
-                *hitwall = -1;
-                *hitsprite = -1;
-                *hitx = x1;
-                *hity = y1;
-                *hitz = z1;
+                ray->hitsect = dasector;
+                ray->hitwall = -1;
+                ray->hitsprite = -1;
+                ray->hitx = x1;
+                ray->hity = y1;
+                ray->hitz = z1;
             }
+    }
 
+    if (sec->floorstat&2)
+    {
+        wal = &wall[sec->wallptr];
+        wal2 = &wall[wal->point2];
+        dax = wal2->x-wal->x;
+        day = wal2->y-wal->y;
+        i = nsqrtasm(dax*dax+day*day);
+        if (i == 0) return;
+        i = divscale15(sec->floorheinum,i);
+        dax *= i;
+        day *= i;
+        k = ((sec->floorz-zs)<<8)+dmulscale15(dax,ys-wal->y,-day,xs-wal->x);
+    }
+    for(r=0; r<numactive; r++)
+    {
+        ray = &rays[active[r]];
         x1 = 0x7fffffff;
         if (sec->floorstat&2)
         {
-            wal = &wall[sec->wallptr];
-            wal2 = &wall[wal->point2];
-            dax = wal2->x-wal->x;
-            day = wal2->y-wal->y;
-            i = nsqrtasm(dax*dax+day*day);
-            if (i == 0) continue;
-            i = divscale15(sec->floorheinum,i);
-            dax *= i;
-            day *= i;
-
-            j = (vz<<8)-dmulscale15(dax,vy,-day,vx);
+            j = (ray->vz<<8)-dmulscale15(dax,ray->vy,-day,ray->vx);
             if (j != 0)
             {
-                i = ((sec->floorz-zs)<<8)+dmulscale15(dax,ys-wal->y,-day,xs-wal->x);
+                i = k;
                 if (((i^j) >= 0) && ((klabs(i)>>1) < klabs(j)))
                 {
                     i = divscale30(i,j);
-                    x1 = xs + mulscale30(vx,i);
-                    y1 = ys + mulscale30(vy,i);
-                    z1 = zs + mulscale30(vz,i);
+                    x1 = xs + mulscale30(ray->vx,i);
+                    y1 = ys + mulscale30(ray->vy,i);
+                    z1 = zs + mulscale30(ray->vz,i);
                 }
             }
         }
-        else if ((vz > 0) && (zs <= sec->floorz))
+        else if ((ray->vz > 0) && (zs <= sec->floorz))
         {
             z1 = sec->floorz;
             i = z1-zs;
-            if ((klabs(i)>>1) < vz)
+            if ((klabs(i)>>1) < ray->vz)
             {
-                i = divscale30(i,vz);
-                x1 = xs + mulscale30(vx,i);
-                y1 = ys + mulscale30(vy,i);
+                i = divscale30(i,ray->vz);
+                x1 = xs + mulscale30(ray->vx,i);
+                y1 = ys + mulscale30(ray->vy,i);
             }
         }
-        if ((x1 != 0x7fffffff) && (klabs(x1-xs)+klabs(y1-ys) < klabs((*hitx)-xs)+klabs((*hity)-ys)))
+        if ((x1 != 0x7fffffff) && (klabs(x1-xs)+klabs(y1-ys) < klabs(ray->hitx-xs)+klabs(ray->hity-ys)))
             if (inside(x1,y1,dasector) != 0)
             {
-                *hitsect = dasector;
-                *hitwall = -1;
-                *hitsprite = -1;
-                *hitx = x1;
-                *hity = y1;
-                *hitz = z1;
+                ray->hitsect = dasector;
+                ray->hitwall = -1;
+                ray->hitsprite = -1;
+                ray->hitx = x1;
+                ray->hity = y1;
+                ray->hitz = z1;
             }
+    }
 
-        startwall = sec->wallptr;
-        endwall = startwall + sec->wallnum;
-        for(z=startwall,wal=&wall[startwall]; z<endwall; z++,wal++)
-        {
-            wal2 = &wall[wal->point2];
-            x1 = wal->x;
-            y1 = wal->y;
-            x2 = wal2->x;
-            y2 = wal2->y;
+    startwall = sec->wallptr;
+    endwall = startwall + sec->wallnum;
+    for(z=startwall,wal=&wall[startwall]; z<endwall; z++,wal++)
+    {
+        wal2 = &wall[wal->point2];
+        x1 = wal->x;
+        y1 = wal->y;
+        x2 = wal2->x;
+        y2 = wal2->y;
 
-            if ((x1-xs)*(y2-ys) < (x2-xs)*(y1-ys)) continue;
-            if (rintersect(xs,ys,zs,vx,vy,vz,x1,y1,x2,y2,&intx,&inty,&intz) == 0) continue;
+        if ((x1-xs)*(y2-ys) < (x2-xs)*(y1-ys)) continue;
 
-            if (klabs(intx-xs)+klabs(inty-ys) >= klabs((*hitx)-xs)+klabs((*hity)-ys)) continue;
+        nextsector = wal->nextsector;
+        for(r=0; r<numactive; r++)
+        {
+            ray = &rays[active[r]];
+            if (rintersect(xs,ys,zs,ray->vx,ray->vy,ray->vz,x1,y1,x2,y2,&intx,&inty,&intz) == 0) continue;
+
+            if (klabs(intx-xs)+klabs(inty-ys) >= klabs(ray->hitx-xs)+klabs(ray->hity-ys)) continue;
 
-            nextsector = wal->nextsector;
             if ((nextsector < 0) || (wal->cstat&dawalclipmask))
             {
-                *hitsect = dasector;
-                *hitwall = z;
-                *hitsprite = -1;
-                *hitx = intx;
-                *hity = inty;
-                *hitz = intz;
+                ray->hitsect = dasector;
+                ray->hitwall = z;
+                ray->hitsprite = -1;
+                ray->hitx = intx;
+                ray->hity = inty;
+                ray->hitz = intz;
                 continue;
             }
             getzsofslope(nextsector,intx,inty,&daz,&daz2);
             if ((intz <= daz) || (intz >= daz2))
             {
-                *hitsect = dasector;
-                *hitwall = z;
-                *hitsprite = -1;
-                *hitx = intx;
-                *hity = inty;
-                *hitz = intz;
+                ray->hitsect = dasector;
+                ray->hitwall = z;
+                ray->hitsprite = -1;
+                ray->hitx = intx;
+                ray->hity = inty;
+                ray->hitz = intz;
                 continue;
             }
 
-            for(zz=tempshortnum-1; zz>=0; zz--)
-                if (clipsectorlist[zz] == nextsector) break;
-            if (zz < 0) clipsectorlist[tempshortnum++] = nextsector;
+            list = hitscansectorlist[active[r]];
+            num = hitscansectnum[active[r]];
+            for(zz=num-1; zz>=0; zz--)
+                if (list[zz] == nextsector) break;
+            if ((zz < 0) && (num < MAXCLIPNUM)) list[hitscansectnum[active[r]]++] = nextsector;
         }
+    }
 
-        for(z=headspritesect[dasector]; z>=0; z=nextspritesect[z])
-        {
-            spr = &sprite[z];
-            cstat = spr->cstat;
-            if ((cstat&dasprclipmask) == 0) continue;
+    for(z=headspritesect[dasector]; z>=0; z=nextspritesect[z])
+    {
+        spr = &sprite[z];
+        cstat = spr->cstat;
+        if ((cstat&dasprclipmask) == 0) continue;
 
-            x1 = spr->x;
-            y1 = spr->y;
+        switch(cstat&48)
+        {
+        case 0:
             z1 = spr->z;
-            switch(cstat&48)
+            k = (tiles[spr->picnum].dim.height*spr->yrepeat<<2);
+
+            if (cstat&128)
+                z1 += (k>>1);
+
+            if (tiles[spr->picnum].animFlags&0x00ff0000)
+                z1 -= ((int32_t)((int8_t )((tiles[spr->picnum].animFlags>>16)&255))*spr->yrepeat<<2);
+
+            l = tiles[spr->picnum].dim.width*spr->xrepeat;
+            l *= l;
+
+            for(r=0; r<numactive; r++)
             {
-            case 0:
-                topt = vx*(x1-xs) + vy*(y1-ys);
+                ray = &rays[active[r]];
+                topt = ray->vx*(spr->x-xs) + ray->vy*(spr->y-ys);
                 if (topt <= 0) continue;
-                bot = vx*vx + vy*vy;
+                bot = ray->vx*ray->vx + ray->vy*ray->vy;
                 if (bot == 0) continue;
 
-                intz = zs+scale(vz,topt,bot);
+                intz = zs+scale(ray->vz,topt,bot);
+                if ((intz > z1) || (intz < z1-k)) continue;
+                topu = ray->vx*(spr->y-ys) - ray->vy*(spr->x-xs);
 
-                i = (tiles[spr->picnum].dim.height*spr->yrepeat<<2);
-                    
-                if (cstat&128) 
-                    z1 += (i>>1);
-                    
-                if (tiles[spr->picnum].animFlags&0x00ff0000) 
-                    z1 -= ((int32_t)((int8_t )((tiles[spr->picnum].animFlags>>16)&255))*spr->yrepeat<<2);
-                    
-                if ((intz > z1) || (intz < z1-i)) continue;
-                topu = vx*(y1-ys) - vy*(x1-xs);
-
-                offx = scale(vx,topu,bot);
-                offy = scale(vy,topu,bot);
+                offx = scale(ray->vx,topu,bot);
+                offy = scale(ray->vy,topu,bot);
                 dist = offx*offx + offy*offy;
-                i = tiles[spr->picnum].dim.width*spr->xrepeat;
-                i *= i;
-                if (dist > (i>>7)) continue;
-                intx = xs + scale(vx,topt,bot);
-                inty = ys + scale(vy,topt,bot);
-
-                if (klabs(intx-xs)+klabs(inty-ys) > klabs((*hitx)-xs)+klabs((*hity)-ys)) continue;
-
-                *hitsect = dasector;
-                *hitwall = -1;
-                *hitsprite = z;
-                *hitx = intx;
-                *hity = inty;
-                *hitz = intz;
-                break;
-            case 16:
-                /*
-                 * These lines get the 2 points of the rotated sprite
-                 * Given: (x1, y1) starts out as the center point
-                 */
-                tilenum = spr->picnum;
-                xoff = (int32_t)((int8_t )((tiles[tilenum].animFlags>>8)&255))+((int32_t)spr->xoffset);
-                if ((cstat&4) > 0) xoff = -xoff;
-                k = spr->ang;
-                l = spr->xrepeat;
-                dax = sintable[k&2047]*l;
-                day = sintable[(k+1536)&2047]*l;
-                l = tiles[tilenum].dim.width;
-                k = (l>>1)+xoff;
-                x1 -= mulscale16(dax,k);
-                x2 = x1+mulscale16(dax,l);
-                y1 -= mulscale16(day,k);
-                y2 = y1+mulscale16(day,l);
-
-                if ((cstat&64) != 0)   /* back side of 1-way sprite */
-                    if ((x1-xs)*(y2-ys) < (x2-xs)*(y1-ys)) continue;
-
-                if (rintersect(xs,ys,zs,vx,vy,vz,x1,y1,x2,y2,&intx,&inty,&intz) == 0) continue;
-
-                if (klabs(intx-xs)+klabs(inty-ys) > klabs((*hitx)-xs)+klabs((*hity)-ys)) continue;
+                if (dist > (l>>7)) continue;
+                intx = xs + scale(ray->vx,topt,bot);
+                inty = ys + scale(ray->vy,topt,bot);
+
+                if (klabs(intx-xs)+klabs(inty-ys) > klabs(ray->hitx-xs)+klabs(ray->hity-ys)) continue;
+
+                ray->hitsect = dasector;
+                ray->hitwall = -1;
+                ray->hitsprite = z;
+                ray->hitx = intx;
+                ray->hity = inty;
+                ray->hitz = intz;
+            }
+            break;
+        case 16:
+            /*
+             * These lines get the 2 points of the rotated sprite
+             * Given: (x1, y1) starts out as the center point
+             */
+            x1 = spr->x;
+            y1 = spr->y;
+            tilenum = spr->picnum;
+            xoff = (int32_t)((int8_t )((tiles[tilenum].animFlags>>8)&255))+((int32_t)spr->xoffset);
+            if ((cstat&4) > 0) xoff = -xoff;
+            k = spr->ang;
+            l = spr->xrepeat;
+            dax = sintable[k&2047]*l;
+            day = sintable[(k+1536)&2047]*l;
+            l = tiles[tilenum].dim.width;
+            k = (l>>1)+xoff;
+            x1 -= mulscale16(dax,k);
+            x2 = x1+mulscale16(dax,l);
+            y1 -= mulscale16(day,k);
+            y2 = y1+mulscale16(day,l);
+
+            if ((cstat&64) != 0)   /* back side of 1-way sprite */
+                if ((x1-xs)*(y2-ys) < (x2-xs)*(y1-ys)) continue;
+
+            k = ((tiles[spr->picnum].dim.height*spr->yrepeat)<<2);
+            if (cstat&128)
+                daz = spr->z+(k>>1);
+            else
+                daz = spr->z;
+
+            if (tiles[spr->picnum].animFlags&0x00ff0000)
+                daz -= ((int32_t)((int8_t  )((tiles[spr->picnum].animFlags>>16)&255))*spr->yrepeat<<2);
+
+            for(r=0; r<numactive; r++)
+            {
+                ray = &rays[active[r]];
+                if (rintersect(xs,ys,zs,ray->vx,ray->vy,ray->vz,x1,y1,x2,y2,&intx,&inty,&intz) == 0) continue;
+
+                if (klabs(intx-xs)+klabs(inty-ys) > klabs(ray->hitx-xs)+klabs(ray->hity-ys)) continue;
 
-                k = ((tiles[spr->picnum].dim.height*spr->yrepeat)<<2);
-                if (cstat&128)
-                    daz = spr->z+(k>>1);
-                else
-                    daz = spr->z;
-                    
-                if (tiles[spr->picnum].animFlags&0x00ff0000)
-                    daz -= ((int32_t)((int8_t  )((tiles[spr->picnum].animFlags>>16)&255))*spr->yrepeat<<2);
-                    
                 if ((intz < daz) && (intz > daz-k))
                 {
-                    *hitsect = dasector;
-                    *hitwall = -1;
-                    *hitsprite = z;
-                    *hitx = intx;
-                    *hity = inty;
-                    *hitz = intz;
+                    ray->hitsect = dasector;
+                    ray->hitwall = -1;
+                    ray->hitsprite = z;
+                    ray->hitx = intx;
+                    ray->hity = inty;
+                    ray->hitz = intz;
                 }
-                break;
-            case 32:
-                if (vz == 0) continue;
+            }
+            break;
+        case 32:
+            z1 = spr->z;
+            if ((cstat&64) != 0)
+                if ((zs > z1) == ((cstat&8)==0)) continue;
+
+            tilenum = spr->picnum;
+            xoff = (int32_t)((int8_t )((tiles[tilenum].animFlags>>8)&255))+((int32_t)spr->xoffset);
+            yoff = (int32_t)((int8_t )((tiles[tilenum].animFlags>>16)&255))+((int32_t)spr->yoffset);
+            if ((cstat&4) > 0) xoff = -xoff;
+            if ((cstat&8) > 0) yoff = -yoff;
+
+            ang = spr->ang;
+            cosang = sintable[(ang+512)&2047];
+            sinang = sintable[ang];
+            xspan = tiles[tilenum].dim.width;
+            xrepeat = spr->xrepeat;
+            yspan = tiles[tilenum].dim.height;
+            yrepeat = spr->yrepeat;
+
+            /* Corners in world space; each ray makes them relative to its hit */
+            dax = ((xspan>>1)+xoff)*xrepeat;
+            day = ((yspan>>1)+yoff)*yrepeat;
+            x1 = spr->x + dmulscale16(sinang,dax,cosang,day);
+            y1 = spr->y + dmulscale16(sinang,day,-cosang,dax);
+            l = xspan*xrepeat;
+            x2 = x1 - mulscale16(sinang,l);
+            y2 = y1 + mulscale16(cosang,l);
+            l = yspan*yrepeat;
+            k = -mulscale16(cosang,l);
+            x3 = x2+k;
+            x4 = x1+k;
+            k = -mulscale16(sinang,l);
+            y3 = y2+k;
+            y4 = y1+k;
+
+            for(r=0; r<numactive; r++)
+            {
+                int32_t cx1, cy1, cx2, cy2, cx3, cy3, cx4, cy4;
+
+                ray = &rays[active[r]];
+                if (ray->vz == 0) continue;
                 intz = z1;
-                if (((intz-zs)^vz) < 0) continue;
-                if ((cstat&64) != 0)
-                    if ((zs > intz) == ((cstat&8)==0)) continue;
-
-                intx = xs+scale(intz-zs,vx,vz);
-                inty = ys+scale(intz-zs,vy,vz);
-
-                if (klabs(intx-xs)+klabs(inty-ys) > klabs((*hitx)-xs)+klabs((*hity)-ys)) continue;
-
-                tilenum = spr->picnum;
-                xoff = (int32_t)((int8_t )((tiles[tilenum].animFlags>>8)&255))+((int32_t)spr->xoffset);
-                yoff = (int32_t)((int8_t )((tiles[tilenum].animFlags>>16)&255))+((int32_t)spr->yoffset);
-                if ((cstat&4) > 0) xoff = -xoff;
-                if ((cstat&8) > 0) yoff = -yoff;
-
-                ang = spr->ang;
-                cosang = sintable[(ang+512)&2047];
-                sinang = sintable[ang];
-                xspan = tiles[tilenum].dim.width;
-                xrepeat = spr->xrepeat;
-                yspan = tiles[tilenum].dim.height;
-                yrepeat = spr->yrepeat;
-
-                dax = ((xspan>>1)+xoff)*xrepeat;
-                day = ((yspan>>1)+yoff)*yrepeat;
-                x1 += dmulscale16(sinang,dax,cosang,day)-intx;
-                y1 += dmulscale16(sinang,day,-cosang,dax)-inty;
-                l = xspan*xrepeat;
-                x2 = x1 - mulscale16(sinang,l);
-                y2 = y1 + mulscale16(cosang,l);
-                l = yspan*yrepeat;
-                k = -mulscale16(cosang,l);
-                x3 = x2+k;
-                x4 = x1+k;
-                k = -mulscale16(sinang,l);
-                y3 = y2+k;
-                y4 = y1+k;
+                if (((intz-zs)^ray->vz) < 0) continue;
+
+                intx = xs+scale(intz-zs,ray->vx,ray->vz);
+                inty = ys+scale(intz-zs,ray->vy,ray->vz);
+
+                if (klabs(intx-xs)+klabs(inty-ys) > klabs(ray->hitx-xs)+klabs(ray->hity-ys)) continue;
+
+                cx1 = x1-intx; cy1 = y1-inty;
+                cx2 = x2-intx; cy2 = y2-inty;
+                cx3 = x3-intx; cy3 = y3-inty;
+                cx4 = x4-intx; cy4 = y4-inty;
 
                 clipyou = 0;
-                if ((y1^y2) < 0)
+                if ((cy1^cy2) < 0)
                 {
-                    if ((x1^x2) < 0) clipyou ^= (x1*y2<x2*y1)^(y1<y2);
-                    else if (x1 >= 0) clipyou ^= 1;
+                    if ((cx1^cx2) < 0) clipyou ^= (cx1*cy2<cx2*cy1)^(cy1<cy2);
+                    else if (cx1 >= 0) clipyou ^= 1;
                 }
-                if ((y2^y3) < 0)
+                if ((cy2^cy3) < 0)
                 {
-                    if ((x2^x3) < 0) clipyou ^= (x2*y3<x3*y2)^(y2<y3);
-                    else if (x2 >= 0) clipyou ^= 1;
+                    if ((cx2^cx3) < 0) clipyou ^= (cx2*cy3<cx3*cy2)^(cy2<cy3);
+                    else if (cx2 >= 0) clipyou ^= 1;
                 }
-                if ((y3^y4) < 0)
+                if ((cy3^cy4) < 0)
                 {
-                    if ((x3^x4) < 0) clipyou ^= (x3*y4<x4*y3)^(y3<y4);
-                    else if (x3 >= 0) clipyou ^= 1;
+                    if ((cx3^cx4) < 0) clipyou ^= (cx3*cy4<cx4*cy3)^(cy3<cy4);
+                    else if (cx3 >= 0) clipyou ^= 1;
                 }
-                if ((y4^y1) < 0)
+                if ((cy4^cy1) < 0)
                 {
-                    if ((x4^x1) < 0) clipyou ^= (x4*y1<x1*y4)^(y4<y1);
-                    else if (x4 >= 0) clipyou ^= 1;
+                    if ((cx4^cx1) < 0) clipyou ^= (cx4*cy1<cx1*cy4)^(cy4<cy1);
+                    else if (cx4 >= 0) clipyou ^= 1;
                 }
 
                 if (clipyou != 0)
                 {
-                    *hitsect = dasector;
-                    *hitwall = -1;
-                    *hitsprite = z;
-                    *hitx = intx;
-                    *hity = inty;
-                    *hitz = intz;
+                    ray->hitsect = dasector;
+                    ray->hitwall = -1;
+                    ray->hitsprite = z;
+                    ray->hitx = intx;
+                    ray->hity = inty;
+                    ray->hitz = intz;
                 }
-                break;
             }
+            break;
         }
-        tempshortcnt++;
-    } while (tempshortcnt < tempshortnum);
+    }
+}
+
+
+/*
+ * Traces up to MAXHITSCANRAYS rays that share an origin and start sector,
+ * e.g. the probes of an AI looking for the longest way out. The rays step
+ * through their sector lists together; rays standing in the same sector
+ * share its walls and sprites, and each ray ends with exactly the result
+ * hitscan() gives for it. hitz is only written when something is hit.
+ */
+int hitscan_batch(int32_t xs, int32_t ys, int32_t zs, short sectnum,
+                  hitscantype *rays, int32_t numrays, uint32_t  cliptype)
+{
+    uint8_t waiting[MAXHITSCANRAYS], active[MAXHITSCANRAYS];
+    int32_t r, numwaiting, numactive, step;
+    short dasector;
+
+    for(; numrays > MAXHITSCANRAYS; rays += MAXHITSCANRAYS, numrays -= MAXHITSCANRAYS)
+        hitscan_batch(xs,ys,zs,sectnum,rays,MAXHITSCANRAYS,cliptype);
+
+    for(r=0; r<numrays; r++)
+    {
+        rays[r].hitsect = -1;
+        rays[r].hitwall = -1;
+        rays[r].hitsprite = -1;
+    }
+    if (sectnum < 0) return(-1);
+
+    for(r=0; r<numrays; r++)
+    {
+        rays[r].hitx = hitscangoalx;
+        rays[r].hity = hitscangoaly;
+        hitscansectorlist[r][0] = sectnum;
+        hitscansectnum[r] = 1;
+    }
+
+    for(step=0; ; step++)
+    {
+        numwaiting = 0;
+        for(r=0; r<numrays; r++)
+            if (step < hitscansectnum[r])
+                waiting[numwaiting++] = r;
+        if (numwaiting == 0) break;
+
+        /* Group the rays by the sector they visit at this step */
+        while (numwaiting > 0)
+        {
+            dasector = hitscansectorlist[waiting[0]][step];
+            numactive = 0;
+            for(r=0; r<numwaiting; r++)
+            {
+                if (hitscansectorlist[waiting[r]][step] == dasector)
+                    active[numactive++] = waiting[r];
+                else
+                    waiting[r-numactive] = waiting[r];
+            }
+            numwaiting -= numactive;
+            hitscansector(xs,ys,zs,dasector,rays,active,numactive,cliptype);
+        }
+    }
     return(0);
 }
 
 
+int hitscan(int32_t xs, int32_t ys, int32_t zs, short sectnum,
+            int32_t vx, int32_t vy, int32_t vz,
+            short *hitsect, short *hitwall, short *hitsprite,
+            int32_t *hitx, int32_t *hity, int32_t *hitz, uint32_t  cliptype)
+{
+    hitscantype ray;
+    int ret;
+
+    ray.vx = vx;
+    ray.vy = vy;
+    ray.vz = vz;
+    ray.hitx = *hitx;
+    ray.hity = *hity;
+    ray.hitz = *hitz;
+
+    ret = hitscan_batch(xs,ys,zs,sectnum,&ray,1,cliptype);
+
+    *hitsect = ray.hitsect;
+    *hitwall = ray.hitwall;
+    *hitsprite = ray.hitsprite;
+    *hitx = ray.hitx;
+    *hity = ray.hity;
+    *hitz = ray.hitz;
+    return(ret);
+}
+
+
 int neartag(int32_t xs, int32_t ys, int32_t zs, short sectnum, short ange,
             short *neartagsector, short *neartagwall, short *neartagsprite,
             int32_t *neartaghitdist, int32_t neartagrange, uint8_t  tagsearch)
@@ -6792,12 +7649,137 @@ int neartag(int32_t xs, int32_t ys, int32_t zs, short sectnum, short ange,
 }
 
 
+/*
+ * getzrange() memo. Actors standing still ask the same question every
+ *  tick, and the sector half of the answer (which sectors the clip square
+ *  reaches, and their floors and ceilings at x,y) rarely changes. Entries
+ *  are keyed on the exact x, y, sector, walldist and cliptype, and on the
+ *  z interval within which every neighbour height test comes out the same.
+ *
+ * Each entry lists the sectors it read and the portal walls whose cstat it
+ *  tested. A sector's generation moves when its heights, slopes or stat
+ *  bits differ from the copy taken when it was last checked (game code
+ *  writes those directly) or when dragpoint() moves one of its walls, so
+ *  a hit returns what the walk would have. Sprites move every tick, so the
+ *  sprite half is always recomputed.
+ */
+#define ZRANGEMEMOSIZ 512
+#define ZRANGEMEMOSECTS 8
+#define ZRANGEMEMOWALLS 6
+
+typedef struct
+{
+    int32_t x, y, zlo, zhi, walldist;
+    uint32_t cliptype, gensum;
+    int32_t ceilz, florz;
+    short ceilhit, florhit, sectnum;
+    uint8_t nclip, nread, nwall, wallbits;
+    short sect[ZRANGEMEMOSECTS];
+    short wallnum[ZRANGEMEMOWALLS];
+} zrangememotype;
+
+typedef struct
+{
+    int32_t ceilingz, floorz;
+    short ceilingheinum, floorheinum, ceilingstat, floorstat;
+} zrangeshadowtype;
+
+uint32_t zrangecalls, zrangememohits;
+
+EXT_RAM_ATTR static zrangememotype zrangememo[ZRANGEMEMOSIZ] __psram_bss("zrangememo");
+EXT_RAM_ATTR static zrangeshadowtype zrangeshadow[MAXSECTORS] __psram_bss("zrangeshadow");
+EXT_RAM_ATTR static uint32_t zrangegen[MAXSECTORS] __psram_bss("zrangegen");
+EXT_RAM_ATTR static short zrangewallsect[MAXWALLS] __psram_bss("zrangewallsect");
+
+static void zrangechecksector(short s)
+{
+    sectortype *sec = &sector[s];
+    zrangeshadowtype *sh = &zrangeshadow[s];
+
+    if ((sh->ceilingz != sec->ceilingz) || (sh->floorz != sec->floorz) ||
+        (sh->ceilingheinum != sec->ceilingheinum) || (sh->floorheinum != sec->floorheinum) ||
+        (sh->ceilingstat != sec->ceilingstat) || (sh->floorstat != sec->floorstat))
+    {
+        sh->ceilingz = sec->ceilingz;
+        sh->floorz = sec->floorz;
+        sh->ceilingheinum = sec->ceilingheinum;
+        sh->floorheinum = sec->floorheinum;
+        sh->ceilingstat = sec->ceilingstat;
+        sh->floorstat = sec->floorstat;
+        zrangegen[s]++;
+    }
+}
+
+
+static uint32_t zrangegensum(zrangememotype *m)
+{
+    uint32_t sum;
+    int32_t i;
+
+    sum = 0;
+    for(i=0; i<m->nread; i++)
+    {
+        zrangechecksector(m->sect[i]);
+        sum += zrangegen[m->sect[i]];
+    }
+    return(sum);
+}
+
+
+void resetzrangecache(void)
+{
+    int32_t i, j, endwall;
+
+    clearbufbyte(zrangememo,sizeof(zrangememo),0L);
+    clearbufbyte(zrangegen,sizeof(zrangegen),0L);
+    for(i=0; i<numsectors; i++)
+    {
+        zrangeshadow[i].ceilingz = sector[i].ceilingz;
+        zrangeshadow[i].floorz = sector[i].floorz;
+        zrangeshadow[i].ceilingheinum = sector[i].ceilingheinum;
+        zrangeshadow[i].floorheinum = sector[i].floorheinum;
+        zrangeshadow[i].ceilingstat = sector[i].ceilingstat;
+        zrangeshadow[i].floorstat = sector[i].floorstat;
+
+        endwall = sector[i].wallptr+sector[i].wallnum;
+        for(j=sector[i].wallptr; j<endwall; j++)
+            zrangewallsect[j] = (short)i;
+    }
+}
+
+
+/* Game code that moves a wall point without dragpoint() (sliding doors
+   in doanimations()) reports it here, so getzrange() memo entries that
+   read the wall's sector are not reused and cansee() stops trusting the
+   sector's load-time box */
+void markwallmoved(short wallnum)
+{
+    if ((wallnum >= 0) && (wallnum < numwalls))
+    {
+        markcanseedynamic(wallnum);
+        zrangegen[zrangewallsect[wallnum]]++;
+    }
+}
+
+
+static zrangememotype *zrangememoslot(int32_t x, int32_t y, short sectnum, int32_t walldist)
+{
+    uint32_t h;
+
+    h = (uint32_t)(x^(y<<5)^(sectnum<<9)^(walldist<<3));
+    h ^= (h>>11)^(h>>20);
+    return(&zrangememo[h&(ZRANGEMEMOSIZ-1)]);
+}
+
+
 void dragpoint(short pointhighlight, int32_t dax, int32_t day)
 {
     short cnt, tempshort;
 
     wall[pointhighlight].x = dax;
     wall[pointhighlight].y = day;
+    markcanseedynamic(pointhighlight);
+    zrangegen[zrangewallsect[pointhighlight]]++;
 
     cnt = MAXWALLS;
     tempshort = pointhighlight;    /* search points CCW */
@@ -6808,6 +7790,8 @@ void dragpoint(short pointhighlight, int32_t dax, int32_t day)
             tempshort = wall[wall[tempshort].nextwall].point2;
             wall[tempshort].x = dax;
             wall[tempshort].y = day;
+            markcanseedynamic(tempshort);
+            zrangegen[zrangewallsect[tempshort]]++;
         }
         else
         {
@@ -6819,6 +7803,8 @@ void dragpoint(short pointhighlight, int32_t dax, int32_t day)
                     tempshort = wall[lastwall(tempshort)].nextwall;
                     wall[tempshort].x = dax;
                     wall[tempshort].y = day;
+                    markcanseedynamic(tempshort);
+                    zrangegen[zrangewallsect[tempshort]]++;
                 }
                 else
                 {
@@ -6883,7 +7869,7 @@ static void keepaway (int32_t *x, int32_t *y, int32_t w)
 }
 
 
-IRAM_ATTR static int raytrace(int32_t x3, int32_t y3, int32_t *x4, int32_t *y4)
+HOT_CODE(raytrace) static int raytrace(int32_t x3, int32_t y3, int32_t *x4, int32_t *y4)
 {
     int32_t x1, y1, x2, y2, bot, topu, nintx, ninty, cnt, z, hitwall;
     int32_t x21, y21, x43, y43;
@@ -6935,7 +7921,7 @@ IRAM_ATTR static int raytrace(int32_t x3, int32_t y3, int32_t *x4, int32_t *y4)
 
 /* !!! ugh...move this var into clipmove as a parameter, and update build2.txt! */
 int32_t clipmoveboxtracenum = 3;
-int clipmove (int32_t *x, int32_t *y, int32_t *z, short *sectnum,
+HOT_CODE(clipmove) int clipmove (int32_t *x, int32_t *y, int32_t *z, short *sectnum,
               int32_t xvect, int32_t yvect, int32_t walldist, int32_t ceildist,
               int32_t flordist, uint32_t  cliptype)
 {
@@ -7310,7 +8296,7 @@ int clipmove (int32_t *x, int32_t *y, int32_t *z, short *sectnum,
 }
 
 
-int pushmove(int32_t *x, int32_t *y, int32_t *z, short *sectnum,
+HOT_CODE(pushmove) int pushmove(int32_t *x, int32_t *y, int32_t *z, short *sectnum,
              int32_t walldist, int32_t ceildist, int32_t flordist,
              uint32_t  cliptype)
 {
@@ -7427,7 +8413,7 @@ int pushmove(int32_t *x, int32_t *y, int32_t *z, short *sectnum,
  Note: Inside uses cross_product and return as soon as the point switch
  from one side to the other.
  */
-void updatesector(int32_t x, int32_t y, short *lastKnownSector)
+HOT_CODE(updatesector) void updatesector(int32_t x, int32_t y, short *lastKnownSector)
 {
     walltype *wal;
     int32_t i, j;
@@ -7807,7 +8793,7 @@ int krand()
 }
 
 
-void getzrange(int32_t x, int32_t y, int32_t z, short sectnum,
+HOT_CODE(getzrange) void getzrange(int32_t x, int32_t y, int32_t z, short sectnum,
                int32_t *ceilz, int32_t *ceilhit, int32_t *florz, int32_t *florhit,
                int32_t walldist, uint32_t  cliptype)
 {
@@ -7818,8 +8804,11 @@ void getzrange(int32_t x, int32_t y, int32_t z, short sectnum,
     int32_t xmin, ymin, xmax, ymax, i, j, k, l, daz, daz2, dx, dy;
     int32_t x1, y1, x2, y2, x3, y3, x4, y4, ang, cosang, sinang;
     int32_t xspan, yspan, xrepeat, yrepeat, dasprclipmask, dawalclipmask;
+    int32_t zlo, zhi, nreject, nwall, wallbits;
+    short reject[ZRANGEMEMOSECTS], testwall[ZRANGEMEMOWALLS];
     short cstat;
-    uint8_t  clipyou;
+    uint8_t  clipyou, memook;
+    zrangememotype *m;
 
     if (sectnum < 0)
     {
@@ -7837,13 +8826,43 @@ void getzrange(int32_t x, int32_t y, int32_t z, short sectnum,
     xmax = x+i;
     ymax = y+i;
 
+    dawalclipmask = (cliptype&65535);
+    dasprclipmask = (cliptype>>16);
+
+    zrangecalls++;
+    m = zrangememoslot(x,y,sectnum,walldist);
+    if ((m->nread > 0) && (m->x == x) && (m->y == y) && (m->sectnum == sectnum) &&
+        (m->walldist == walldist) && (m->cliptype == cliptype) &&
+        (z >= m->zlo) && (z <= m->zhi) && (editstatus == 0) &&
+        (zrangegensum(m) == m->gensum))
+    {
+        wallbits = 0;
+        for(i=0; i<m->nwall; i++)
+            if (wall[m->wallnum[i]].cstat&dawalclipmask)
+                wallbits |= (1<<i);
+        if (wallbits == m->wallbits)
+        {
+            zrangememohits++;
+            *ceilz = m->ceilz;
+            *florz = m->florz;
+            *ceilhit = m->ceilhit;
+            *florhit = m->florhit;
+            for(i=0; i<m->nclip; i++)
+                clipsectorlist[i] = m->sect[i];
+            clipsectnum = m->nclip;
+            goto SPRITES;
+        }
+    }
+
+    zlo = 0x80000000;
+    zhi = 0x7fffffff;
+    nreject = nwall = wallbits = 0;
+    memook = (editstatus == 0);
+
     getzsofslope(sectnum,x,y,ceilz,florz);
     *ceilhit = sectnum+16384;
     *florhit = sectnum+16384;
 
-    dawalclipmask = (cliptype&65535);
-    dasprclipmask = (cliptype>>16);
-
     clipsectorlist[0] = sectnum;
     clipsectcnt = 0;
     clipsectnum = 1;
@@ -7877,12 +8896,41 @@ void getzrange(int32_t x, int32_t y, int32_t z, short sectnum,
                 else day = dy*(xmin-x1);
                 if (dax >= day) continue;
 
-                if (wal->cstat&dawalclipmask) continue;
+                if (nwall < ZRANGEMEMOWALLS) testwall[nwall] = j;
+                else memook = 0;
+                if (wal->cstat&dawalclipmask)
+                {
+                    if (nwall < ZRANGEMEMOWALLS) wallbits |= (1<<nwall);
+                    nwall++;
+                    continue;
+                }
+                nwall++;
                 sec = &sector[k];
                 if (editstatus == 0)
                 {
-                    if (((sec->ceilingstat&1) == 0) && (z <= sec->ceilingz+(3<<8))) continue;
-                    if (((sec->floorstat&1) == 0) && (z >= sec->floorz-(3<<8))) continue;
+                    /* narrow z to where each test comes out the same */
+                    if ((sec->ceilingstat&1) == 0)
+                    {
+                        if (z <= sec->ceilingz+(3<<8))
+                        {
+                            zhi = min(zhi,sec->ceilingz+(3<<8));
+                            if (nreject < ZRANGEMEMOSECTS) reject[nreject++] = k;
+                            else memook = 0;
+                            continue;
+                        }
+                        zlo = max(zlo,sec->ceilingz+(3<<8)+1);
+                    }
+                    if ((sec->floorstat&1) == 0)
+                    {
+                        if (z >= sec->floorz-(3<<8))
+                        {
+                            zlo = max(zlo,sec->floorz-(3<<8));
+                            if (nreject < ZRANGEMEMOSECTS) reject[nreject++] = k;
+                            else memook = 0;
+                            continue;
+                        }
+                        zhi = min(zhi,sec->floorz-(3<<8)-1);
+                    }
                 }
 
                 for(i=clipsectnum-1; i>=0; i--) if (clipsectorlist[i] == k) break;
@@ -7913,6 +8961,24 @@ void getzrange(int32_t x, int32_t y, int32_t z, short sectnum,
         clipsectcnt++;
     } while (clipsectcnt < clipsectnum);
 
+    if (memook && (clipsectnum+nreject <= ZRANGEMEMOSECTS))
+    {
+        m->x = x; m->y = y; m->zlo = zlo; m->zhi = zhi;
+        m->walldist = walldist; m->cliptype = cliptype;
+        m->sectnum = sectnum;
+        m->ceilz = *ceilz; m->florz = *florz;
+        m->ceilhit = (short)*ceilhit; m->florhit = (short)*florhit;
+        for(i=0; i<clipsectnum; i++) m->sect[i] = clipsectorlist[i];
+        for(i=0; i<nreject; i++) m->sect[clipsectnum+i] = reject[i];
+        for(i=0; i<nwall; i++) m->wallnum[i] = testwall[i];
+        m->nclip = (uint8_t)clipsectnum;
+        m->nread = (uint8_t)(clipsectnum+nreject);
+        m->nwall = (uint8_t)nwall;
+        m->wallbits = (uint8_t)wallbits;
+        m->gensum = zrangegensum(m);
+    }
+
+SPRITES:
     for(i=0; i<clipsectnum; i++)
     {
         for(j=headspritesect[clipsectorlist[i]]; j>=0; j=nextspritesect[j])
@@ -8212,7 +9278,7 @@ void rotatesprite(int32_t sx, int32_t sy, int32_t z, short a, short picnum,
 }
 
 
-static int getclosestcol(int32_t r, int32_t g, int32_t b)
+static int getclosestcolsearch(int32_t r, int32_t g, int32_t b)
 {
     int32_t i, j, k, dist, mindist, retcol;
     uint8_t  *pal1;
@@ -8270,12 +9336,65 @@ static int getclosestcol(int32_t r, int32_t g, int32_t b)
 }
 
 
+static int getclosestcol(int32_t r, int32_t g, int32_t b)
+{
+    if (invcolmap == NULL)
+        return(getclosestcolsearch(r,g,b));
+
+    r = min(max(r,0),63) >> (6-INVCOLBITS);
+    g = min(max(g,0),63) >> (6-INVCOLBITS);
+    b = min(max(b,0),63) >> (6-INVCOLBITS);
+    return(invcolmap[(((r<<INVCOLBITS)+g)<<INVCOLBITS)+b]);
+}
+
+
+// Box filter each mip level from the one above it, averaging the four
+// texels in RGB and mapping back through the inverse colour map. Levels
+// follow the base level and are column-major like it.
+void maketilemips(short tilenume, int32_t levels)
+{
+    int32_t m, x, y, xsiz, ysiz, r, g, b;
+    uint8_t *src, *dst, *p0, *p1;
+
+    xsiz = tiles[tilenume].dim.width;
+    ysiz = tiles[tilenume].dim.height;
+    src = tiles[tilenume].data;
+    dst = src+xsiz*ysiz;
+
+    for(m=1; m<=levels; m++)
+    {
+        for(x=0; x<xsiz; x+=2)
+        {
+            p0 = src+x*ysiz;
+            p1 = p0+ysiz;
+            for(y=0; y<ysiz; y+=2)
+            {
+                if ((p0[y] == p0[y+1]) && (p0[y] == p1[y]) && (p0[y] == p1[y+1]))
+                {
+                    *dst++ = p0[y];
+                    continue;
+                }
+                r = palette[p0[y]*3]+palette[p0[y+1]*3]+palette[p1[y]*3]+palette[p1[y+1]*3];
+                g = palette[p0[y]*3+1]+palette[p0[y+1]*3+1]+palette[p1[y]*3+1]+palette[p1[y+1]*3+1];
+                b = palette[p0[y]*3+2]+palette[p0[y+1]*3+2]+palette[p1[y]*3+2]+palette[p1[y+1]*3+2];
+                *dst++ = getclosestcol((r+2)>>2,(g+2)>>2,(b+2)>>2);
+            }
+        }
+        src += xsiz*ysiz;
+        xsiz >>= 1;
+        ysiz >>= 1;
+    }
+}
+
+
 void makepalookup(int32_t palnum, uint8_t  *remapbuf, int8_t r,
                   int8_t g, int8_t b, uint8_t  dastat)
 {
     //printf("makepalookup %d\n",palnum);
     int32_t i, j, palscale;
     uint8_t  *ptr, *ptr2;
+    palookupkey_t *key;
+    uint32_t crc;
 
     if (paletteloaded == 0)
         return;
@@ -8290,6 +9409,16 @@ void makepalookup(int32_t palnum, uint8_t  *remapbuf, int8_t r,
     if (dastat == 0) return;
     if ((r|g|b|63) != 63) return;
 
+    key = &palookupkeys[palnum];
+    crc = crc32_update(remapbuf, 256, 0);
+    if (key->valid && key->crc == crc && key->r == r && key->g == g && key->b == b)
+        return;
+    key->crc = crc;
+    key->r = r;
+    key->g = g;
+    key->b = b;
+    key->valid = 1;
+
     if ((r|g|b) == 0)
     {
         for(i=0; i<256; i++)
@@ -9114,13 +10243,13 @@ void clearallviews(int32_t dacol)
 }
 
 
-IRAM_ATTR void plotpixel(int32_t x, int32_t y, uint8_t  col)
+HOT_CODE(plotpixel) void plotpixel(int32_t x, int32_t y, uint8_t  col)
 {
     drawpixel(ylookup[y]+x+frameplace,(int32_t)col);
 }
 
 
-IRAM_ATTR uint8_t  getpixel(int32_t x, int32_t y)
+HOT_CODE(getpixel) uint8_t  getpixel(int32_t x, int32_t y)
 {
     return(readpixel(ylookup[y]+x+frameplace));
 }
@@ -9212,7 +10341,7 @@ void completemirror(void)
 }
 
 
-IRAM_ATTR int sectorofwall(short theline)
+HOT_CODE(sectorofwall) int sectorofwall(short theline)
 {
     int32_t i, gap;
 
@@ -9235,7 +10364,7 @@ IRAM_ATTR int sectorofwall(short theline)
 }
 
 
-IRAM_ATTR int getceilzofslope(short sectnum, int32_t dax, int32_t day)
+HOT_CODE(getceilzofslope) int getceilzofslope(short sectnum, int32_t dax, int32_t day)
 {
     int32_t dx, dy, i, j;
     walltype *wal;
@@ -9251,7 +10380,7 @@ IRAM_ATTR int getceilzofslope(short sectnum, int32_t dax, int32_t day)
 }
 
 
-IRAM_ATTR int getflorzofslope(short sectnum, int32_t dax, int32_t day)
+HOT_CODE(getflorzofslope) int getflorzofslope(short sectnum, int32_t dax, int32_t day)
 {
     int32_t dx, dy, i, j;
     walltype *wal;
@@ -9282,7 +10411,7 @@ IRAM_ATTR int getflorzofslope(short sectnum, int32_t dax, int32_t day)
  a slope it requires more calculation
  
  */
-IRAM_ATTR void getzsofslope(short sectnum, int32_t dax, int32_t day, int32_t *ceilz, int32_t *florz)
+HOT_CODE(getzsofslope) void getzsofslope(short sectnum, int32_t dax, int32_t day, int32_t *ceilz, int32_t *florz)
 {
     int32_t dx, dy, i, j;
     walltype *wal, *wal2;
@@ -80,6 +80,17 @@ int hitscan(int32_t xs, int32_t ys, int32_t zs, int16_t sectnum,
             int32_t vx, int32_t vy, int32_t vz,
 	        int16_t *hitsect, int16_t *hitwall, int16_t *hitsprite,
 	        int32_t *hitx, int32_t *hity, int32_t *hitz, uint32_t  cliptype);
+
+//One ray of hitscan_batch(): set vx/vy/vz, read back the hit fields.
+#define MAXHITSCANRAYS 8
+typedef struct
+{
+    int32_t vx, vy, vz;
+    int16_t hitsect, hitwall, hitsprite;
+    int32_t hitx, hity, hitz;
+} hitscantype;
+int hitscan_batch(int32_t xs, int32_t ys, int32_t zs, int16_t sectnum,
+            hitscantype *rays, int32_t numrays, uint32_t  cliptype);
 int inside (int32_t x, int32_t y, int16_t sectnum);
 void setfirstwall(int16_t sectnum, int16_t newfirstwall);
 void rotatepoint(int32_t xpivot, int32_t ypivot, int32_t x, int32_t y, int16_t daang,
@@ -95,6 +106,12 @@ void dragpoint(int16_t pointhighlight, int32_t dax, int32_t day);
 int ksqrt(int32_t num);
 int loopnumofsector(int16_t sectnum, int16_t wallnum);
 int cansee(int32_t x1, int32_t y1, int32_t z1, int16_t sect1,int32_t x2, int32_t y2, int32_t z2, int16_t sect2);
+void flushcanseecache(void);
+void resetcanseecache(void);
+void resetzrangecache(void);
+void markwallmoved(int16_t wallnum);
+void flushspritehash(void);
+int32_t getspritesnear(int32_t x, int32_t y, int32_t r, int16_t *list, int32_t maxlist);
 int lintersect(int32_t x1, int32_t y1, int32_t z1, int32_t x2, int32_t y2, int32_t z2, int32_t x3, int32_t y3, int32_t x4, int32_t y4, int32_t *intx,int32_t *inty, int32_t *intz);
 int rintersect(int32_t x1, int32_t y1, int32_t z1, int32_t vx, int32_t vy, int32_t vz,
                int32_t x3, int32_t y3, int32_t x4, int32_t y4, int32_t *intx,
@@ -156,6 +173,40 @@ int clipinsidebox(int32_t x, int32_t y, int16_t wallnum, int32_t walldist);
     extern EXT_RAM_ATTR int32_t tilefileoffs[MAXTILES];
     extern int32_t totalclocklock;
 
+//cansee() caches, see engine.c
+    extern int canseecachemode;
+    extern uint32_t canseecalls, canseememohits, canseepvsrejects;
+
+//getzrange() calls and how many reused the sector walk, see engine.c
+    extern uint32_t zrangecalls, zrangememohits;
+
+//Sprite proximity grid counters; spritehashtouched[i] is the
+//spritehashclock value when sprite i was last moved or inserted, see engine.c
+    extern uint32_t spritehashclock, spritehashqueries, spritehashfound;
+    extern EXT_RAM_ATTR uint32_t spritehashtouched[MAXSPRITES];
+
+//Frame pacing and latency counters, see display.c
+    extern int framecap;
+    extern uint32_t framepaceframeus, framepacelatencyus;
+    extern void (*framepaceidle)(void);
+    int32_t gettimerfrac(void);
+    void adjusttotalclock(int32_t n);
+    void framepacemarkinput(void);
+    int32_t framepacespare(void);
+
+//XIP cache hit rate and SRAM-resident code size, see display.c
+    extern uint32_t xiphitpermille, hottextbytes;
+
+//Texel bytes mipped surfaces touched last frame, see engine.c
+    extern uint32_t mipfetchfull, mipfetchactual;
+
+//rotatesprite calls last frame and how many took the row blitter, see engine.c
+    extern uint32_t rotatespriteblits, rotatespritedraws;
+
+//Map file the live board came from, reference for delta save games
+    extern char loadedboardname[128];
+    int32_t loadboardbase(char *filename, sectortype *sec, walltype *wal, spritetype *spr);
+
 #ifdef __cplusplus
 }
 #endif
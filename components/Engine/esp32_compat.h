@@ -18,8 +18,9 @@
 // This MUST be included before any FatFS headers to properly redefine DIR
 #include "dirent.h"
 
-// Forward declare psram_malloc for use by kkmalloc
+// Forward declare psram_malloc/psram_free for use by kkmalloc/kkfree
 extern void *psram_malloc(size_t size);
+extern void psram_free(void *ptr);
 
 // Define BYTE_ORDER for RP2350 (ARM Cortex-M33, little-endian)
 #ifndef BYTE_ORDER
@@ -30,7 +31,8 @@ extern void *psram_malloc(size_t size);
 #define PLATFORM_SUPPORTS_SDL
 
 // Memory allocation macros - use PSRAM for large allocations
-#define kkfree(x) /* PSRAM doesn't support free */
+#define kkfree(x) psram_free(x)
+#define kfree(x) psram_free(x)
 #define kkmalloc(x) psram_malloc(x)
 #define kmalloc(x) psram_malloc(x)
 
@@ -19,6 +19,10 @@
 
 #include "duke3d.h"
 
+#ifdef RP2350_PSRAM
+#include "psram_allocator.h"
+#endif
+
 extern char game_dir[512];
 
 //The multiplayer module in game.dll needs direct access to the crc32 (sic).
@@ -192,9 +196,9 @@ void uninitgroupfile(void)
 	int i;
     
 	for( i=0 ; i < grpSet.num ;i++){
-        free(grpSet.archives[i].gfilelist);
-        free(grpSet.archives[i].fileOffsets);
-        free(grpSet.archives[i].filesizes);
+        kfree(grpSet.archives[i].gfilelist);
+        kfree(grpSet.archives[i].fileOffsets);
+        kfree(grpSet.archives[i].filesizes);
         memset(&grpSet.archives[i], 0, sizeof(grpArchive_t));
     }
     
@@ -761,6 +765,320 @@ void dfwrite_raw(void *buffer, size_t dasizeof, size_t count, FILE *fil)
 }
 #endif
 
+#ifdef RP2350_PSRAM
+// Streaming LZ for save games. The stream is cut into 4KB blocks that are
+// packed independently (LZ4-style tokens, 1K-entry hash), so the codec only
+// needs ~10KB of working memory. Packed blocks are gathered and written to
+// the card in 16KB chunks. Each block is [u16 packed][u16 raw][payload];
+// packed == raw means the block is stored.
+//
+// The memory modes write/read the same calls to a growable PSRAM image
+// instead, for save snapshots held in RAM.
+#define SAVLZBLOCK 4096
+#define SAVLZIO    16384
+#define SAVLZHASH  10
+
+static uint8_t  *savlzblk, *savlzpackbuf, *savlzio;
+static uint16_t *savlzhash;
+static FILE     *savlzout;
+static int32_t   savlzin;
+static int32_t   savlzblkpos, savlzblklen, savlziopos, savlziolen;
+static int32_t   savlztotal;
+static uint8_t   savlzmode, savlzerror;    // mode: 1 LZ write, 2 LZ read, 3/4 memory
+static uint8_t  *savmembuf;
+static int32_t   savmemlen, savmemcap, savmempos;
+
+static int32_t savlzext(uint8_t *dst, int32_t op, int32_t v)
+{
+    while (v >= 255) { dst[op++] = 255; v -= 255; }
+    dst[op++] = (uint8_t)v;
+    return op;
+}
+
+static int32_t savlzpack(const uint8_t *src, int32_t n, uint8_t *dst)
+{
+    int32_t ip = 0, anchor = 0, op = 0, ref, len, lit;
+    uint32_t seq;
+
+    memset(savlzhash, 0xff, sizeof(uint16_t)<<SAVLZHASH);
+    while (ip+4 <= n)
+    {
+        seq = src[ip]|(src[ip+1]<<8)|(src[ip+2]<<16)|((uint32_t)src[ip+3]<<24);
+        seq = (seq*2654435761u)>>(32-SAVLZHASH);
+        ref = savlzhash[seq];
+        savlzhash[seq] = (uint16_t)ip;
+        if (ref == 0xffff || memcmp(src+ref, src+ip, 4)) { ip++; continue; }
+
+        len = 4;
+        while (ip+len < n && src[ref+len] == src[ip+len]) len++;
+        lit = ip-anchor;
+        if (op+lit+lit/255+len/255+5 > n) return(-1);
+
+        dst[op++] = (uint8_t)((min(lit,15)<<4)|min(len-4,15));
+        if (lit >= 15) op = savlzext(dst, op, lit-15);
+        memcpy(dst+op, src+anchor, lit); op += lit;
+        dst[op++] = (uint8_t)(ip-ref);
+        dst[op++] = (uint8_t)((ip-ref)>>8);
+        if (len-4 >= 15) op = savlzext(dst, op, len-19);
+        ip += len; anchor = ip;
+    }
+
+    lit = n-anchor;
+    if (op+lit+lit/255+2 > n) return(-1);
+    dst[op++] = (uint8_t)(min(lit,15)<<4);
+    if (lit >= 15) op = savlzext(dst, op, lit-15);
+    memcpy(dst+op, src+anchor, lit);
+    return(op+lit);
+}
+
+static int32_t savlzunpack(const uint8_t *src, int32_t n, uint8_t *dst, int32_t raw)
+{
+    int32_t ip = 0, op = 0, lit, len, off, b;
+    uint8_t tok;
+
+    for (;;)
+    {
+        if (ip >= n) return(-1);
+        tok = src[ip++];
+        lit = tok>>4;
+        if (lit == 15) do { if (ip >= n) return(-1); b = src[ip++]; lit += b; } while (b == 255);
+        if (ip+lit > n || op+lit > raw) return(-1);
+        memcpy(dst+op, src+ip, lit); ip += lit; op += lit;
+        if (ip == n) break;
+
+        if (ip+2 > n) return(-1);
+        off = src[ip]|(src[ip+1]<<8); ip += 2;
+        len = (tok&15)+4;
+        if ((tok&15) == 15) do { if (ip >= n) return(-1); b = src[ip++]; len += b; } while (b == 255);
+        if (off == 0 || off > op || op+len > raw) return(-1);
+        for (b = op-off; len > 0; len--) dst[op++] = dst[b++];
+    }
+    return(op == raw ? 0 : -1);
+}
+
+static void savlzput(const uint8_t *p, int32_t n)
+{
+    int32_t k;
+
+    while (n > 0)
+    {
+        k = min(n, SAVLZIO-savlziopos);
+        memcpy(savlzio+savlziopos, p, k);
+        savlziopos += k; p += k; n -= k;
+        if (savlziopos == SAVLZIO)
+        {
+            if (fwrite(savlzio, 1, SAVLZIO, savlzout) != SAVLZIO) savlzerror = 1;
+            savlztotal += SAVLZIO;
+            savlziopos = 0;
+        }
+    }
+}
+
+static void savlzflushblock(void)
+{
+    uint8_t hdr[4];
+    int32_t packed;
+
+    if (savlzblkpos == 0) return;
+    packed = savlzpack(savlzblk, savlzblkpos, savlzpackbuf);
+    if (packed < 0) packed = savlzblkpos;
+    hdr[0] = (uint8_t)packed; hdr[1] = (uint8_t)(packed>>8);
+    hdr[2] = (uint8_t)savlzblkpos; hdr[3] = (uint8_t)(savlzblkpos>>8);
+    savlzput(hdr, 4);
+    savlzput(packed == savlzblkpos ? savlzblk : savlzpackbuf, packed);
+    savlzblkpos = 0;
+}
+
+static int32_t savlzget(uint8_t *p, int32_t n)
+{
+    int32_t k;
+
+    while (n > 0)
+    {
+        if (savlziopos == savlziolen)
+        {
+            savlziolen = kread(savlzin, savlzio, SAVLZIO);
+            savlziopos = 0;
+            if (savlziolen <= 0) { savlziolen = 0; return(-1); }
+        }
+        k = min(n, savlziolen-savlziopos);
+        memcpy(p, savlzio+savlziopos, k);
+        savlziopos += k; p += k; n -= k;
+    }
+    return(0);
+}
+
+static int32_t savlzloadblock(void)
+{
+    uint8_t hdr[4];
+    int32_t packed, raw;
+
+    savlzblkpos = savlzblklen = 0;
+    if (savlzget(hdr, 4)) return(-1);
+    packed = hdr[0]|(hdr[1]<<8);
+    raw = hdr[2]|(hdr[3]<<8);
+    if (raw == 0 || raw > SAVLZBLOCK || packed > raw) return(-1);
+    if (packed == raw) { if (savlzget(savlzblk, raw)) return(-1); }
+    else if (savlzget(savlzpackbuf, packed) || savlzunpack(savlzpackbuf, packed, savlzblk, raw)) return(-1);
+    savlzblklen = raw;
+    return(0);
+}
+
+static int32_t savlzalloc(void)
+{
+    savlzblk = psram_malloc(SAVLZBLOCK);
+    savlzpackbuf = psram_malloc(SAVLZBLOCK);
+    savlzio = psram_malloc(SAVLZIO);
+    savlzhash = psram_malloc(sizeof(uint16_t)<<SAVLZHASH);
+    savlzblkpos = savlzblklen = savlziopos = savlziolen = 0;
+    savlztotal = 0;
+    savlzerror = 0;
+    if (savlzblk && savlzpackbuf && savlzio && savlzhash) return(0);
+    savlzclose();
+    return(-1);
+}
+
+int32_t savlzwrite(FILE *fil)
+{
+    if (savlzalloc()) return(-1);
+    savlzout = fil;
+    savlzmode = 1;
+    return(0);
+}
+
+int32_t savlzread(int32_t fil)
+{
+    if (savlzalloc()) return(-1);
+    savlzin = fil;
+    savlzmode = 2;
+    return(0);
+}
+
+int32_t savmemwrite(void)
+{
+    savmemlen = 0;
+    savlzerror = 0;
+    savlzmode = 3;
+    return(0);
+}
+
+int32_t savmemread(void)
+{
+    if (savmembuf == NULL || savmemlen == 0) return(-1);
+    savmempos = 0;
+    savlzerror = 0;
+    savlzmode = 4;
+    return(0);
+}
+
+uint8_t *savmemimage(int32_t *len)
+{
+    *len = savmemlen;
+    return(savmembuf);
+}
+
+int32_t savlzclose(void)
+{
+    int32_t ret;
+
+    if (savlzmode >= 3)
+    {
+        ret = savlzerror ? -1 : savmemlen;
+        if (savlzerror) savmemlen = 0;
+        savlzmode = 0;
+        return(ret);
+    }
+    if (savlzmode == 1)
+    {
+        savlzflushblock();
+        if (savlziopos && fwrite(savlzio, 1, savlziopos, savlzout) != (size_t)savlziopos) savlzerror = 1;
+        savlztotal += savlziopos;
+    }
+    ret = savlzerror ? -1 : savlztotal;
+    savlzmode = 0;
+    psram_free(savlzblk); psram_free(savlzpackbuf);
+    psram_free(savlzio); psram_free(savlzhash);
+    savlzblk = savlzpackbuf = savlzio = NULL;
+    savlzhash = NULL;
+    return(ret);
+}
+
+// Stream bytes through the codec. With a base the bytes are XORed against
+// it first, so fields still equal to the freshly loaded map become zero runs.
+void dfwritedelta(void *buffer, const void *base, size_t size, FILE *fil)
+{
+    uint8_t *p = (uint8_t *)buffer;
+    uint8_t *grown;
+    const uint8_t *b = (const uint8_t *)base;
+    int32_t i, k;
+
+    if (savlzmode == 3)
+    {
+        if (savmemlen+(int32_t)size > savmemcap)
+        {
+            k = max(savmemcap*2, savmemlen+(int32_t)size);
+            grown = psram_realloc(savmembuf, k);
+            if (grown == NULL) { savlzerror = 1; return; }
+            savmembuf = grown;
+            savmemcap = k;
+        }
+        memcpy(savmembuf+savmemlen, p, size);
+        savmemlen += size;
+        return;
+    }
+    if (savlzmode != 1) { dfwrite_raw(buffer, 1, size, fil); return; }
+    while (size > 0)
+    {
+        k = min((int32_t)size, SAVLZBLOCK-savlzblkpos);
+        if (b) { for (i = 0; i < k; i++) savlzblk[savlzblkpos+i] = p[i]^b[i]; b += k; }
+        else memcpy(savlzblk+savlzblkpos, p, k);
+        savlzblkpos += k; p += k; size -= k;
+        if (savlzblkpos == SAVLZBLOCK) savlzflushblock();
+    }
+}
+
+void kdfreaddelta(void *buffer, const void *base, size_t size, int32_t fil)
+{
+    uint8_t *p = (uint8_t *)buffer;
+    const uint8_t *b = (const uint8_t *)base;
+    int32_t i, k;
+
+    if (savlzmode == 4)
+    {
+        k = min((int32_t)size, savmemlen-savmempos);
+        memcpy(p, savmembuf+savmempos, k);
+        memset(p+k, 0, size-k);
+        if (k < (int32_t)size) savlzerror = 1;
+        savmempos += k;
+        return;
+    }
+    if (savlzmode != 2) { kdfread_raw(buffer, 1, size, fil); return; }
+    while (size > 0)
+    {
+        if (savlzblkpos == savlzblklen && (savlzerror || savlzloadblock()))
+        {
+            savlzerror = 1;
+            memset(p, 0, size);
+            return;
+        }
+        k = min((int32_t)size, savlzblklen-savlzblkpos);
+        if (b) { for (i = 0; i < k; i++) p[i] = savlzblk[savlzblkpos+i]^b[i]; b += k; }
+        else memcpy(p, savlzblk+savlzblkpos, k);
+        savlzblkpos += k; p += k; size -= k;
+    }
+}
+
+void dfwrite_lz(void *buffer, size_t dasizeof, size_t count, FILE *fil)
+{
+    dfwritedelta(buffer, NULL, dasizeof*count, fil);
+}
+
+void kdfread_lz(void *buffer, size_t dasizeof, size_t count, int32_t fil)
+{
+    kdfreaddelta(buffer, NULL, dasizeof*count, fil);
+}
+#endif
+
 
 //int SafeFileExists ( const char  * _filename );
 int32_t TCkopen4load(const char  *filename, int32_t readfromGRP)
@@ -38,6 +38,19 @@ void     dfwrite(void *buffer, size_t dasizeof, size_t count, FILE *fil);
 void     kdfread_raw(void *buffer, size_t dasizeof, size_t count, int32_t fil);
 void     dfread_raw(void *buffer, size_t dasizeof, size_t count, FILE *fil);
 void     dfwrite_raw(void *buffer, size_t dasizeof, size_t count, FILE *fil);
+
+// Streaming LZ save format. While a stream is open the _lz / delta calls go
+// through the codec; otherwise they fall back to the raw calls above.
+int32_t  savlzwrite(FILE *fil);
+int32_t  savlzread(int32_t fil);
+int32_t  savmemwrite(void);       // Same calls, into a PSRAM image
+int32_t  savmemread(void);
+uint8_t *savmemimage(int32_t *len);
+int32_t  savlzclose(void);        // Bytes written (write stream) or -1 on error
+void     kdfread_lz(void *buffer, size_t dasizeof, size_t count, int32_t fil);
+void     dfwrite_lz(void *buffer, size_t dasizeof, size_t count, FILE *fil);
+void     kdfreaddelta(void *buffer, const void *base, size_t size, int32_t fil);
+void     dfwritedelta(void *buffer, const void *base, size_t size, FILE *fil);
 #endif
 
 int      getGRPcrc32(int grpID);
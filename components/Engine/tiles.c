@@ -6,6 +6,9 @@
 //  Copyright (c) 2012 fabien sanglard. All rights reserved.
 //
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "tiles.h"
 #include "engine.h"
 #include "draw.h"
@@ -13,6 +16,7 @@
 
 #include "esp_attr.h"
 #include "esp_heap_caps.h"
+#include "psram_sections.h"
 
 char  artfilename[20];
 
@@ -30,6 +34,8 @@ void setviewtotile(short tilenume, int32_t tileWidth, int32_t tileHeight)
 {
     int32_t i, j;
     
+    tilecacherelease(tilenume);
+
     /* DRAWROOMS TO TILE BACKUP&SET CODE */
     tiles[tilenume].dim.width = tileWidth;
     tiles[tilenume].dim.height = tileHeight;
@@ -66,6 +72,8 @@ void squarerotatetile(short tilenume)
     
     dimensions_t tileDim;
     
+    tilecacherelease(tilenume);
+
     tileDim.width = tiles[tilenume].dim.width;
     tileDim.height = tiles[tilenume].dim.height;
     
@@ -94,24 +102,292 @@ void squarerotatetile(short tilenume)
 
 
 
+/*
+ * SRAM L1 tile cache. Tile pixels live in the PSRAM cache pool and every
+ * texel fetch goes through the XIP cache, which is shared with the map
+ * arrays and flash code. setgotpic() counts draws per tile; every
+ * TILECACHE_WINDOW frames tilecacheupdate() copies the most drawn small
+ * tiles into a fixed SRAM pool and points tiles[].data at the copy. The
+ * PSRAM block stays allocated and is pointed at again when the tile drops
+ * out. Repointing only happens between frames, so drawers never see a tile
+ * move under them.
+ *
+ * If the PSRAM cache evicts a resident tile, allocache() clears
+ * tiles[].data and the SRAM copy is simply forgotten. Anything that writes
+ * tile pixels calls tilecacherelease() first.
+ */
+#define TILECACHE_POOL_SIZE (48*1024)
+#define TILECACHE_MAX_TILE (16*1024)
+#define TILECACHE_MAX_RESIDENT 128
+#define TILECACHE_MAX_TOUCHED 512
+#define TILECACHE_WINDOW 8
+
+typedef struct {
+    short tile;
+    int32_t offset, size;
+    uint8_t *psram;
+} tilecacheentry_t;
+
+static uint8_t tilecachepool[TILECACHE_POOL_SIZE] __attribute__((aligned(4)));
+static tilecacheentry_t tilecacheresidentlist[TILECACHE_MAX_RESIDENT];
+static int32_t tilecacheresidentcount = 0;
+static uint8_t tilecachedraws[MAXTILES];
+static uint8_t tilecachewant[(MAXTILES+7)>>3];
+static short tilecachetouched[TILECACHE_MAX_TOUCHED];
+static int32_t tilecachetouchedcount = 0, tilecacheframe = 0;
+static uint32_t tilecachesramnow = 0, tilecachepsramnow = 0;
+
+int tilecachemode = 1;
+uint32_t tilecachesramdraws = 0, tilecachepsramdraws = 0;
+uint32_t tilecacheresident = 0, tilecachebytes = 0;
+
 //1. Lock a picture in the cache system.
 //2. Mark it as used in the bitvector tracker.
-IRAM_ATTR void setgotpic(int32_t tilenume)
+//3. Count the draw for the SRAM tile cache.
+HOT_CODE(setgotpic) void setgotpic(int32_t tilenume)
 {
     if (tiles[tilenume].lock < 200)
         tiles[tilenume].lock = 199;
     
     gotpic[tilenume>>3] |= pow2char[tilenume&7];
+
+    if (tilecachemode)
+    {
+        if (tilecachedraws[tilenume] == 0 && tilecachetouchedcount < TILECACHE_MAX_TOUCHED)
+            tilecachetouched[tilecachetouchedcount++] = tilenume;
+        if (tilecachedraws[tilenume] < 255)
+            tilecachedraws[tilenume]++;
+
+        if ((uint32_t)(tiles[tilenume].data-tilecachepool) < TILECACHE_POOL_SIZE)
+            tilecachesramnow++;
+        else
+            tilecachepsramnow++;
+    }
+}
+
+static int tilecachecompare(const void *a, const void *b)
+{
+    return tilecachedraws[*(const short *)b]-tilecachedraws[*(const short *)a];
 }
 
+static void tilecacherebuild(void)
+{
+    int32_t i, n, used, size;
+    short tilenume;
+    tilecacheentry_t *e;
+
+    // Most drawn first, then take what fits
+    qsort(tilecachetouched, tilecachetouchedcount, sizeof(short), tilecachecompare);
+    clearbufbyte(tilecachewant, sizeof(tilecachewant), 0L);
+    used = 0;
+    for(i=0; i<tilecachetouchedcount; i++)
+    {
+        tilenume = tilecachetouched[i];
+        size = tiles[tilenume].dim.width*tiles[tilenume].dim.height+tilemipsize(tilenume,tilemips[tilenume]);
+        if (tiles[tilenume].data == NULL || tiles[tilenume].lock >= 200 ||
+            tilenume >= MAXTILES-16 || size <= 0 || size > TILECACHE_MAX_TILE ||
+            tilecachedraws[tilenume] < 2)
+            continue;
+        size = (size+3)&~3;
+        if (used+size > TILECACHE_POOL_SIZE)
+            continue;
+        used += size;
+        tilecachewant[tilenume>>3] |= pow2char[tilenume&7];
+    }
+
+    // Compact the tiles that stay, in address order so memmove never
+    // overwrites one that has not moved yet, and hand back the rest
+    n = 0; used = 0;
+    for(i=0; i<tilecacheresidentcount; i++)
+    {
+        e = &tilecacheresidentlist[i];
+        tilenume = e->tile;
+        if (tilenume < 0 || tiles[tilenume].data != tilecachepool+e->offset)
+            continue;
+        if ((tilecachewant[tilenume>>3]&pow2char[tilenume&7]) == 0)
+        {
+            tiles[tilenume].data = e->psram;
+            continue;
+        }
+        if (e->offset != used)
+            memmove(tilecachepool+used, tilecachepool+e->offset, e->size);
+        tiles[tilenume].data = tilecachepool+used;
+        e->offset = used;
+        used += (e->size+3)&~3;
+        tilecacheresidentlist[n++] = *e;
+        tilecachewant[tilenume>>3] &= ~pow2char[tilenume&7];
+    }
 
+    // Bring in the new ones
+    for(i=0; i<tilecachetouchedcount && n<TILECACHE_MAX_RESIDENT; i++)
+    {
+        tilenume = tilecachetouched[i];
+        if ((tilecachewant[tilenume>>3]&pow2char[tilenume&7]) == 0)
+            continue;
+        size = tiles[tilenume].dim.width*tiles[tilenume].dim.height+tilemipsize(tilenume,tilemips[tilenume]);
+        if (used+size > TILECACHE_POOL_SIZE)
+            continue;
+        e = &tilecacheresidentlist[n++];
+        e->tile = tilenume;
+        e->offset = used;
+        e->size = size;
+        e->psram = tiles[tilenume].data;
+        memcpy(tilecachepool+used, e->psram, size);
+        tiles[tilenume].data = tilecachepool+used;
+        used += (size+3)&~3;
+    }
 
+    tilecacheresidentcount = n;
+    tilecacheresident = n;
+    tilecachebytes = used;
+}
 
+// Point every resident tile back at its PSRAM copy
+void tilecacheflush(void)
+{
+    int32_t i;
+    tilecacheentry_t *e;
+
+    for(i=0; i<tilecacheresidentcount; i++)
+    {
+        e = &tilecacheresidentlist[i];
+        if (e->tile >= 0 && tiles[e->tile].data == tilecachepool+e->offset)
+            tiles[e->tile].data = e->psram;
+    }
+    tilecacheresidentcount = 0;
+    tilecacheresident = 0;
+    tilecachebytes = 0;
+}
+
+static int32_t tilemipbytes;
+
+// Called before a tile's pixels are written, so the write lands in PSRAM
+// and stale mip levels and opaque runs are no longer used
+void tilecacherelease(short tilenume)
+{
+    int32_t i;
+    tilecacheentry_t *e;
+
+    if (tilemips[tilenume])
+    {
+        tilemipbytes -= tilemipsize(tilenume,tilemips[tilenume]);
+        tilemips[tilenume] = 0;
+    }
+    if (tilespans[tilenume] != NULL)
+    {
+        suckcache((int32_t *)tilespans[tilenume]);
+        tilespans[tilenume] = NULL;
+    }
+    for(i=0; i<tilecacheresidentcount; i++)
+    {
+        e = &tilecacheresidentlist[i];
+        if (e->tile == tilenume)
+        {
+            if (tiles[tilenume].data == tilecachepool+e->offset)
+                tiles[tilenume].data = e->psram;
+            e->tile = -1;
+            return;
+        }
+    }
+}
+
+// Called once per frame, between frames
+void tilecacheupdate(void)
+{
+    int32_t i;
+
+    tilecachesramdraws = tilecachesramnow;
+    tilecachepsramdraws = tilecachepsramnow;
+    tilecachesramnow = tilecachepsramnow = 0;
+
+    if (!tilecachemode)
+    {
+        if (tilecacheresidentcount)
+            tilecacheflush();
+        for(i=0; i<tilecachetouchedcount; i++)
+            tilecachedraws[tilecachetouched[i]] = 0;
+        tilecachetouchedcount = 0;
+        return;
+    }
+
+    if (++tilecacheframe < TILECACHE_WINDOW)
+        return;
+    tilecacheframe = 0;
+
+    tilecacherebuild();
+    for(i=0; i<tilecachetouchedcount; i++)
+        tilecachedraws[tilecachetouched[i]] = 0;
+    tilecachetouchedcount = 0;
+}
+
+
+
+
+
+/*
+ * Mipmaps. loadtile() allocates room after the base level of power-of-two
+ * tiles of 16x16 and up for mipmaplevels halved copies, and maketilemips()
+ * box filters them. tilemips[] holds the levels present. wallscan() and
+ * hline() pick a level per column or span from the texel step.
+ * mipmapbudget (KiB) caps what the levels take out of the tile cache; the
+ * total only learns about evicted tiles when they are reloaded, so it is
+ * recounted from tiles[] when it runs over.
+ */
+int mipmaplevels = 2;
+int mipmapbudget = 256;
+EXT_RAM_ATTR uint8_t tilemips[MAXTILES] __psram_bss("tilemips");
+static int32_t tilemipbytes = 0, tilemiprecount = 0;
+
+int32_t tilemipsize(short tilenume, int32_t levels)
+{
+    int32_t m, size = 0;
+
+    for(m=1; m<=levels; m++)
+        size += (tiles[tilenume].dim.width>>m)*(tiles[tilenume].dim.height>>m);
+    return(size);
+}
+
+static int32_t tilemiplevels(short tilenume)
+{
+    int32_t xbits, ybits, levels;
+
+    xbits = picsiz[tilenume]&15;
+    ybits = picsiz[tilenume]>>4;
+    if ((pow2long[xbits] != tiles[tilenume].dim.width) ||
+        (pow2long[ybits] != tiles[tilenume].dim.height))
+        return(0);
+
+    levels = min(min(xbits,ybits)-3,min(mipmaplevels,TILEMIP_MAXLEVELS));
+    if (levels <= 0)
+        return(0);
+
+    if (tilemipbytes+tilemipsize(tilenume,levels) > mipmapbudget*1024)
+    {
+        int32_t i;
+
+        // Rate limited, this walks every tile
+        if (tilemiprecount-- > 0)
+            return(0);
+        tilemiprecount = 64;
+        tilemipbytes = 0;
+        for(i=0; i<MAXTILES; i++)
+            if (tilemips[i])
+            {
+                if (tiles[i].data == NULL)
+                    tilemips[i] = 0;
+                else
+                    tilemipbytes += tilemipsize(i,tilemips[i]);
+            }
+        if (tilemipbytes+tilemipsize(tilenume,levels) > mipmapbudget*1024)
+            return(0);
+    }
+    return(levels);
+}
 
 void loadtile(short tilenume)
 {
     uint8_t  *ptr;
-    int32_t i, tileFilesize;
+    int32_t i, tileFilesize, miplevels = 0;
     
     
     
@@ -146,8 +422,17 @@ void loadtile(short tilenume)
     }
     
     if (tiles[tilenume].data == NULL){
+        // Any levels it had went with the old allocation
+        if (tilemips[tilenume])
+        {
+            tilemipbytes -= tilemipsize(tilenume,tilemips[tilenume]);
+            tilemips[tilenume] = 0;
+        }
+        if (mipmaplevels > 0)
+            miplevels = tilemiplevels(tilenume);
+
         tiles[tilenume].lock = 199;
-        allocache(&tiles[tilenume].data,tileFilesize,(uint8_t  *) &tiles[tilenume].lock);
+        allocache(&tiles[tilenume].data,tileFilesize+tilemipsize(tilenume,miplevels),(uint8_t  *) &tiles[tilenume].lock);
     }
     
     if (artfilplc != tilefileoffs[tilenume])
@@ -160,6 +445,13 @@ void loadtile(short tilenume)
     kread(artfil,ptr,tileFilesize);
     faketimerhandler();
     artfilplc = tilefileoffs[tilenume]+tileFilesize;
+
+    if (miplevels)
+    {
+        maketilemips(tilenume,miplevels);
+        tilemips[tilenume] = miplevels;
+        tilemipbytes += tilemipsize(tilenume,miplevels);
+    }
 }
 
 
@@ -176,6 +468,7 @@ uint8_t* allocatepermanenttile(short tilenume, int32_t width, int32_t height)
     tileDataSize = width * height;
     
     tiles[tilenume].lock = 255;
+    tilecacherelease(tilenume);
     allocache(&tiles[tilenume].data,tileDataSize,(uint8_t  *) &tiles[tilenume].lock);
     
     tiles[tilenume].dim.width = width;
@@ -316,6 +609,68 @@ void TILE_MakeAvailable(short picID){
 
 }
 
+/*
+ * Opaque runs per column, for the masked column drawers. Built the first
+ * time a tile is drawn masked and kept in the tile cache under the tile's
+ * own lock, so it ages out with the tile. Layout: uint16 first[width+1],
+ * then (start, end) row pairs; column x owns pairs first[x]..first[x+1]-1.
+ */
+int tilespanmode = 1;
+EXT_RAM_ATTR uint8_t *tilespans[MAXTILES] __psram_bss("tilespans");
+
+uint16_t *tilegetspans(short tilenume)
+{
+    int32_t x, y, w, h, nruns;
+    uint8_t *col, lock;
+    uint16_t *first, *runs;
+
+    if (tilespans[tilenume] != NULL)
+        return((uint16_t *)tilespans[tilenume]);
+    if (!tilespanmode)
+        return(NULL);
+
+    w = tiles[tilenume].dim.width;
+    h = tiles[tilenume].dim.height;
+    if ((w <= 0) || (h <= 0) || (h > 65535) || (tiles[tilenume].data == NULL))
+        return(NULL);
+
+    nruns = 0;
+    col = tiles[tilenume].data;
+    for(x=0; x<w; x++,col+=h)
+        for(y=0; y<h; y++)
+            if ((col[y] != 255) && ((y == 0) || (col[y-1] == 255)))
+                nruns++;
+    if (nruns > 65535)
+        return(NULL);
+
+    // Both blocks stay put while the other one is allocated
+    lock = tiles[tilenume].lock;
+    tiles[tilenume].lock = 254;
+    allocache(&tilespans[tilenume],(w+1+2*nruns)*sizeof(uint16_t),&tiles[tilenume].lock);
+    tiles[tilenume].lock = lock;
+
+    first = (uint16_t *)tilespans[tilenume];
+    runs = first+w+1;
+    nruns = 0;
+    col = tiles[tilenume].data;
+    for(x=0; x<w; x++,col+=h)
+    {
+        first[x] = nruns;
+        for(y=0; y<h; y++)
+        {
+            if (col[y] == 255)
+                continue;
+            runs[nruns*2] = y;
+            while ((y < h) && (col[y] != 255))
+                y++;
+            runs[nruns*2+1] = y;
+            nruns++;
+        }
+    }
+    first[w] = nruns;
+    return(first);
+}
+
 void copytilepiece(int32_t tilenume1, int32_t sx1, int32_t sy1, int32_t xsiz, int32_t ysiz,
                    int32_t tilenume2, int32_t sx2, int32_t sy2)
 {
@@ -327,6 +682,8 @@ void copytilepiece(int32_t tilenume1, int32_t sx1, int32_t sy1, int32_t xsiz, in
     
     xsiz2 = tiles[tilenume2].dim.width;
     ysiz2 = tiles[tilenume2].dim.height;
+
+    tilecacherelease(tilenume2);
     
     
     if ((xsiz1 > 0) && (ysiz1 > 0) && (xsiz2 > 0) && (ysiz2 > 0))
@@ -59,6 +59,26 @@ void copytilepiece(int32_t tilenume1, int32_t sx1, int32_t sy1, int32_t xsiz, in
 extern EXT_RAM_ATTR uint8_t  gotpic[(MAXTILES+7)>>3];
 void setgotpic(int32_t tilenume);
 
+//SRAM copies of the most drawn tiles, see tiles.c
+extern int tilecachemode;
+extern uint32_t tilecachesramdraws, tilecachepsramdraws;
+extern uint32_t tilecacheresident, tilecachebytes;
+void tilecacheupdate(void);
+void tilecacheflush(void);
+void tilecacherelease(short tilenume);
+
+//Mip levels stored after the base level of a tile, see tiles.c
+#define TILEMIP_MAXLEVELS 3
+extern int mipmaplevels, mipmapbudget;
+extern EXT_RAM_ATTR uint8_t tilemips[MAXTILES];
+int32_t tilemipsize(short tilenume, int32_t levels);
+void maketilemips(short tilenume, int32_t levels);
+
+//Opaque row runs per column for the masked drawers, see tiles.c
+extern int tilespanmode;
+extern EXT_RAM_ATTR uint8_t *tilespans[MAXTILES];
+uint16_t *tilegetspans(short tilenume);
+
 
 
 int animateoffs(int16_t tilenum);
@@ -25,6 +25,10 @@ Prepared for public release: 03/21/2003 - Charlie Wiederhold, 3D Realms
 //-------------------------------------------------------------------------
 
 #include "duke3d.h"
+#include "cvar_defs.h"
+#ifdef RP2350_PSRAM
+#include "psram_sections.h"
+#endif
 
 extern int32_t numenvsnds;
 uint8_t  actor_tog;
@@ -442,12 +446,21 @@ int32_t ifsquished(short i, short p)
     return 0;
 }
 
+// Sprites near the blast, from the sprite grid. The status lists are still
+// walked in order; a sprite is only skipped when the grid left it out and it
+// has not moved or been spawned since, as it could not be within r anyway.
+#define HITRADIUSNEAR 512
+static short hitradiusnear[HITRADIUSNEAR];
+static uint8_t hitradiusmark[MAXSPRITES>>3];
+
 void hitradius( short i, int32_t  r, int32_t  hp1, int32_t  hp2, int32_t  hp3, int32_t  hp4 )
 {
     spritetype *s,*sj;
     walltype *wal;
     int32_t d, q, x1, y1;
     int32_t sectcnt, sectend, dasect, startwall, endwall, nextsect;
+    int32_t numnear;
+    uint32_t since;
     short j,k,p,x,nextj,sect;
     uint8_t  statlist[] = {0,1,6,10,12,2,5};
     short *tempshort = (short *)tempbuf;
@@ -504,12 +517,30 @@ void hitradius( short i, int32_t  r, int32_t  hp1, int32_t  hp2, int32_t  hp3, i
 
     q = -(16<<8)+(TRAND&((32<<8)-1));
 
+    // dist() never falls below 15/16 of the largest axis delta.
+    since = spritehashclock;
+    numnear = getspritesnear(s->x,s->y,r+(r>>3)+1,hitradiusnear,HITRADIUSNEAR);
+    if(numnear <= HITRADIUSNEAR)
+    {
+        memset(hitradiusmark,0,sizeof(hitradiusmark));
+        for(k=0;k<numnear;k++)
+            hitradiusmark[hitradiusnear[k]>>3] |= 1<<(hitradiusnear[k]&7);
+    }
+    else numnear = -1;
+
     for(x = 0;x<7;x++)
     {
         j = headspritestat[statlist[x]];
         while(j >= 0)
         {
             nextj = nextspritestat[j];
+
+            if( numnear >= 0 && !(hitradiusmark[j>>3]&(1<<(j&7))) && spritehashtouched[j] <= since )
+            {
+                j = nextj;
+                continue;
+            }
+
             sj = &sprite[j];
 
             if( x == 0 || x >= 5 || AFLAMABLE(sj->picnum) )
@@ -623,7 +654,7 @@ void hitradius( short i, int32_t  r, int32_t  hp1, int32_t  hp2, int32_t  hp3, i
 }
 
 
-IRAM_ATTR int movesprite(short spritenum, int32_t xchange, int32_t ychange, int32_t zchange, uint32_t cliptype)
+HOT_CODE(movesprite) int movesprite(short spritenum, int32_t xchange, int32_t ychange, int32_t zchange, uint32_t cliptype)
 {
     int32_t daz,h, oldx, oldy;
     short retval, dasectnum, cd;
@@ -710,7 +741,7 @@ IRAM_ATTR int movesprite(short spritenum, int32_t xchange, int32_t ychange, int3
 }
 
 
-IRAM_ATTR short ssp(short i,uint32_t cliptype) //The set sprite function
+HOT_CODE(ssp) short ssp(short i,uint32_t cliptype) //The set sprite function
 {
     spritetype *s;
     int32_t movetype;
@@ -3136,6 +3167,86 @@ void movetransports(void)
 
 
 
+// Actor activity scheduler (console "ActorScheduler", off by default).
+// Awake enemies that are far from their player and stand in a sector that
+// was not drawn last frame only run their CON code every few ticks. The
+// skipped ticks are banked per sprite and handed to execute() through
+// actorschedtics so action frames keep their pace once the actor runs.
+// It changes game logic timing, so it never runs in network games or while
+// recording/playing a demo.
+#define ACTORSCHEDNEAR  8192            // always tick inside this distance
+#define ACTORSCHEDFAR   (MAXSLEEPDIST<<1)
+
+#ifdef RP2350_PSRAM
+static uint16_t actorschedbank[MAXSPRITES] __psram_bss("actorschedbank");
+#else
+static uint16_t actorschedbank[MAXSPRITES];
+#endif
+int32_t actorschedtics;
+
+// A reused sprite index, a new map or a loaded game starts with nothing
+// banked; i < 0 clears every sprite.
+void resetactorsched(short i)
+{
+    if( i < 0 )
+        memset(actorschedbank,0,sizeof(actorschedbank));
+    else actorschedbank[i] = 0;
+}
+
+static uint8_t  actormustick(short i,short p)
+{
+    spritetype *s = &sprite[i];
+
+    if( !badguy(s) ) return 1;          // scripted props, items, switches...
+
+    switch(s->picnum)
+    {
+        case BOSS1:
+        case BOSS1STAYPUT:
+        case BOSS2:
+        case BOSS3:
+        case BOSS4:
+        case BOSS4STAYPUT:
+            return 1;
+    }
+
+    if( hittype[i].extra >= 0 ) return 1; // pending damage
+    if( ps[p].actorsqu == i ) return 1;
+
+    return 0;
+}
+
+// Returns 1 if sprite i should sit this tick out.
+static uint8_t  actorthrottled(short i,short p,int32_t x)
+{
+    int32_t rate;
+    short sect;
+
+    actorschedtics = 0;
+
+    if( g_CV_ActorScheduler == 0 || ud.multimode > 1 || ud.recstat != 0 )
+        return 0;
+
+    sect = sprite[i].sectnum;
+
+    if( x < ACTORSCHEDNEAR || (visitedSectors[sect>>3]&pow2char[sect&7]) || actormustick(i,p) )
+        rate = 1;
+    else if( x < ACTORSCHEDFAR )
+        rate = 2;
+    else rate = 4;
+
+    if( rate > 1 && actorschedbank[i] < (rate-1)*TICSPERFRAME )
+    {
+        actorschedbank[i] += TICSPERFRAME;
+        actordebugDeferred++;
+        return 1;
+    }
+
+    actorschedtics = actorschedbank[i];
+    actorschedbank[i] = 0;
+    return 0;
+}
+
 void moveactors(void)
 {
     int32_t x, m, l, *t;
@@ -4382,7 +4493,10 @@ void moveactors(void)
 
         p = findplayer(s,&x);
 
+        if( actorthrottled(i,p,x) ) goto BOLT;
+
         execute(i,p,x);
+        actorschedtics = 0;
 
         BOLT:
 
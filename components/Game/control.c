@@ -65,6 +65,25 @@ uint32   CONTROL_JoyHatState1; //[MAXJOYHATS];
 uint32   CONTROL_JoyHatState2; //[MAXJOYHATS];
 
 
+//
+// Timestamped keyboard state. keyhandler() passes every press and release
+// with its arrival time; CONTROL_SampleKeys() closes one input window per
+// game tick. A key pressed and released inside a window still counts for
+// that tick, and held time comes from the timestamps, not the frame rate.
+//
+static uint32  CONTROL_KeyPressTime[MAXKEYBOARDSCAN];
+static uint32  CONTROL_KeyHeldPending[MAXKEYBOARDSCAN];
+static uint32  CONTROL_KeyHeldUs[MAXKEYBOARDSCAN];
+static uint8_t CONTROL_KeyIsDown[MAXKEYBOARDSCAN];
+static uint8_t CONTROL_KeyTapPending[MAXKEYBOARDSCAN];
+static uint8_t CONTROL_KeyTapped[MAXKEYBOARDSCAN];
+static uint32  CONTROL_WindowStart = 0;
+#define CONTROL_TAP_MAXAGE 100000 // us
+static uint32  CONTROL_HeldRemainder[MAXGAMEBUTTONS];
+
+// Press-to-tick latency, buckets <1, 1, 2-3, 4-7, 8-15, 16-31, 32-63, 64+ ms
+uint32 CONTROL_LatencyHistogram[CONTROL_LATENCY_BUCKETS];
+
 static short mouseButtons = 0;
 static short lastmousebuttons = 0;
 
@@ -94,9 +113,11 @@ static int32 JoyAnalogDeadzone[MAXJOYAXES];
 int ACTION(int i)
 {
 
-	//Keyboard input
+	//Keyboard input, including keys tapped and released within the last tick
 	if( (KB_KeyDown[KeyMapping[i].key1]) ||
-		(KB_KeyDown[KeyMapping[i].key2])
+		(KB_KeyDown[KeyMapping[i].key2]) ||
+		(CONTROL_KeyTapped[KeyMapping[i].key1]) ||
+		(CONTROL_KeyTapped[KeyMapping[i].key2])
 	  )
 	{
 		return 1;
@@ -361,6 +382,31 @@ static void RESHATBUTTON(int i)
 
 void CONTROL_UpdateKeyboardState(int key, int pressed)
 {
+	uint32 t = _readlastkeytime();
+
+	if (key < 0 || key >= MAXKEYBOARDSCAN)
+		return;
+
+	if (pressed)
+	{
+		if (!CONTROL_KeyIsDown[key])
+		{
+			CONTROL_KeyIsDown[key] = 1;
+			CONTROL_KeyPressTime[key] = t;
+			CONTROL_KeyTapPending[key] = 1;
+		}
+	}
+	else if (CONTROL_KeyIsDown[key])
+	{
+		uint32 from = CONTROL_KeyPressTime[key];
+
+		if ((int32)(from-CONTROL_WindowStart) < 0)
+			from = CONTROL_WindowStart;
+		if ((int32)(t-from) > 0)
+			CONTROL_KeyHeldPending[key] += t-from;
+		CONTROL_KeyIsDown[key] = 0;
+	}
+
 	/*
 
 		if(pressed)
@@ -688,6 +734,8 @@ void CONTROL_ClearAction( int32 whichbutton )
 	//RESBUTTON(whichbutton);
 	KB_KeyDown[KeyMapping[whichbutton].key1] = 0;
 	KB_KeyDown[KeyMapping[whichbutton].key2] = 0;
+	CONTROL_KeyTapped[KeyMapping[whichbutton].key1] = 0;
+	CONTROL_KeyTapped[KeyMapping[whichbutton].key2] = 0;
 
 	RESJOYBUTTON(whichbutton);
 	RESHATBUTTON(whichbutton);
@@ -696,6 +744,66 @@ void CONTROL_ClearAction( int32 whichbutton )
 	
 }
 
+//
+// CONTROL_SampleKeys() -- close the input window for this tick
+//
+void CONTROL_SampleKeys( void )
+{
+	uint32 now = getmicroticks();
+	int i;
+
+	for (i = 0; i < MAXKEYBOARDSCAN; i++)
+	{
+		uint32 held = CONTROL_KeyHeldPending[i];
+
+		if (CONTROL_KeyIsDown[i])
+		{
+			uint32 from = CONTROL_KeyPressTime[i];
+
+			if ((int32)(from-CONTROL_WindowStart) < 0)
+				from = CONTROL_WindowStart;
+			if ((int32)(now-from) > 0)
+				held += now-from;
+		}
+		CONTROL_KeyHeldUs[i] = held;
+		CONTROL_KeyHeldPending[i] = 0;
+
+		// Presses older than a few ticks were meant for a menu, not the game
+		if (CONTROL_KeyTapPending[i] && now-CONTROL_KeyPressTime[i] > CONTROL_TAP_MAXAGE)
+			CONTROL_KeyTapPending[i] = 0;
+
+		CONTROL_KeyTapped[i] = CONTROL_KeyTapPending[i] && !CONTROL_KeyIsDown[i];
+		if (CONTROL_KeyTapPending[i])
+		{
+			uint32 ms = (now-CONTROL_KeyPressTime[i])/1000;
+			int b = 0;
+
+			while (ms && b < CONTROL_LATENCY_BUCKETS-1)
+			{
+				ms >>= 1;
+				b++;
+			}
+			CONTROL_LatencyHistogram[b]++;
+		}
+		CONTROL_KeyTapPending[i] = 0;
+	}
+	CONTROL_WindowStart = now;
+}
+
+//
+// CONTROL_ActionHeldTics() -- ticks a game function's keys were held during
+// the last window, in units of ticrate per second. Fractions carry over.
+//
+int32 CONTROL_ActionHeldTics( int32 which, int32 ticrate )
+{
+	uint32 us = max(CONTROL_KeyHeldUs[KeyMapping[which].key1],
+	                CONTROL_KeyHeldUs[KeyMapping[which].key2]);
+	uint32 total = (uint32)(((uint64_t)us*ticrate)) + CONTROL_HeldRemainder[which];
+
+	CONTROL_HeldRemainder[which] = total%1000000;
+	return (int32)(total/1000000);
+}
+
 void CONTROL_ClearUserInput( UserInput *info )
 {
 	STUBBED("CONTROL_ClearUserInput");
@@ -258,6 +258,11 @@ int32 CONTROL_GetFilteredAxisValue(int32 axis);
 void CONTROL_PrintAxes( void );
 
 void CONTROL_UpdateKeyboardState(int key, int pressed);
+void CONTROL_SampleKeys( void );
+int32 CONTROL_ActionHeldTics( int32 which, int32 ticrate );
+
+#define CONTROL_LATENCY_BUCKETS 8
+extern uint32 CONTROL_LatencyHistogram[CONTROL_LATENCY_BUCKETS];
 
 #ifdef __cplusplus
 };
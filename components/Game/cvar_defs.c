@@ -51,6 +51,38 @@ void CVARDEFS_Init()
 
 	g_CV_DebugFileAccess = 0;
     REGCONVAR("DebugFileAccess", " - Displays info on file access", g_CV_DebugFileAccess, CVARDEFS_DefaultFunction);
+
+    g_CV_ActorScheduler = 0;
+    REGCONVAR("ActorScheduler", " - Tick far, unseen enemies less often (no demos)", g_CV_ActorScheduler, CVARDEFS_DefaultFunction);
+
+    g_CV_DebugActors = 0;
+    REGCONVAR("DebugActors", " - Displays CON executes per tick", g_CV_DebugActors, CVARDEFS_DefaultFunction);
+
+    g_CV_HudCache = 1;
+    REGCONVAR("HudCache", " - Cache the mini status bar between changes", g_CV_HudCache, CVARDEFS_DefaultFunction);
+
+    g_CV_TargetFPS = 0;
+    REGCONVAR("TargetFPS", " - Lower the 3D view width to hold this frame rate (0 = off)", g_CV_TargetFPS, CVARDEFS_DefaultFunction);
+
+    g_CV_DebugRender = 0;
+    REGCONVAR("DebugRender", " - Displays the 3D view scale and frame times", g_CV_DebugRender, CVARDEFS_DefaultFunction);
+
+    g_CV_DebugInput = 0;
+    REGCONVAR("DebugInput", " - Displays a key press to game tick latency histogram", g_CV_DebugInput, CVARDEFS_DefaultFunction);
+
+    REGCONVAR("FrameCap", " - Present on every Nth 60 Hz vsync and sleep in between (0 = off)", framecap, CVARDEFS_DefaultFunction);
+
+    g_CV_SaveSnapshot = 1;
+    REGCONVAR("SaveSnapshot", " - Keep saves in memory and write them to SD in the background", g_CV_SaveSnapshot, CVARDEFS_DefaultFunction);
+
+    REGCONVAR("TileCache", " - Keep the most drawn tiles in SRAM (0 = off)", tilecachemode, CVARDEFS_DefaultFunction);
+
+    REGCONVAR("Mipmaps", " - Mip levels built for wall and floor tiles as they load (0 = off)", mipmaplevels, CVARDEFS_DefaultFunction);
+    REGCONVAR("MipBudget", " - KiB of the tile cache mip levels may use", mipmapbudget, CVARDEFS_DefaultFunction);
+
+    REGCONVAR("MaskedRuns", " - Draw masked walls and sprites by their opaque runs (0 = off)", tilespanmode, CVARDEFS_DefaultFunction);
+
+    REGCONVAR("CanseeCache", " - cansee caches: 1 memo, 2 sector pairs, 3 both", canseecachemode, CVARDEFS_DefaultFunction);
 	
     REGCONVAR("TickRate", " - Changes the tick rate", g_iTickRate, CVARDEFS_DefaultFunction);
     REGCONVAR("TicksPerFrame", " - Changes the ticks per frame", g_iTicksPerFrame, CVARDEFS_DefaultFunction);
@@ -114,6 +146,90 @@ void CVARDEFS_Render()
 
 		sprintf(buf, "Deallocate Calls: %d", sounddebugDeallocateSoundCalls);
 		minitext(2, 26, buf, 23,10+16);
+
+		sprintf(buf, "Pan3D/frame: %u (cansee %u)", sounddebugPan3DInstances,
+			sounddebugPan3DOcclusions);
+		minitext(2, 34, buf, 23,10+16);
+
+		{
+			uint32_t streams, streambytes, streamlate;
+			FX_StreamStats(&streams, &streambytes, &streamlate);
+			sprintf(buf, "Streams: %u (%u KiB read, %u late)  Evictions: %d",
+				streams, streambytes/1024, streamlate, cacheevictions);
+			minitext(2, 42, buf, 23,10+16);
+		}
+	}
+
+	if(g_CV_DebugActors)
+	{
+        char  buf[128];
+        minitext(2, 2, "Debug Actors", 17,10+16);
+
+		sprintf(buf, "Executes/tick: %u", actordebugExecutesPerTick);
+		minitext(2, 10, buf, 23,10+16);
+
+		sprintf(buf, "Deferred/tick: %u", actordebugDeferredPerTick);
+		minitext(2, 18, buf, 23,10+16);
+
+		sprintf(buf, "Cansee/tick: %u (memo %u, pvs %u)", canseedebugCallsPerTick,
+			canseedebugMemoHitsPerTick, canseedebugPVSRejectsPerTick);
+		minitext(2, 26, buf, 23,10+16);
+
+		sprintf(buf, "Near queries/tick: %u (%u sprites)", spritehashdebugQueriesPerTick,
+			spritehashdebugFoundPerTick);
+		minitext(2, 34, buf, 23,10+16);
+
+		sprintf(buf, "Zrange/tick: %u (memo %u)", zrangedebugCallsPerTick,
+			zrangedebugMemoHitsPerTick);
+		minitext(2, 42, buf, 23,10+16);
+	}
+
+	if(g_CV_DebugRender)
+	{
+        char  buf[128];
+        // Below the rows the other debug screens use, so they can be combined
+        minitext(2, 90, "Debug Render", 17,10+16);
+
+		sprintf(buf, "View scale: %u/4", renderdebugScale);
+		minitext(2, 98, buf, 23,10+16);
+
+		sprintf(buf, "Rooms: %u ms  Frame: %u ms", renderdebugRoomsMs, renderdebugFrameMs);
+		minitext(2, 106, buf, 23,10+16);
+
+		sprintf(buf, "Present: %u.%u ms  Input latency: %u.%u ms",
+			framepaceframeus/1000, (framepaceframeus/100)%10,
+			framepacelatencyus/1000, (framepacelatencyus/100)%10);
+		minitext(2, 114, buf, 23,10+16);
+
+		sprintf(buf, "XIP hit: %u.%u%%  SRAM code: %u KiB",
+			xiphitpermille/10, xiphitpermille%10, (hottextbytes+1023)/1024);
+		minitext(2, 122, buf, 23,10+16);
+
+		sprintf(buf, "Tile draws SRAM/PSRAM: %u/%u  L1: %u tiles %u KiB",
+			tilecachesramdraws, tilecachepsramdraws, tilecacheresident, (tilecachebytes+1023)/1024);
+		minitext(2, 130, buf, 23,10+16);
+
+		sprintf(buf, "Mip texels: %u of %u KiB",
+			(mipfetchactual+1023)/1024, (mipfetchfull+1023)/1024);
+		minitext(2, 138, buf, 23,10+16);
+
+		sprintf(buf, "2D blits: %u of %u", rotatespriteblits, rotatespritedraws);
+		minitext(2, 146, buf, 23,10+16);
+	}
+
+	if(g_CV_DebugInput)
+	{
+        static const char *bucketname[CONTROL_LATENCY_BUCKETS] =
+            { "<1", "1", "2-3", "4-7", "8-15", "16-31", "32-63", "64+" };
+        char  buf[128];
+        int i;
+        minitext(2, 2, "Debug Input (press to tick, ms)", 17,10+16);
+
+		for(i = 0; i < CONTROL_LATENCY_BUCKETS; i++)
+		{
+			sprintf(buf, "%s: %u", bucketname[i], CONTROL_LatencyHistogram[i]);
+			minitext(2, (i*8)+10, buf, 23,10+16);
+		}
 	}
 
 }
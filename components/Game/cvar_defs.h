@@ -36,6 +36,29 @@ int g_CV_DebugFileAccess;
 uint32_t sounddebugActiveSounds;
 uint32_t sounddebugAllocateSoundCalls;
 uint32_t sounddebugDeallocateSoundCalls;
+uint32_t sounddebugPan3DInstances;
+uint32_t sounddebugPan3DOcclusions;
+int g_CV_ActorScheduler;
+int g_CV_DebugActors;
+int g_CV_HudCache;
+int g_CV_TargetFPS;
+int g_CV_DebugRender;
+int g_CV_SaveSnapshot;
+int g_CV_DebugInput;
+uint32_t renderdebugScale;
+uint32_t renderdebugRoomsMs;
+uint32_t renderdebugFrameMs;
+uint32_t actordebugExecutes;
+uint32_t actordebugDeferred;
+uint32_t actordebugExecutesPerTick;
+uint32_t actordebugDeferredPerTick;
+uint32_t canseedebugCallsPerTick;
+uint32_t canseedebugMemoHitsPerTick;
+uint32_t canseedebugPVSRejectsPerTick;
+uint32_t spritehashdebugQueriesPerTick;
+uint32_t spritehashdebugFoundPerTick;
+uint32_t zrangedebugCallsPerTick;
+uint32_t zrangedebugMemoHitsPerTick;
 
 
 int g_CV_CubicInterpolation;
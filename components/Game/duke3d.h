@@ -321,6 +321,8 @@ typedef struct
 {
     short i;
     int voice;
+    short occlcs, occlsect; // Listener and source sectors of the cached cansee()
+    uint8_t occluded, occlage;
 } SOUNDOWNER;
 
 #include "usrhooks.h"
@@ -563,6 +565,7 @@ extern int32_t EXT_RAM_ATTR script[MAXSCRIPTSIZE];
 extern int32_t *scriptptr,*insptr,*labelcode,labelcnt;
 extern char  *label,*textptr,error,warning;
 extern uint8_t killit_flag;
+extern int32_t actorschedtics;
 #ifdef RP2350_PSRAM
 extern int32_t **actorscrptr;
 #else
@@ -648,7 +651,7 @@ extern short last_threehundred,lastsavedpos;
 extern uint8_t  restorepalette;
 
 extern short buttonstat;
-extern int32_t cachecount;
+extern int32_t cachecount, cacheevictions;
 extern uint8_t  waterpal[768],slimepal[768],titlepal[768],drealms[768],endingpal[768];
 extern char boardfilename[128];
 extern uint8_t  betaname[80];
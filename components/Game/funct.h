@@ -47,6 +47,7 @@ extern void intomenusounds(void );
 //#line "sounds.c" 227
 extern void playmusic(char  *fn);
 //#line "sounds.c" 251
+extern void readsound(uint16_t num, int32_t fp, int32_t l);
 extern uint8_t  loadsound(uint16_t num);
 //#line "sounds.c" 277
 extern int xyzsound(short num,short i,int32_t x,int32_t y,int32_t z);
@@ -237,6 +238,8 @@ extern int loadpheader(uint8_t  spot,int32 *vn,int32 *ln,int32 *psk,int32 *numpl
 extern int loadplayer(int8_t spot);
 //#line "menues.c" 276
 extern int saveplayer(int8_t spot);
+extern void flushsavesnapshot(int all);
+extern void idlesavesnapshot(void);
 //#line "menues.c" 421
 extern void sendgameinfo(void );
 //#line "menues.c" 434
@@ -285,6 +288,7 @@ extern void transnum(void );
 extern uint8_t  parsecommand(int readfromGRP );
 //#line "gamedef.c" 1227
 extern void passone(int readfromGRP);
+extern int32_t linkbranches(void);
 //#line "gamedef.c" 1239
 extern void loadefs(char  *fn,char  *mptr, int readfromGRP);
 //#line "gamedef.c" 1342
@@ -299,6 +303,7 @@ extern void alterang(short a);
 extern void move(void);
 //#line "gamedef.c" 1711
 extern void parseifelse(int32_t condition);
+extern void parseifchain(void);
 //#line "gamedef.c" 1729
 extern uint8_t  parse(void );
 //#line "gamedef.c" 2699
@@ -360,6 +365,7 @@ extern void displayfragbar(void );
 //#line "game.c" 1318
 void drawsmallweapon(short weapon, float scale, short x, short y); // xduke
 extern void coolgaugetext(short snum);
+extern void displayminihud(struct player_struct *p);
 //#line "game.c" 1557
 extern void tics(short offx, short offy , short color);
 //#line "game.c" 1572
@@ -589,5 +595,6 @@ extern void moveeffectors(void );
 extern void moveactors(void );
 //#line "actors.c" 6005
 extern void moveexplosions(void );
+extern void resetactorsched(short i);
 
 #endif
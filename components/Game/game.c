@@ -61,6 +61,10 @@ Prepared for public release: 03/21/2003 - Charlie Wiederhold, 3D Realms
 
 #include "SDL.h"
 #include "esp_attr.h"
+#ifdef RP2350_PSRAM
+#include "psram_sections.h"
+#include "psram_allocator.h"
+#endif
 
 #define MINITEXT_BLUE	0
 #define MINITEXT_RED	2
@@ -789,7 +793,7 @@ void getpackets(void)
 
 //From player.c
 void computergetinput(int32_t snum, input *syn);
-IRAM_ATTR void faketimerhandler()
+HOT_CODE(faketimerhandler) void faketimerhandler()
 {
     int32_t i, j, k;
     input *osyn, *nsyn;
@@ -828,6 +832,7 @@ IRAM_ATTR void faketimerhandler()
      if( !CONSOLE_IsActive())
      {
         getinput(myconnectindex);
+        framepacemarkinput();
      }
 
      avgfvel += loc.fvel; // x
@@ -911,7 +916,7 @@ IRAM_ATTR void faketimerhandler()
 					i = 0;
 				}
 
-                totalclock -= TICSPERFRAME*i;
+                adjusttotalclock(-TICSPERFRAME*i);
                 myminlag[connecthead] -= i; otherminlag += i;
             }
 
@@ -978,7 +983,7 @@ IRAM_ATTR void faketimerhandler()
             else if (klabs(i) > 2) i = ksgn(i);
             else i = 0;
 
-            totalclock -= TICSPERFRAME*i;
+            adjusttotalclock(-TICSPERFRAME*i);
             myminlag[connecthead] -= i; otherminlag += i;
 
             for(i=connecthead;i>=0;i=connectpoint2[i])
@@ -1910,13 +1915,225 @@ void drawsmallweapon(short weapon, float scale, short x, short y)
 	return;
 }
 
+/*
+ * Mini status bar (screen_size 4) cache.
+ *  The mini bar sits on top of the 3D view, so it has to be composited
+ *  every frame, but its pixels only change when a number or icon does.
+ *  Each field is drawn once into an off-screen copy (255 = see through)
+ *  and from then on the copy is blitted run by run until its key changes.
+ */
+#define MINIHUDX2      128  /* 320x200 units, the bar spans x 0..127 */
+#define MINIHUDY1      160  /*                      and y 160..199 */
+#define MINIHUDFIELDS  3
+#define MINIHUDKEYS    6
+#define MINIHUDBUFSIZ  (MINIHUDX2*(200-MINIHUDY1))
+
+#ifdef RP2350_PSRAM
+static uint8_t minihudcache[MINIHUDBUFSIZ] __psram_bss("minihudcache");
+static uint8_t minihudsave[MINIHUDBUFSIZ] __psram_bss("minihudsave");
+#else
+static uint8_t minihudcache[MINIHUDBUFSIZ], minihudsave[MINIHUDBUFSIZ];
+#endif
+static int32_t minihudkey[MINIHUDFIELDS][MINIHUDKEYS];
+static int32_t minihudlayout = -1, minihudxdim, minihudydim;
+static const short minihudfieldx[MINIHUDFIELDS+1] = { 0, 37, 69, MINIHUDX2 };
+
+static void minihudkeys(struct player_struct *p, int32_t key[MINIHUDFIELDS][MINIHUDKEYS])
+{
+    int32_t i, j;
+
+    memset(key, 0, sizeof(minihudkey));
+
+    if(ud.extended_screen_size>0)
+    {
+        key[0][0] = p->ammo_amount[p->curr_weapon];
+        key[0][1] = p->last_extra;
+        key[0][2] = p->shield_amount;
+        key[0][3] = p->jetpack_amount;
+        key[0][4] = p->steroids_amount;
+        key[0][5] = p->firstaid_amount;
+        return;
+    }
+
+    key[0][0] = (sprite[p->i].pal == 1 && p->last_extra < 2) ? 1 : p->last_extra;
+
+    if (p->curr_weapon == HANDREMOTE_WEAPON) i = HANDBOMB_WEAPON; else i = p->curr_weapon;
+    key[1][0] = p->ammo_amount[i];
+
+    i = 0; j = 0x80000000;
+    switch(p->inven_icon)
+    {
+        case 1: i = p->firstaid_amount; break;
+        case 2: i = ((p->steroids_amount+3)>>2); break;
+        case 3: i = ((p->holoduke_amount+15)/24); j = p->holoduke_on; break;
+        case 4: i = ((p->jetpack_amount+15)>>4); j = p->jetpack_on; break;
+        case 5: i = p->heat_amount/12; j = p->heat_on; break;
+        case 6: i = ((p->scuba_amount+63)>>6); break;
+        case 7: i = (p->boot_amount>>1); break;
+    }
+    key[2][0] = p->inven_icon;
+    key[2][1] = (uint8_t )i;
+    key[2][2] = j;
+}
+
+static void minihudfield(short f, struct player_struct *p)
+{
+	short offx, offy;
+    int32_t i, j, o;
+    uint8_t  permbit;
+    char text[512];
+
+    // FIX_00027: Added an extra small statusbar (HUD)
+    if(ud.extended_screen_size>0)
+    {
+        offx = 5; offy = 160;
+
+        sprintf(text,"%d", ps[screenpeek].ammo_amount[ps[screenpeek].curr_weapon]);
+        minitext(offx+26,offy+21,text,COLOR_ON,2+8+16); //minitext: 2 red light, 23 yellow
+        sprintf(text,"%d", ps[screenpeek].last_extra); 
+        gametext(offx,offy+20,text,ps[screenpeek].last_extra<=50?15:0,2+8+16); //minitext: 2 red light, 23 yellow
+        rotatesprite((offx+0*10)<<16,(offy+28)<<16,20000,0,SHIELD,ps[screenpeek].shield_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+0*10)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].shield_amount)*20000/10,0,SHIELD,0,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+1*10)<<16,(offy+28)<<16,35000,0,JETPACK_ICON,ps[screenpeek].jetpack_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+1*10)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].jetpack_amount)*35000/40,0,JETPACK_ICON,0,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+2*10-1)<<16,(offy+28)<<16,35000,0,STEROIDS_ICON,ps[screenpeek].steroids_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+2*10-1)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].steroids_amount)*35000/20,0,STEROIDS_ICON,5,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+3*10-3)<<16,(offy+28)<<16,40000,0,FIRSTAID_ICON,ps[screenpeek].firstaid_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
+        rotatesprite((offx+3*10-3)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].firstaid_amount)*40000/10,0,FIRSTAID_ICON,0,0,2+8+16,0,0,xdim-1,ydim-1);
+        return;
+    }
+
+    switch(f)
+    {
+        case 0:
+            rotatesprite(5<<16,(200-28)<<16,65536L,0,HEALTHBOX,0,21,10+16,0,0,xdim-1,ydim-1);
+
+            if(sprite[p->i].pal == 1 && p->last_extra < 2)
+                digitalnumber(20,200-17,1,-16,10+16);
+            else digitalnumber(20,200-17,p->last_extra,-16,10+16);
+            break;
+
+        case 1:
+            rotatesprite(37<<16,(200-28)<<16,65536L,0,AMMOBOX,0,21,10+16,0,0,xdim-1,ydim-1);
+
+            if (p->curr_weapon == HANDREMOTE_WEAPON) i = HANDBOMB_WEAPON; else i = p->curr_weapon;
+            digitalnumber(53,200-17,p->ammo_amount[i],-16,10+16);
+            break;
+
+        case 2:
+            if (p->inven_icon == 0)
+                break;
+            rotatesprite(69<<16,(200-30)<<16,65536L,0,INVENTORYBOX,0,21,10+16,0,0,xdim-1,ydim-1);
+
+            o = 158; permbit = 0;
+            switch(p->inven_icon)
+            {
+                case 1: i = FIRSTAID_ICON; break;
+                case 2: i = STEROIDS_ICON; break;
+                case 3: i = HOLODUKE_ICON; break;
+                case 4: i = JETPACK_ICON; break;
+                case 5: i = HEAT_ICON; break;
+                case 6: i = AIRTANK_ICON; break;
+                case 7: i = BOOT_ICON; break;
+                default: i = -1;
+            }
+            if (i >= 0) rotatesprite((231-o)<<16,(200-21)<<16,65536L,0,i,0,0,10+16+permbit,0,0,xdim-1,ydim-1);
+
+            minitext(292-30-o,190,"%",6,10+16+permbit);
+
+            j = 0x80000000;
+            switch(p->inven_icon)
+            {
+                case 1: i = p->firstaid_amount; break;
+                case 2: i = ((p->steroids_amount+3)>>2); break;
+                case 3: i = ((p->holoduke_amount+15)/24); j = p->holoduke_on; break;
+                case 4: i = ((p->jetpack_amount+15)>>4); j = p->jetpack_on; break;
+                case 5: i = p->heat_amount/12; j = p->heat_on; break;
+                case 6: i = ((p->scuba_amount+63)>>6); break;
+                case 7: i = (p->boot_amount>>1); break;
+            }
+            invennum(284-30-o,200-6,(uint8_t )i,0,10+permbit);
+            if (j > 0) minitext(288-30-o,180,"ON",0,10+16+permbit);
+            else if (j != 0x80000000) minitext(284-30-o,180,"OFF",2,10+16+permbit);
+            if (p->inven_icon >= 6) minitext(284-35-o,180,"AUTO",2,10+16+permbit);
+            break;
+    }
+}
+
+void displayminihud(struct player_struct *p)
+{
+    int32_t key[MINIHUDFIELDS][MINIHUDKEYS];
+    int32_t f, nfields, layout, x, x1, x2, y, y1, w, h, bw;
+    uint8_t *src, *dst;
+
+    nfields = (ud.extended_screen_size>0) ? 1 : MINIHUDFIELDS;
+
+    bw = scale(MINIHUDX2,xdim,320);
+    y1 = scale(MINIHUDY1,ydim,200);
+    h = ydim-y1;
+    if( !g_CV_HudCache || bw*h > MINIHUDBUFSIZ )
+    {
+        for(f=0;f<nfields;f++)
+            minihudfield(f,p);
+        minihudlayout = -1;
+        return;
+    }
+
+    layout = (ud.extended_screen_size>0);
+    if( layout != minihudlayout || xdim != minihudxdim || ydim != minihudydim )
+    {
+        memset(minihudkey, 0xff, sizeof(minihudkey));
+        minihudlayout = layout;
+        minihudxdim = xdim;
+        minihudydim = ydim;
+    }
+
+    minihudkeys(p,key);
+    for(f=0;f<nfields;f++)
+    {
+        if( memcmp(key[f],minihudkey[f],sizeof(key[f])) == 0 )
+            continue;
+        memcpy(minihudkey[f],key[f],sizeof(key[f]));
+
+        // Draw the field over a see-through rectangle, keep it, then
+        // put back whatever the view had there.
+        x1 = nfields > 1 ? scale(minihudfieldx[f],xdim,320) : 0;
+        x2 = nfields > 1 ? scale(minihudfieldx[f+1],xdim,320) : bw;
+        w = x2-x1;
+        for(y=0;y<h;y++)
+        {
+            dst = (uint8_t *)(frameplace+ylookup[y1+y]+x1);
+            memcpy(&minihudsave[y*bw+x1],dst,w);
+            memset(dst,255,w);
+        }
+        minihudfield(f,p);
+        for(y=0;y<h;y++)
+        {
+            dst = (uint8_t *)(frameplace+ylookup[y1+y]+x1);
+            memcpy(&minihudcache[y*bw+x1],dst,w);
+            memcpy(dst,&minihudsave[y*bw+x1],w);
+        }
+    }
+
+    for(y=0;y<h;y++)
+    {
+        src = &minihudcache[y*bw];
+        dst = (uint8_t *)(frameplace+ylookup[y1+y]);
+        for(x=0;x<bw;)
+        {
+            if(src[x] == 255) { x++; continue; }
+            for(x1=x;x<bw && src[x] != 255;x++);
+            memcpy(dst+x1,src+x1,x-x1);
+        }
+    }
+}
+
 void coolgaugetext(short snum)
 {
     struct player_struct *p;
     int32_t i, j, o, ss, u;
     uint8_t  permbit;
 	short offx = 3, offy = 3, stepx=60, stepy=6;
-    char text[512];
     
     p = &ps[snum];
 
@@ -1961,74 +2178,7 @@ void coolgaugetext(short snum)
 
     if (ss == 4)   //DRAW MINI STATUS BAR:
     {
-    	// FIX_00027: Added an extra small statusbar (HUD)
-		if(ud.extended_screen_size>0)
-		{
-			offx = 5; offy = 160;
-
-			sprintf(text,"%d", ps[screenpeek].ammo_amount[ps[screenpeek].curr_weapon]);
-			minitext(offx+26,offy+21,text,COLOR_ON,2+8+16); //minitext: 2 red light, 23 yellow
-			sprintf(text,"%d", ps[screenpeek].last_extra); 
-			gametext(offx,offy+20,text,ps[screenpeek].last_extra<=50?15:0,2+8+16); //minitext: 2 red light, 23 yellow
-			rotatesprite((offx+0*10)<<16,(offy+28)<<16,20000,0,SHIELD,ps[screenpeek].shield_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+0*10)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].shield_amount)*20000/10,0,SHIELD,0,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+1*10)<<16,(offy+28)<<16,35000,0,JETPACK_ICON,ps[screenpeek].jetpack_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+1*10)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].jetpack_amount)*35000/40,0,JETPACK_ICON,0,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+2*10-1)<<16,(offy+28)<<16,35000,0,STEROIDS_ICON,ps[screenpeek].steroids_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+2*10-1)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].steroids_amount)*35000/20,0,STEROIDS_ICON,5,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+3*10-3)<<16,(offy+28)<<16,40000,0,FIRSTAID_ICON,ps[screenpeek].firstaid_amount?25:100,0,2+8+16,0,0,xdim-1,ydim-1);
-			rotatesprite((offx+3*10-3)<<16,(offy+28)<<16,ksqrt(ps[screenpeek].firstaid_amount)*40000/10,0,FIRSTAID_ICON,0,0,2+8+16,0,0,xdim-1,ydim-1);
-		}
-		else
-		{
-			if (p->inven_icon)
-				rotatesprite(69<<16,(200-30)<<16,65536L,0,INVENTORYBOX,0,21,10+16,0,0,xdim-1,ydim-1);
-			rotatesprite(5<<16,(200-28)<<16,65536L,0,HEALTHBOX,0,21,10+16,0,0,xdim-1,ydim-1);
-
-			if(sprite[p->i].pal == 1 && p->last_extra < 2)
-				digitalnumber(20,200-17,1,-16,10+16);
-			else digitalnumber(20,200-17,p->last_extra,-16,10+16);
-
-			rotatesprite(37<<16,(200-28)<<16,65536L,0,AMMOBOX,0,21,10+16,0,0,xdim-1,ydim-1);
-
-			if (p->curr_weapon == HANDREMOTE_WEAPON) i = HANDBOMB_WEAPON; else i = p->curr_weapon;
-			digitalnumber(53,200-17,p->ammo_amount[i],-16,10+16);
-
-			o = 158; permbit = 0;
-			if (p->inven_icon)
-			{
-				switch(p->inven_icon)
-				{
-					case 1: i = FIRSTAID_ICON; break;
-					case 2: i = STEROIDS_ICON; break;
-					case 3: i = HOLODUKE_ICON; break;
-					case 4: i = JETPACK_ICON; break;
-					case 5: i = HEAT_ICON; break;
-					case 6: i = AIRTANK_ICON; break;
-					case 7: i = BOOT_ICON; break;
-					default: i = -1;
-				}
-				if (i >= 0) rotatesprite((231-o)<<16,(200-21)<<16,65536L,0,i,0,0,10+16+permbit,0,0,xdim-1,ydim-1);
-
-				minitext(292-30-o,190,"%",6,10+16+permbit);
-
-				j = 0x80000000;
-				switch(p->inven_icon)
-				{
-					case 1: i = p->firstaid_amount; break;
-					case 2: i = ((p->steroids_amount+3)>>2); break;
-					case 3: i = ((p->holoduke_amount+15)/24); j = p->holoduke_on; break;
-					case 4: i = ((p->jetpack_amount+15)>>4); j = p->jetpack_on; break;
-					case 5: i = p->heat_amount/12; j = p->heat_on; break;
-					case 6: i = ((p->scuba_amount+63)>>6); break;
-					case 7: i = (p->boot_amount>>1); break;
-				}
-				invennum(284-30-o,200-6,(uint8_t )i,0,10+permbit);
-				if (j > 0) minitext(288-30-o,180,"ON",0,10+16+permbit);
-				else if (j != 0x80000000) minitext(284-30-o,180,"OFF",2,10+16+permbit);
-				if (p->inven_icon >= 6) minitext(284-35-o,180,"AUTO",2,10+16+permbit);
-			}
-		}
+        displayminihud(p);
         return;
     }
 
@@ -2440,6 +2590,10 @@ void gameexit(char  *msg)
         frecfilep = NULL;
     }
 
+#ifdef RP2350_PSRAM
+    flushsavesnapshot(1);
+#endif
+
     if(qe || cp)
         goto GOTOHERE;
 
@@ -2952,7 +3106,7 @@ void updatesectorz(int32_t x, int32_t y, int32_t z, short *sectnum)
     *sectnum = -1;
 }
 
-IRAM_ATTR void view(struct player_struct *pp, int32_t *vx, int32_t *vy,int32_t *vz,short *vsectnum, short ang, short horiz)
+HOT_CODE(view) void view(struct player_struct *pp, int32_t *vx, int32_t *vy,int32_t *vz,short *vsectnum, short ang, short horiz)
 {
      spritetype *sp;
      int32_t i, nx, ny, nz, hx, hy, hitx, hity, hitz;
@@ -3242,13 +3396,114 @@ static void se40code(int32_t x,int32_t y,int32_t z,int32_t a,int32_t h, int32_t
 
 static int32_t oyrepeat=-1;
 
-IRAM_ATTR void displayrooms(short snum,int32_t smoothratio)
+/*
+ * Render scale governor.
+ *  With TargetFPS set, the 3D view is drawn into the left 4/4, 3/4 or
+ *  2/4 of the view window and widened in place by repeating columns.
+ *  The HUD and weapon are drawn afterwards and stay at full width.
+ *  Frame time and drawrooms time are averaged (ms<<4). The scale drops
+ *  when frames overrun the budget by 1/8, and steps back up only when
+ *  the predicted frame at the next scale is 1/8 under budget.
+ */
+#define RENDERSCALEHOLD 16
+
+static int32_t renderscale = 4, renderscalehold;
+static int32_t renderscaleframe, renderscalerooms;
+static uint32_t renderscalestart, renderscalelast;
+static int32_t renderscalex2, renderscaleyx, renderscalerange;
+
+static uint8_t  renderscalebegin(void)
+{
+    int32_t w;
+
+    renderscalestart = getticks();
+    if (renderscalelast)
+        renderscaleframe += ((int32_t)((renderscalestart-renderscalelast)<<4)-renderscaleframe)>>3;
+    renderscalelast = renderscalestart;
+
+    if (g_CV_TargetFPS <= 0)
+    {
+        renderscale = 4;
+        return 0;
+    }
+    if (renderscale == 4)
+        return 0;
+
+    w = windowx2-windowx1+1;
+    renderscalex2 = windowx2;
+    renderscaleyx = yxaspect;
+    renderscalerange = viewingrange;
+
+    // Same field of view in fewer columns: widen yxaspect to match.
+    setview(windowx1,windowy1,windowx1+((w*renderscale)>>2)-1,windowy2);
+    setaspect(renderscalerange,scale(renderscaleyx,4,renderscale));
+    return 1;
+}
+
+static void renderscaleexpand(void)
+{
+    int32_t x, y, w, step, pos;
+    uint8_t *row;
+
+    w = renderscalex2-windowx1+1;
+    step = divscale16((w*renderscale)>>2,w);
+    for(y=windowy1;y<=windowy2;y++)
+    {
+        row = (uint8_t *)(frameplace+ylookup[y]+windowx1);
+        pos = step*(w-1);
+        for(x=w-1;x>=0;x--,pos-=step)
+            row[x] = row[pos>>16];
+    }
+}
+
+static void renderscaleend(uint8_t  scaled)
+{
+    int32_t budget, next;
+
+    if (scaled)
+    {
+        renderscaleexpand();
+        setview(windowx1,windowy1,renderscalex2,windowy2);
+        setaspect(renderscalerange,renderscaleyx);
+    }
+
+    renderscalerooms += ((int32_t)((getticks()-renderscalestart)<<4)-renderscalerooms)>>3;
+
+    renderdebugScale = renderscale;
+    renderdebugRoomsMs = renderscalerooms>>4;
+    renderdebugFrameMs = renderscaleframe>>4;
+
+    if (g_CV_TargetFPS <= 0 || renderscalehold-- > 0)
+        return;
+
+    budget = (1000<<4)/g_CV_TargetFPS;
+    if (renderscaleframe > budget+(budget>>3) && renderscale > 2)
+    {
+        renderscalerooms = scale(renderscalerooms,renderscale-1,renderscale);
+        renderscale--;
+        renderscalehold = RENDERSCALEHOLD;
+    }
+    else if (renderscale < 4)
+    {
+        next = renderscaleframe-renderscalerooms+scale(renderscalerooms,renderscale+1,renderscale);
+        if (next < budget-(budget>>3))
+        {
+            renderscalerooms = scale(renderscalerooms,renderscale+1,renderscale);
+            renderscale++;
+            renderscalehold = RENDERSCALEHOLD;
+        }
+    }
+}
+
+
+HOT_CODE(displayrooms) void displayrooms(short snum,int32_t smoothratio)
 {
     int32_t cposx,cposy,cposz,dst,j,fz,cz;
     short sect, cang, k, choriz;
     struct player_struct *p;
     int32_t tposx,tposy,i;
     short tang;
+    uint8_t  scaled, tilepath;
 
     p = &ps[snum];
 
@@ -3399,6 +3654,12 @@ IRAM_ATTR void displayrooms(short snum,int32_t smoothratio)
         if(choriz > 299) choriz = 299;
         else if(choriz < -99) choriz = -99;
 
+        // the tile path (tilt, low detail, screenshot) keeps its own scaling
+        tilepath = screencapt || ( ud.screen_tilting && p->rotscrnang ) || ud.detail==0;
+        scaled = 0;
+        if( !tilepath )
+            scaled = renderscalebegin();
+
         se40code(cposx,cposy,cposz,cang,choriz,smoothratio);
 
         if ((gotpic[MIRROR>>3]&(1<<(MIRROR&7))) > 0)
@@ -3435,6 +3696,9 @@ IRAM_ATTR void displayrooms(short snum,int32_t smoothratio)
         animatesprites(cposx,cposy,cang,smoothratio);
         drawmasks();
 
+        if( !tilepath )
+            renderscaleend(scaled);
+
         if(screencapt == 1)
         {
             setviewback();
@@ -3492,6 +3756,8 @@ short EGS(short whatsect,int32_t s_x,int32_t s_y,int32_t s_z,short s_pn,int8_t s
     if( i < 0 )
         gameexit(" Too many sprites spawned. This may happen (for any duke port) if you have hacked the steroids trail in the *.con files. If so, delete your *.con files to use the internal ones and try again.");
 
+    resetactorsched(i);
+
     hittype[i].bposx = s_x;
     hittype[i].bposy = s_y;
     hittype[i].bposz = s_z;
@@ -8432,6 +8698,15 @@ int main(int argc,char  **argv)
             ud.warp_on = 0;
     }
 
+#ifdef RP2350_PSRAM
+    // Start-up allocations stay in the boot arena; see psram_print_stats().
+    psram_mark_session();
+    psram_print_stats();
+
+    // Save snapshots reach the card in the frame pacer's spare time
+    framepaceidle = idlesavesnapshot;
+#endif
+
     MAIN_LOOP_RESTART:
 
     if(ud.warp_on == 0) //if game is loaded without /V or /L cmd arguments.
@@ -8616,8 +8891,30 @@ int main(int argc,char  **argv)
           nonsharedkeys();
         
 
+#ifdef DUKE3D_RP2350
+        // The tick alarm keeps totalclock running while the last frame drew.
+        // Queue and simulate a tick that fell due since then right before the
+        // view is built, so the frame shows the newest input.
+        if( ps[myconnectindex].gm&MODE_GAME && ud.recstat != 2 && ud.multimode < 2 &&
+            ud.show_help == 0 && (ps[myconnectindex].gm&MODE_MENU) != MODE_MENU )
+        {
+            _handle_events();
+            faketimerhandler();
+            if( moveloop() )
+                continue;
+        }
+#endif
+
         if( (ud.show_help == 0 && ud.multimode < 2 && !(ps[myconnectindex].gm&MODE_MENU) ) || ud.multimode > 1 || ud.recstat == 2)
-            i = min(max((totalclock-ototalclock)*(65536L/TICSPERFRAME),0),65536);
+        {
+            // Sub-tick clock fraction: every frame between two ticks gets its own view
+            int32_t frac;
+            do {
+                j = totalclock;
+                frac = gettimerfrac();
+            } while (j != totalclock);
+            i = min(max((int32_t)((((int64_t)(j-ototalclock)<<16)+frac)/TICSPERFRAME),0),65536);
+        }
         else
             i = 65536;
 
@@ -9732,20 +10029,47 @@ uint8_t  domovethings(void)
 
     if( ud.pause_on == 0 )
     {
+        // cansee() results are only reused until the next pass that
+        // may move floors, ceilings or blocking walls. The sprite grid is
+        // refreshed on the same beat, as sprites move by direct writes.
+        flushcanseecache();
+        flushspritehash();
         movefta();//ST 2
         moveweapons();          //ST 5 (must be last)
         movetransports();       //ST 9
+        flushcanseecache();
+        flushspritehash();
 
         moveplayers();          //ST 10
         movefallers();          //ST 12
         moveexplosions();       //ST 4
+        flushcanseecache();
+        flushspritehash();
 
         moveactors();           //ST 1
         moveeffectors();        //ST 3
+        flushcanseecache();
+        flushspritehash();
 
         movestandables();       //ST 6
         doanimations();
+        flushcanseecache();
+        flushspritehash();
         movefx();               //ST 11
+
+        actordebugExecutesPerTick = actordebugExecutes;
+        actordebugDeferredPerTick = actordebugDeferred;
+        actordebugExecutes = actordebugDeferred = 0;
+        canseedebugCallsPerTick = canseecalls;
+        canseedebugMemoHitsPerTick = canseememohits;
+        canseedebugPVSRejectsPerTick = canseepvsrejects;
+        canseecalls = canseememohits = canseepvsrejects = 0;
+        spritehashdebugQueriesPerTick = spritehashqueries;
+        spritehashdebugFoundPerTick = spritehashfound;
+        spritehashqueries = spritehashfound = 0;
+        zrangedebugCallsPerTick = zrangecalls;
+        zrangedebugMemoHitsPerTick = zrangememohits;
+        zrangecalls = zrangememohits = 0;
     }
 
     fakedomovethingscorrect();
@@ -9754,6 +10078,7 @@ uint8_t  domovethings(void)
     {
         animatewalls();
         movecyclers();
+        flushcanseecache();
         pan3dsound();
     }
 
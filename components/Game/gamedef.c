@@ -25,6 +25,7 @@ Prepared for public release: 03/21/2003 - Charlie Wiederhold, 3D Realms
 //-------------------------------------------------------------------------
 
 #include "duke3d.h"
+#include "cvar_defs.h"
 
 
 extern short otherp;
@@ -35,6 +36,8 @@ char *last_used_text;
 static short num_squigilly_brackets;
 static int32_t last_used_size;
 
+static uint8_t  *branchslots;
+
 static short g_i,g_p;
 static int32_t g_x;
 static int32_t *g_t;
@@ -1119,6 +1122,8 @@ uint8_t  parsecommand(int readfromGRP)
             parsecommand(readfromGRP);
 
             *tempscrptr = (int32_t) scriptptr;
+            i = tempscrptr-script;
+            branchslots[i>>3] |= (1<<(i&7));
 
             checking_ifelse++;
             return 0;
@@ -1515,6 +1520,41 @@ void passone(int readfromGRP)
 
 }
 
+// Resolve the fail targets of every compiled if once the whole script is
+// known. An if that fails onto an "else" is pointed straight past the else
+// header, so a false test falls through to the else statement without the
+// parseifelse() re-dispatch. Only the slot values change, so the script
+// layout (and the save game format built on it) stays the same.
+int32_t linkbranches(void)
+{
+    int32_t i, n, *target;
+
+    n = 0;
+    for(i=1;i<(scriptptr-script);i++)
+    {
+        if( (branchslots[i>>3]&(1<<(i&7))) == 0 ) continue;
+
+        target = (int32_t *) script[i];
+        if( *target != 10 ) continue;
+
+        // A terminator as the else statement would end the enclosing block
+        // instead of being swallowed by parseifelse(). Leave those alone.
+        switch( *(target+2) )
+        {
+            case 4:
+            case 12:
+            case 18:
+            case 30:
+                continue;
+        }
+
+        script[i] = (int32_t) (target+2);
+        n++;
+    }
+
+    return n;
+}
+
 char  *defaultcons[3] =
 {
      "GAME.CON",
@@ -1597,6 +1637,11 @@ void loadefs(char  *filenam, char  *mptr, int readfromGRP)
     clearbuf(actorscrptr,MAXSPRITES,0L);
     clearbufbyte(actortype,MAXSPRITES,0L);
 
+    // Borrow wall[] for the branch slot bitmap, the same way compilecons()
+    // borrows sector[] and sprite[] for the labels.
+    branchslots = (uint8_t  *)&wall[0];
+    clearbufbyte(branchslots,(MAXSCRIPTSIZE+7)>>3,0L);
+
     labelcnt = 0;
     scriptptr = script+1;
     warning = 0;
@@ -1618,6 +1663,7 @@ void loadefs(char  *filenam, char  *mptr, int readfromGRP)
     {
         total_lines += line_number;
         printf("Code Size:%d bytes(%d labels).\n",(int32_t)((scriptptr-script)<<2)-4,labelcnt);
+        printf("Linked %d else branches.\n",linkbranches());
 		ud.conSize[0] = (int32_t)(scriptptr-script)-1;
 
 		// FIX_00062: Better support and identification for GRP and CON files for 1.3/1.3d/1.4/1.5
@@ -1717,8 +1763,9 @@ uint8_t  dodge(spritetype *s)
 
 short furthestangle(short i,short angs)
 {
-    short j, hitsect,hitwall,hitspr,furthest_angle, angincs;
-    int32_t hx, hy, hz, d, greatestd;
+    short j, k, n, furthest_angle, angincs;
+    int32_t d, greatestd;
+    hitscantype rays[MAXHITSCANRAYS];
     spritetype *s = &sprite[i];
 
     greatestd = -(1<<30);
@@ -1727,19 +1774,27 @@ short furthestangle(short i,short angs)
     if(s->picnum != APLAYER)
         if( (g_t[0]&63) > 2 ) return( s->ang + 1024 );
 
-    for(j=s->ang;j<(2048+s->ang);j+=angincs)
+    // All probes leave from the same spot, so trace them as one batch
+    for(j=s->ang;j<(2048+s->ang);j+=angincs*n)
     {
-        hitscan(s->x, s->y, s->z-(8<<8), s->sectnum,
-            sintable[(j+512)&2047],
-            sintable[j&2047],0,
-            &hitsect,&hitwall,&hitspr,&hx,&hy,&hz,CLIPMASK1);
+        for(n=0;n<MAXHITSCANRAYS && j+angincs*n<(2048+s->ang);n++)
+        {
+            rays[n].vx = sintable[(j+angincs*n+512)&2047];
+            rays[n].vy = sintable[(j+angincs*n)&2047];
+            rays[n].vz = 0;
+        }
 
-        d = klabs(hx-s->x) + klabs(hy-s->y);
+        hitscan_batch(s->x, s->y, s->z-(8<<8), s->sectnum, rays, n, CLIPMASK1);
 
-        if(d > greatestd)
+        for(k=0;k<n;k++)
         {
-            greatestd = d;
-            furthest_angle = j;
+            d = klabs(rays[k].hitx-s->x) + klabs(rays[k].hity-s->y);
+
+            if(d > greatestd)
+            {
+                greatestd = d;
+                furthest_angle = j+angincs*k;
+            }
         }
     }
     return (furthest_angle&2047);
@@ -2066,9 +2121,52 @@ void parseifelse(int32_t condition)
     }
 }
 
+// ifai/ifaction/ifmove are pure compares against the actor's current
+// ai/action/move and CON uses them in long "else" chains. Walk the chain here
+// instead of returning to the caller's parse() loop after every failed test.
+// Falling through onto the next compare is the same as the caller parsing it.
+void parseifchain(void)
+{
+    int32_t v;
+
+    while(1)
+    {
+        switch(*insptr)
+        {
+            case 21: v = g_t[5]; break;
+            case 34: v = g_t[4]; break;
+            case 41: v = g_t[1]; break;
+            default: return;
+        }
+
+        if( v == *(insptr+1) )
+        {
+            insptr += 3;
+            parse();
+            return;
+        }
+
+        insptr = (int32_t *) *(insptr+2);
+        if(*insptr == 10)
+        {
+            insptr += 2;
+            switch(*insptr)
+            {
+                case 21:
+                case 34:
+                case 41:
+                    break;
+                default:
+                    parse();
+                    return;
+            }
+        }
+    }
+}
+
 // int32_t *it = 0x00589a04;
 
-uint8_t  parse(void)
+HOT_CODE(parse) uint8_t  parse(void)
 {
     int32_t j, l, s;
 
@@ -2629,12 +2727,10 @@ uint8_t  parse(void)
             parseifelse( hittype[g_i].picnum == *insptr);
             break;
         case 21:
-            insptr++;
-            parseifelse(g_t[5] == *insptr);
+            parseifchain();
             break;
         case 34:
-            insptr++;
-            parseifelse(g_t[4] == *insptr);
+            parseifchain();
             break;
         case 35:
             insptr++;
@@ -2693,8 +2789,7 @@ uint8_t  parse(void)
             insptr++;
             break;
         case 41:
-            insptr++;
-            parseifelse(g_t[1] == *insptr);
+            parseifchain();
             break;
         case 42:
             insptr++;
@@ -3170,9 +3265,11 @@ void execute(short i,short p,int32_t x)
     }
 
 
+    actordebugExecutes++;
+
     if(g_t[4])
     {
-        g_sp->lotag += TICSPERFRAME;
+        g_sp->lotag += TICSPERFRAME+actorschedtics;
         if(g_sp->lotag > *(int32_t *)(g_t[4]+16) )
         {
             g_t[2]++;
@@ -36,10 +36,18 @@ Prepared for public release: 03/21/2003 - Charlie Wiederhold, 3D Realms
 #ifdef RP2350_PSRAM
 #include "psram_sections.h"
 #include "anim_streaming.h"
-// Use raw (uncompressed) file I/O for RP2350 to avoid cache/memory issues
-#define kdfread kdfread_raw
-#define dfwrite dfwrite_raw
+#include "psram_allocator.h"
+#include "cvar_defs.h"
+// Save games go through the streaming LZ codec once savlzwrite/savlzread has
+// opened a stream; before that (header, old saves) the calls are raw.
+#define kdfread kdfread_lz
+#define dfwrite dfwrite_lz
 #define dfread dfread_raw
+
+// Compact save format: "DSV2" magic and format version ahead of the old
+// header. Old raw saves start with BYTEVERSION and still load.
+#define SAVEMAGIC   0x32565344
+#define SAVEVERSION 1
 #endif
 
 static const char* TAG = "menues";
@@ -63,6 +71,160 @@ int keyMode = 0;
 static char savegame_scriptptrs[MAXSCRIPTSIZE] __psram_bss("savegame_scriptptrs");
 #endif
 
+#ifdef RP2350_PSRAM
+// Freshly loaded map records that walls, sectors and sprites are XORed
+// against in a save. Only alive while a save/load is in progress.
+static sectortype *savebasesector;
+static walltype *savebasewall;
+static spritetype *savebasesprite;
+
+static int32_t savebaseload(char *mapname)
+{
+    int32_t crc = -1;
+
+    if (mapname[0] == 0) return(-1);
+    savebasesector = psram_malloc(sizeof(sectortype)*MAXSECTORS);
+    savebasewall = psram_malloc(sizeof(walltype)*MAXWALLS);
+    savebasesprite = psram_malloc(sizeof(spritetype)*MAXSPRITES);
+    if (savebasesector && savebasewall && savebasesprite)
+        crc = loadboardbase(mapname, savebasesector, savebasewall, savebasesprite);
+    return(crc);
+}
+
+static void savebasefree(void)
+{
+    psram_free(savebasesector);
+    psram_free(savebasewall);
+    psram_free(savebasesprite);
+    savebasesector = NULL;
+    savebasewall = NULL;
+    savebasesprite = NULL;
+}
+
+// Save snapshots. A single-player save is serialised into a PSRAM image
+// and a load of the same slot is served from it. flushsavesnapshot() packs
+// the image to gameN.tmp a chunk at a time in the frame pacer's spare time,
+// then renames it over gameN.sav. The magic is written last, so a torn .tmp
+// never passes for a save.
+#define SNAPCHUNK 4096 // one LZ block
+
+static int8_t   snapspot = -1;   // slot whose image is in memory
+static uint8_t  snapdirty;       // image not on the card yet
+static uint8_t  snapoff;         // snapshot failed, save to the card
+static FILE     *snapfil;
+static int32_t  snappos;
+static uint32_t snapflushms, snapflushmax, snapflushsteps;
+
+static void abortsavesnapshotflush(void)
+{
+    char  fn[16];
+
+    if (snapfil == NULL) return;
+    savlzclose();
+    fclose(snapfil);
+    snapfil = NULL;
+    sprintf(fn, "game%d.tmp", snapspot);
+    remove(fn);
+}
+
+void flushsavesnapshot(int all)
+{
+    char  fn[16], tmpfn[16];
+    uint8_t *image;
+    int32_t len, n, bv, ok;
+    uint32_t t;
+
+    while (snapdirty && (all || framepacespare() > 0))
+    {
+        t = getticks();
+        image = savmemimage(&len);
+        sprintf(tmpfn, "game%d.tmp", snapspot);
+        sprintf(fn, "game%d.sav", snapspot);
+
+        if (snapfil == NULL)
+        {
+            if ((snapfil = fopen(tmpfn, "wb")) == NULL)
+            {
+                printf("flushsavesnapshot: cannot create %s!\n", tmpfn);
+                snapdirty = 0;
+                return;
+            }
+            if (savlzwrite(snapfil))
+            {
+                fclose(snapfil);
+                snapfil = NULL;
+                if (!all) return;
+                continue;
+            }
+            // Compact header without a delta base; the raw image already
+            // starts with BYTEVERSION and the player count.
+            bv = 0;
+            dfwrite_raw(&bv, 4, 1, snapfil);
+            bv = SAVEVERSION;
+            dfwrite_raw(&bv, 4, 1, snapfil);
+            dfwrite_raw(image, 4+sizeof(ud.multimode), 1, snapfil);
+            memset(tempbuf, 0, 128);
+            dfwrite_raw(tempbuf, 128, 1, snapfil);
+            bv = -1;
+            dfwrite_raw(&bv, 4, 1, snapfil);
+            snappos = 4+sizeof(ud.multimode);
+            snapflushms = snapflushmax = snapflushsteps = 0;
+        }
+
+        n = min(SNAPCHUNK, len-snappos);
+        dfwritedelta(image+snappos, NULL, n, snapfil);
+        snappos += n;
+
+        if (snappos == len)
+        {
+            ok = (savlzclose() >= 0);
+            bv = SAVEMAGIC;
+            ok = ok && fseek(snapfil, 0, SEEK_SET) == 0 && fwrite(&bv, 4, 1, snapfil) == 1;
+            fclose(snapfil);
+            snapfil = NULL;
+            if (ok)
+            {
+                remove(fn);
+                ok = (rename(tmpfn, fn) == 0);
+            }
+            if (!ok)
+            {
+                remove(tmpfn);
+                printf("flushsavesnapshot: could not write %s!\n", fn);
+            }
+            snapdirty = 0;
+        }
+
+        t = getticks()-t;
+        snapflushms += t;
+        snapflushmax = max(snapflushmax, t);
+        snapflushsteps++;
+        if (!snapdirty)
+            printf("flushsavesnapshot: %s in %u steps, %u ms total, %u ms max step\n",
+                   fn, snapflushsteps, snapflushms, snapflushmax);
+    }
+}
+
+// Frame pacer idle hook, see framepaceidle
+void idlesavesnapshot(void)
+{
+    flushsavesnapshot(0);
+}
+
+// Finds the .tmp of a flush that lost power between remove and rename.
+static int32_t opensavefile(char *fn)
+{
+    int32_t fil;
+    char  tmpfn[16];
+
+    if ((fil = TCkopen4load(fn,0)) != -1) return(fil);
+    strcpy(tmpfn, fn);
+    strcpy(strrchr(tmpfn, '.'), ".tmp");
+    if (rename(tmpfn, fn) == 0) fil = TCkopen4load(fn,0);
+    return(fil);
+}
+#endif
+
 // File tree info
 //
 //uint8_t  szCurrentDirectory[1024] = {'\0'};
@@ -204,14 +366,31 @@ int loadpheader(uint8_t  spot,int32 *vn,int32 *ln,int32 *psk,int32 *nump)
     char  fn[] = "game0.sav";
     int32_t fil;
     int32_t bv;
+#ifdef RP2350_PSRAM
+    uint8_t newformat;
+#endif
 
          fn[4] = spot+'0';
 
+#ifdef RP2350_PSRAM
+     flushsavesnapshot(1);
+     if ((fil = opensavefile(fn)) == -1) return(-1);
+#else
      if ((fil = TCkopen4load(fn,0)) == -1) return(-1);
+#endif
 
      tiles[MAXTILES-3].lock = 255;
 
      kdfread(&bv,4,1,fil);
+#ifdef RP2350_PSRAM
+     newformat = (bv == SAVEMAGIC);
+     if(newformat)
+     {
+        kdfread(&bv,4,1,fil);
+        if(bv == SAVEVERSION) kdfread(&bv,4,1,fil);
+        else bv = -1;
+     }
+#endif
      if(bv != BYTEVERSION)
      {
         FTA(114,&ps[myconnectindex],1);
@@ -220,6 +399,13 @@ int loadpheader(uint8_t  spot,int32 *vn,int32 *ln,int32 *psk,int32 *nump)
      }
 
      kdfread(nump,sizeof(int32),1,fil);
+#ifdef RP2350_PSRAM
+     if(newformat)
+     {
+        kdfread(tempbuf,128+4,1,fil); // delta base map name and CRC
+        if(savlzread(fil)) { kclose(fil); return(-1); }
+     }
+#endif
 
      kdfread(tempbuf,19,1,fil);
          kdfread(vn,sizeof(int32),1,fil);
@@ -231,6 +417,9 @@ int loadpheader(uint8_t  spot,int32 *vn,int32 *ln,int32 *psk,int32 *nump)
     tiles[MAXTILES-3].dim.width = 100;
     tiles[MAXTILES-3].dim.height = 160;
     kdfread(tiles[MAXTILES-3].data,160,100,fil);
+#ifdef RP2350_PSRAM
+    if(newformat) savlzclose();
+#endif
     kclose(fil);
     return(0);
 }
@@ -248,6 +437,12 @@ int loadplayer(int8_t spot)
 #endif
      int32_t fil, bv, i, j, x;
      int32 nump;
+#ifdef RP2350_PSRAM
+     char  mapname[128];
+     int32_t basecrc;
+     uint32_t t = getticks();
+     uint8_t newformat, snapshot;
+#endif
 
      if(spot < 0)
      {
@@ -275,17 +470,41 @@ int loadplayer(int8_t spot)
         fn[4] = spot + '0';
      }
 
+#ifdef RP2350_PSRAM
+     abortsavesnapshotflush();
+     snapshot = (fnptr == fn && spot == snapspot && g_CV_SaveSnapshot && savmemread() == 0);
+     if (snapshot) fil = -1;
+     else
+     {
+        // The card copy of this slot is older than a pending image
+        if (fnptr == fn && spot == snapspot) flushsavesnapshot(1);
+        if ((fil = opensavefile(fnptr)) == -1) return(-1);
+     }
+#else
      if ((fil = TCkopen4load(fnptr,0)) == -1) return(-1);
+#endif
 
 	 if(ud.recstat != 2)
 		ready2send = 0;
 
      kdfread(&bv,4,1,fil);
+#ifdef RP2350_PSRAM
+     newformat = (bv == SAVEMAGIC);
+     if(newformat)
+     {
+        kdfread(&bv,4,1,fil);
+        if(bv == SAVEVERSION) kdfread(&bv,4,1,fil);
+        else bv = -1;
+     }
+#endif
      printf("loadplayer: read BYTEVERSION=%d, expected=%d\n", bv, BYTEVERSION);
      if(bv != BYTEVERSION)
      {
         printf("loadplayer: BYTEVERSION mismatch!\n");
         FTA(114,&ps[myconnectindex],1);
+#ifdef RP2350_PSRAM
+        if(snapshot) savlzclose();
+#endif
         kclose(fil);
 		if(ud.recstat != 2)
 		{	
@@ -301,6 +520,9 @@ int loadplayer(int8_t spot)
      if(nump != numplayers)
      {
         printf("loadplayer: numplayers mismatch!\n");
+#ifdef RP2350_PSRAM
+        if(snapshot) savlzclose();
+#endif
         kclose(fil);
 		if(ud.recstat != 2)
 		{
@@ -312,6 +534,28 @@ int loadplayer(int8_t spot)
         return 1;
      }
 
+#ifdef RP2350_PSRAM
+     if(newformat)
+     {
+        kdfread(mapname,sizeof(mapname),1,fil);
+        kdfread(&basecrc,4,1,fil);
+        mapname[sizeof(mapname)-1] = 0;
+        if((basecrc != -1 && savebaseload(mapname) != basecrc) || savlzread(fil))
+        {
+            printf("loadplayer: base map %s missing or changed!\n", mapname);
+            savebasefree();
+            FTA(114,&ps[myconnectindex],1);
+            kclose(fil);
+            if(ud.recstat != 2)
+            {
+                ototalclock = totalclock;
+                ready2send = 1;
+            }
+            return 1;
+        }
+     }
+#endif
+
      if(numplayers > 1)
      {
          pub = NUMPAGES;
@@ -355,10 +599,17 @@ int loadplayer(int8_t spot)
      kdfread(tiles[MAXTILES-3].data,160,100,fil);
 
          kdfread(&numwalls,2,1,fil);
+#ifdef RP2350_PSRAM
+     kdfreaddelta(&wall[0],savebasewall,sizeof(walltype)*MAXWALLS,fil);
+         kdfread(&numsectors,2,1,fil);
+     kdfreaddelta(&sector[0],savebasesector,sizeof(sectortype)*MAXSECTORS,fil);
+         kdfreaddelta(&sprite[0],savebasesprite,sizeof(spritetype)*MAXSPRITES,fil);
+#else
      kdfread(&wall[0],sizeof(walltype),MAXWALLS,fil);
          kdfread(&numsectors,2,1,fil);
      kdfread(&sector[0],sizeof(sectortype),MAXSECTORS,fil);
          kdfread(&sprite[0],sizeof(spritetype),MAXSPRITES,fil);
+#endif
          kdfread(&headspritesect[0],2,MAXSECTORS+1,fil);
          kdfread(&prevspritesect[0],2,MAXSPRITES,fil);
          kdfread(&nextspritesect[0],2,MAXSPRITES,fil);
@@ -462,6 +713,16 @@ int loadplayer(int8_t spot)
      kdfread(&global_random,sizeof(global_random),1,fil);
      kdfread(&parallaxyscale,sizeof(parallaxyscale),1,fil);
 
+#ifdef RP2350_PSRAM
+     if(newformat || snapshot)
+     {
+        if(savlzclose() < 0) printf("loadplayer: save stream is damaged!\n");
+        savebasefree();
+        if(newformat) strcpy(loadedboardname, mapname);
+     }
+     printf("loadplayer: %s save loaded in %u ms\n",
+            snapshot ? "snapshot" : newformat ? "compact" : "raw", getticks()-t);
+#endif
      kclose(fil);
      printf("loadplayer: file closed, restoring game state\n");
 
@@ -528,6 +789,10 @@ int loadplayer(int8_t spot)
          }
      }
 
+     resetcanseecache();
+     resetzrangecache();
+     flushspritehash();
+
      numinterpolations = 0;
      startofdynamicinterpolations = 0;
 
@@ -573,6 +838,8 @@ int loadplayer(int8_t spot)
      show_shareware = 0;
      everyothertime = 0;
 
+     resetactorsched(-1);
+
      clearbufbyte(playerquitflag,MAXPLAYERS,0x01010101);
 
      resetmys();
@@ -601,6 +868,12 @@ int saveplayer(int8_t spot)
          FILE *fil;
      int32_t bv = BYTEVERSION;
 	 char  fullpathsavefilename[16];
+#ifdef RP2350_PSRAM
+     char  mapname[128];
+     int32_t basecrc;
+     uint32_t t = getticks();
+     uint8_t newformat, snapshot;
+#endif
 
      printf("saveplayer: spot=%d\n", spot);
 
@@ -652,17 +925,89 @@ int saveplayer(int8_t spot)
 	}
 #endif
 
+#ifdef RP2350_PSRAM
+     // Single player saves go to a PSRAM snapshot first. The new image
+     // replaces any pending one; a slot whose flush had not finished keeps
+     // the save it has on the card.
+     snapshot = (fnptr == fn && ud.multimode < 2 && g_CV_SaveSnapshot && !snapoff);
+     if (snapshot)
+     {
+        if (snapdirty && spot != snapspot)
+            printf("saveplayer: pending save of slot %d dropped\n", snapspot);
+        abortsavesnapshotflush();
+        snapdirty = 0;
+        snapspot = -1;
+        fil = NULL;
+     }
+     else
+     {
+        // A pending image of this slot is older than this save and must not
+        // land on top of it; one of another slot is flushed first.
+        if (fnptr == fn && spot == snapspot)
+        {
+            abortsavesnapshotflush();
+            snapdirty = 0;
+            snapspot = -1;
+        }
+        else flushsavesnapshot(1);
+#endif
      printf("saveplayer: opening %s\n", fullpathsavefilename);
      if ((fil = fopen(fullpathsavefilename,"wb")) == 0) {
          printf("saveplayer: fopen failed!\n");
          return(-1);
      }
+#ifdef RP2350_PSRAM
+     }
+#endif
      printf("saveplayer: file opened, writing...\n");
 
      ready2send = 0;
 
+#ifdef RP2350_PSRAM
+     newformat = 0;
+     if(snapshot)
+     {
+        // Raw layout in memory; it is packed when flushed to the card
+        savmemwrite();
+        dfwrite(&bv,4,1,fil);
+        dfwrite(&ud.multimode,sizeof(ud.multimode),1,fil);
+     }
+     else
+     {
+     // Walls, sectors and sprites are stored as XOR deltas against the map
+     // file this level was loaded from; its CRC is checked on load.
+     strcpy(mapname, loadedboardname);
+     basecrc = savebaseload(mapname);
+     if(basecrc == -1)
+     {
+        savebasefree();
+        mapname[0] = 0;
+     }
+     newformat = (savlzwrite(fil) == 0);
+     if(newformat)
+     {
+        bv = SAVEMAGIC;
+        dfwrite_raw(&bv,4,1,fil);
+        bv = SAVEVERSION;
+        dfwrite_raw(&bv,4,1,fil);
+        bv = BYTEVERSION;
+        dfwrite_raw(&bv,4,1,fil);
+        dfwrite_raw(&ud.multimode,sizeof(ud.multimode),1,fil);
+        dfwrite_raw(mapname,sizeof(mapname),1,fil);
+        dfwrite_raw(&basecrc,4,1,fil);
+     }
+     else
+     {
+        // No memory for the codec: fall back to the old raw format
+        savebasefree();
+        dfwrite(&bv,4,1,fil);
+        dfwrite(&ud.multimode,sizeof(ud.multimode),1,fil);
+     }
+     }
+#else
      dfwrite(&bv,4,1,fil);
      dfwrite(&ud.multimode,sizeof(ud.multimode),1,fil);
+#endif
 
          dfwrite(&ud.savegame[spot][0],19,1,fil);
          dfwrite(&ud.volume_number,sizeof(ud.volume_number),1,fil);
@@ -671,10 +1016,17 @@ int saveplayer(int8_t spot)
      dfwrite(tiles[MAXTILES-1].data,160,100,fil);
 
          dfwrite(&numwalls,2,1,fil);
+#ifdef RP2350_PSRAM
+     dfwritedelta(&wall[0],savebasewall,sizeof(walltype)*MAXWALLS,fil);
+         dfwrite(&numsectors,2,1,fil);
+     dfwritedelta(&sector[0],savebasesector,sizeof(sectortype)*MAXSECTORS,fil);
+         dfwritedelta(&sprite[0],savebasesprite,sizeof(spritetype)*MAXSPRITES,fil);
+#else
      dfwrite(&wall[0],sizeof(walltype),MAXWALLS,fil);
          dfwrite(&numsectors,2,1,fil);
      dfwrite(&sector[0],sizeof(sectortype),MAXSECTORS,fil);
          dfwrite(&sprite[0],sizeof(spritetype),MAXSPRITES,fil);
+#endif
          dfwrite(&headspritesect[0],2,MAXSECTORS+1,fil);
          dfwrite(&prevspritesect[0],2,MAXSPRITES,fil);
          dfwrite(&nextspritesect[0],2,MAXSPRITES,fil);
@@ -816,9 +1168,39 @@ int saveplayer(int8_t spot)
      dfwrite(&global_random,sizeof(global_random),1,fil);
      dfwrite(&parallaxyscale,sizeof(parallaxyscale),1,fil);
 
+#ifdef RP2350_PSRAM
+     if(snapshot)
+     {
+        if(savlzclose() < 0)
+        {
+            printf("saveplayer: no memory for a snapshot, saving to the card\n");
+            snapoff = 1;
+            i = saveplayer(spot);
+            snapoff = 0;
+            return(i);
+        }
+        snapspot = spot;
+        snapdirty = 1;
+        printf("saveplayer: snapshot, game blocked %u ms\n", getticks()-t);
+     }
+     else
+     {
+        if(newformat)
+        {
+            if(savlzclose() < 0) printf("saveplayer: write error!\n");
+            savebasefree();
+        }
+        printf("saveplayer: %s save, %ld bytes in %u ms\n", newformat ? "compact" : "raw",
+               (long)ftell(fil), getticks()-t);
+        printf("saveplayer: closing file\n");
+        fclose(fil);
+        printf("saveplayer: file closed\n");
+     }
+#else
      printf("saveplayer: closing file\n");
          fclose(fil);
      printf("saveplayer: file closed\n");
+#endif
 
      if(ud.multimode < 2)
      {
@@ -4677,7 +5059,8 @@ void playanm(char  *fn,uint8_t  t)
     /* Use streaming animation player on RP2350 */
     
     uint8_t *palptr;
-    int32_t i, j, k, numframes=0;
+    int32_t i, j, k, numframes=0, skipped=0;
+    bool direct;
 
     if(t != 7 && t != 9 && t != 10 && t != 11)
         KB_FlushKeyboardQueue();
@@ -4712,6 +5095,10 @@ void playanm(char  *fn,uint8_t  t)
     }
     VBE_setPalette(tempbuf);
 
+    // Full-screen clips decode straight into the frame; the PSRAM image and
+    // rotatesprite are only used when the screen does not fit.
+    direct = AnimStream_SetDirectOutput(frameplace, bytesperline, xdim, ydim);
+
     ototalclock = totalclock + 10;
 
     for(i=1;i<numframes;i++)
@@ -4721,6 +5108,7 @@ void playanm(char  *fn,uint8_t  t)
           if( KB_KeyWaiting() )
               goto ENDOFANIMLOOP_STREAM;
           getpackets();
+          AnimStream_Prefetch();
        }
 
        if(t == 10) ototalclock += 14;
@@ -4733,9 +5121,19 @@ void playanm(char  *fn,uint8_t  t)
        else if(ud.volume_number == 1) ototalclock += 18;
        else                           ototalclock += 10;
 
+       // Frames are deltas, so every one is decoded, but one that is
+       // already past its slot is not shown (at most 2 in a row) to keep
+       // the clip on the timer.
        tiles[MAXTILES-3-t].data = AnimStream_DrawFrame(i);
-       rotatesprite(0<<16,0<<16,65536L,512,MAXTILES-3-t,0,0,2+4+8+16+64, 0,0,xdim-1,ydim-1);
-       nextpage();
+       if(totalclock >= ototalclock && skipped < 2)
+           skipped++;
+       else
+       {
+           skipped = 0;
+           if(!direct)
+               rotatesprite(0<<16,0<<16,65536L,512,MAXTILES-3-t,0,0,2+4+8+16+64, 0,0,xdim-1,ydim-1);
+           nextpage();
+       }
 
        if(t == 8) endanimvol41(i);
        else if(t == 10) endanimvol42(i);
@@ -1796,7 +1796,6 @@ void getinput(short snum)
     short j, daang;
 // MED
     ControlInfo info;
-    int32 tics;
     boolean running;
     int32 turnamount;
     int32 keymove;
@@ -1812,6 +1811,7 @@ void getinput(short snum)
     p = &ps[snum];
 
     CONTROL_GetInput( &info );
+    CONTROL_SampleKeys();
 
 	// FIX_00021: Duke was moving when moving the mouse up/down. Y axis move is disabled.
 	info.dz = 0; // remove y axis
@@ -1827,7 +1827,6 @@ void getinput(short snum)
          return;
     }
 
-    tics = totalclock-lastcontroltime;
     lastcontroltime = totalclock;
 
 
@@ -2040,7 +2039,7 @@ void getinput(short snum)
     {
         if ( ACTION(gamefunc_Turn_Left))
            {
-           turnheldtime += tics;
+           turnheldtime += CONTROL_ActionHeldTics(gamefunc_Turn_Left,TICRATE);
            if (turnheldtime>=TURBOTURNTIME)
               {
               angvel -= turnamount;
@@ -2052,7 +2051,7 @@ void getinput(short snum)
            }
         else if ( ACTION(gamefunc_Turn_Right))
            {
-           turnheldtime += tics;
+           turnheldtime += CONTROL_ActionHeldTics(gamefunc_Turn_Right,TICRATE);
            if (turnheldtime>=TURBOTURNTIME)
               {
               angvel += turnamount;
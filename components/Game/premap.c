@@ -250,9 +250,7 @@ uint8_t  getsound(uint16_t num)
         ( l < 12288 ) )
     {
         Sound[num].lock = 2;
-        allocache(&Sound[num].ptr,l,&Sound[num].lock);
-        if(Sound[num].ptr != NULL)
-            kread( fp, Sound[num].ptr , l);
+        readsound(num,fp,l);
     }
     kclose( fp );
     return 1;
@@ -1461,6 +1459,8 @@ void enterlevel(uint8_t  g)
     char text[512];
 
 	KB_ClearKeyDown(sc_Pause); // avoid entering in pause mode.
+
+    resetactorsched(-1);
 	
     if( (g&MODE_DEMO) != MODE_DEMO ) ud.recstat = ud.m_recstat;
     ud.respawn_monsters = ud.m_respawn_monsters;
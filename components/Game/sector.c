@@ -332,6 +332,10 @@ void doanimations(void)
         }
 
 		*animateptr[i] = a;
+
+        // Sliding doors animate wall points in place
+        if( (uint8_t *)animateptr[i] >= (uint8_t *)wall && (uint8_t *)animateptr[i] < (uint8_t *)&wall[numwalls] )
+            markwallmoved((short)(((uint8_t *)animateptr[i]-(uint8_t *)wall)/sizeof(walltype)));
 	}
 }
 
@@ -1571,6 +1575,7 @@ void checkhitwall(short spr,short dawallnum,int32_t x,int32_t y,int32_t z,short
    
 
     wal = &wall[dawallnum];
+    flushcanseecache();
 
     if(wal->overpicnum == MIRROR)
     {
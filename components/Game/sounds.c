@@ -35,12 +35,54 @@ Prepared for public release: 03/21/2003 - Charlie Wiederhold, 3D Realms
 #include "duke3d.h"
 #include "global.h"
 #include "filesystem.h"
+#include "psram_allocator.h"
+#include "cvar_defs.h"
 
 
 #define LOUDESTVOLUME 150
 
+// Size of the PSRAM file buffer sounds are read through for transcoding
+#define SOUNDFILEBUFSIZ (256*1024)
+
+// Sounds at least this large are played from their file instead of being
+// cached; SOUNDSTREAMHEAD bytes are read to find where the samples start
+#ifndef SOUNDSTREAMSIZ
+#define SOUNDSTREAMSIZ (32*1024)
+#endif
+#define SOUNDSTREAMHEAD 512
+
+// pan3dsound() calls between cansee() refreshes of an instance that stays
+// in the same listener and source sectors
+#define SOUNDOCCLUSIONAGE 4
+
 int32_t backflag,numenvsnds;
 
+// Sounds with at least one playing instance, in the order they started.
+// Linked by xyzsound() and unlinked by TestCallBack() when Sound[].num
+// drops to 0, so pan3dsound() does not scan all NUM_SOUNDS every frame.
+static short soundactivehead = -1;
+static short soundactiveprev[NUM_SOUNDS], soundactivenext[NUM_SOUNDS];
+static uint8_t soundactive[NUM_SOUNDS];
+
+static void linkactivesound(short num)
+{
+    if(soundactive[num]) return;
+    soundactive[num] = 1;
+    soundactiveprev[num] = -1;
+    soundactivenext[num] = soundactivehead;
+    if(soundactivehead >= 0) soundactiveprev[soundactivehead] = num;
+    soundactivehead = num;
+}
+
+static void unlinkactivesound(short num)
+{
+    if(!soundactive[num]) return;
+    soundactive[num] = 0;
+    if(soundactiveprev[num] >= 0) soundactivenext[soundactiveprev[num]] = soundactivenext[num];
+    else soundactivehead = soundactivenext[num];
+    if(soundactivenext[num] >= 0) soundactiveprev[soundactivenext[num]] = soundactiveprev[num];
+}
+
 /*
 ===================
 =
@@ -264,6 +306,61 @@ void playmusic(char  *fn)
     PlayMusic(fn);
 }
 
+/*
+ * Read an open sound file into the cache at Sound[num].ptr, with
+ *  Sound[num].lock already set by the caller. VOC and WAV files are cached
+ *  converted to the mixer's own format (FX_Transcode), so playing them
+ *  again skips header parsing and sample conversion. Sounds of
+ *  SOUNDSTREAMSIZ bytes or more only get a small stream header
+ *  (FX_StreamHeader) and play from the file, so long voice lines and
+ *  loops do not evict tiles. Anything else, or anything larger than the
+ *  file buffer, is cached as it is.
+ */
+void readsound(uint16_t num, int32_t fp, int32_t l)
+{
+    uint8_t  *raw = NULL;
+    uint32_t t = 0, h;
+
+    if (l >= SOUNDSTREAMSIZ)
+    {
+        h = SOUNDSTREAMHEAD;
+        raw = (uint8_t  *)psram_get_file_buffer(h);
+        if (raw != NULL && kread( fp, raw, h) == (int32_t)h &&
+            (t = FX_StreamHeaderSize(raw,h,l)) > 0)
+        {
+            allocache(&Sound[num].ptr,t,(uint8_t  *)&Sound[num].lock);
+            if (Sound[num].ptr != NULL)
+                FX_StreamHeader(raw,h,l,sounds[num],Sound[num].ptr);
+            return;
+        }
+        klseek( fp, 0, SEEK_SET);
+        raw = NULL;
+    }
+
+    if (l <= SOUNDFILEBUFSIZ)
+        raw = (uint8_t  *)psram_get_file_buffer(l);
+    if (raw != NULL)
+    {
+        kread( fp, raw, l);
+        t = FX_TranscodedSize(raw,l);
+    }
+
+    if (t > 0)
+    {
+        allocache(&Sound[num].ptr,t,(uint8_t  *)&Sound[num].lock);
+        if (Sound[num].ptr != NULL)
+            FX_Transcode(raw,l,Sound[num].ptr);
+        return;
+    }
+
+    allocache(&Sound[num].ptr,l,(uint8_t  *)&Sound[num].lock);
+    if (Sound[num].ptr == NULL)
+        return;
+    if (raw != NULL)
+        memcpy(Sound[num].ptr,raw,l);
+    else kread( fp, Sound[num].ptr , l);
+}
+
 uint8_t  loadsound(uint16_t num)
 {
     int32_t   fp, l;
@@ -284,8 +381,7 @@ uint8_t  loadsound(uint16_t num)
 
     Sound[num].lock = 200;
 
-    allocache(&Sound[num].ptr,l,(uint8_t  *)&Sound[num].lock);
-    kread( fp, Sound[num].ptr , l);
+    readsound(num,fp,l);
     kclose( fp );
     return 1;
 }
@@ -316,8 +412,7 @@ int xyzsound(short num,short i,int32_t x,int32_t y,int32_t z)
 		// FIX_00041: Toggle to hear the opponent sound in DM (like it used to be in v1.3d)
 		if(VoiceToggle==0 || (ud.multimode > 1 && PN == APLAYER && sprite[i].yvel != screenpeek && /*ud.coop!=1 &&*/ !OpponentSoundToggle) ) return -1; //xduke : 1.3d Style: makes opponent sound in DM as in COOP
 
-        for(j=0;j<NUM_SOUNDS;j++)
-          for(k=0;k<Sound[j].num;k++)
+        for(j=soundactivehead;j>=0;j=soundactivenext[j])
             if( (Sound[j].num > 0) && (soundm[j]&4) )
               return -1;
     }
@@ -432,7 +527,9 @@ int xyzsound(short num,short i,int32_t x,int32_t y,int32_t z)
     {
         SoundOwner[num][Sound[num].num].i = i;
         SoundOwner[num][Sound[num].num].voice = voice;
+        SoundOwner[num][Sound[num].num].occlage = 0;
         Sound[num].num++;
+        linkactivesound(num);
     }
     else Sound[num].lock--;
     return (voice);
@@ -531,7 +628,9 @@ void stopenvsound(short num,short i)
 void pan3dsound(void)
 {
     int32_t sndist, sx, sy, sz, cx, cy, cz;
-    short sndang,ca,j,k,i,cs;
+    short sndang,ca,j,k,i,cs,nextj;
+    SOUNDOWNER *so;
+    uint32_t instances = 0, occlusions = 0;
 
     numenvsnds = 0;
 
@@ -552,9 +651,12 @@ void pan3dsound(void)
         ca = sprite[ud.camerasprite].ang;
     }
 
-    for(j=0;j<NUM_SOUNDS;j++) for(k=0;k<Sound[j].num;k++)
+    // stopsound(j) below can unlink j, so step past it first
+    for(j=soundactivehead;j>=0;j=nextj) for(nextj=soundactivenext[j],k=0;k<Sound[j].num;k++)
     {
-        i = SoundOwner[j][k].i;
+        so = &SoundOwner[j][k];
+        i = so->i;
+        instances++;
 
         sx = sprite[i].x;
         sy = sprite[i].y;
@@ -577,8 +679,25 @@ void pan3dsound(void)
         sndist += soundvo[j];
         if(sndist < 0) sndist = 0;
 
-        if( sndist && PN != MUSICANDSFX && !cansee(cx,cy,cz-(24<<8),cs,sx,sy,sz-(24<<8),SECT) )
-            sndist += sndist>>5;
+        // Occlusion only shades the volume by 1/32, so the cansee() result
+        // is kept while neither end changes sector. It is always redone
+        // when it decides whether the sound is cut off below.
+        if( sndist && PN != MUSICANDSFX )
+        {
+            if( so->occlage == 0 || so->occlcs != cs || so->occlsect != SECT ||
+                ( sndist <= 31444 && sndist+(sndist>>5) > 31444 ) )
+            {
+                so->occluded = !cansee(cx,cy,cz-(24<<8),cs,sx,sy,sz-(24<<8),SECT);
+                so->occlcs = cs;
+                so->occlsect = SECT;
+                so->occlage = SOUNDOCCLUSIONAGE;
+                occlusions++;
+            }
+            else so->occlage--;
+
+            if( so->occluded )
+                sndist += sndist>>5;
+        }
 
         if(PN == MUSICANDSFX && SLT < 999)
             numenvsnds++;
@@ -604,8 +723,11 @@ void pan3dsound(void)
         if(sndist < ((255-LOUDESTVOLUME)<<6) )
             sndist = ((255-LOUDESTVOLUME)<<6);
 
-        FX_Pan3D(SoundOwner[j][k].voice,sndang>>6,sndist>>6);
+        FX_Pan3D(so->voice,sndang>>6,sndist>>6);
     }
+
+    sounddebugPan3DInstances = instances;
+    sounddebugPan3DOcclusions = occlusions;
 }
 
 void TestCallBack(int32_t num)
@@ -634,6 +756,7 @@ void TestCallBack(int32_t num)
             printf("TestCallBack: Sound[%d].num=%d out of range\n", num, tempk);
             tempk = 0;
             Sound[num].num = 0;
+            unlinkactivesound(num);
         }
 
         if(tempk > 0)
@@ -652,8 +775,7 @@ void TestCallBack(int32_t num)
                         hittype[tempi].temp_data[0] = 0;
                     if( (tempj + 1) < tempk )
                     {
-                        SoundOwner[num][tempj].voice = SoundOwner[num][tempk-1].voice;
-                        SoundOwner[num][tempj].i     = SoundOwner[num][tempk-1].i;
+                        SoundOwner[num][tempj] = SoundOwner[num][tempk-1];
                     }
                     break;
                 }
@@ -662,6 +784,8 @@ void TestCallBack(int32_t num)
             Sound[num].num--;
             if(tempk-1 >= 0 && tempk-1 < 4)
                 SoundOwner[num][tempk-1].i = -1;
+            if(Sound[num].num == 0)
+                unlinkactivesound(num);
         }
 
         Sound[num].lock--;
@@ -126,6 +126,12 @@ int FX_PlayRaw( uint8_t  *ptr, uint32_t length, uint32_t rate,
 int FX_PlayLoopedRaw( uint8_t *ptr, uint32_t length, char *loopstart,
        char *loopend, uint32_t rate, int32_t pitchoffset, int32_t vol, int32_t left,
        int32_t right, int32_t priority, uint32_t callbackval );
+uint32_t FX_TranscodedSize( uint8_t *ptr, uint32_t length );
+int FX_Transcode( uint8_t *ptr, uint32_t length, uint8_t *out );
+uint32_t FX_StreamHeaderSize( uint8_t *head, uint32_t headlen, uint32_t filelength );
+int FX_StreamHeader( uint8_t *head, uint32_t headlen, uint32_t filelength,
+       char *name, uint8_t *out );
+void FX_StreamStats( uint32_t *playing, uint32_t *bytes, uint32_t *underruns );
 int32_t FX_Pan3D( int handle, int angle, int distance );
 int32_t FX_SoundActive( int32_t handle );
 int32_t FX_SoundsPlaying( void );
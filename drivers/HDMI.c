@@ -9,6 +9,8 @@
 #include "pico/multicore.h"
 #include "hardware/clocks.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "psram_allocator.h"
 
 // Globals expected by the driver
 int graphics_buffer_width = 320;
@@ -68,8 +70,20 @@ int get_video_mode() {
     return 0;
 }
 
+static volatile uint32_t vsync_count = 0;
+static volatile uint32_t vsync_time = 0;
+
 void vsync_handler() {
-    // Optional: Add vsync callback if needed
+    vsync_count++;
+    vsync_time = time_us_32();
+}
+
+uint32_t graphics_get_vsync_count(void) {
+    return vsync_count;
+}
+
+uint32_t graphics_get_vsync_time(void) {
+    return vsync_time;
 }
 
 // --- New HDMI Driver Code ---
@@ -116,6 +130,37 @@ alignas(4096) uint32_t conv_color[1224];
 //индекс, проверяющий зависание
 static uint32_t irq_inx = 0;
 
+// Palette state cache. Every full palette the game submits (brightness
+// levels, damage/pickup tints) is encoded once into TMDS words and kept in
+// PSRAM keyed by a hash of its 256 colours. New states are encoded on core 1;
+// core 0 copies a ready state into conv_stage and the DMA handler swaps it
+// into conv_color at vblank, when only the sync entries are on the wire.
+#define PAL_CACHE_STATES 16
+
+enum { PAL_EMPTY = 0, PAL_ENCODING, PAL_READY };
+
+typedef struct {
+    uint32_t colors[256];
+    uint64_t words[256 * 2];
+    uint8_t substitute[4];
+} pal_state_t;
+
+typedef struct {
+    uint32_t key;
+    uint32_t used;
+    volatile uint8_t status;
+} pal_meta_t;
+
+static pal_state_t* pal_states = NULL;
+static pal_meta_t pal_meta[PAL_CACHE_STATES];
+static uint32_t pal_clock = 0;
+static int pal_want = -1;  // state the game asked for last
+static int pal_shown = -1; // state copied to conv_stage
+
+static uint64_t conv_stage[256 * 2];
+static uint8_t stage_substitute[4];
+static volatile bool pal_flip_pending = false;
+
 //функции и константы HDMI
 
 #define BASE_HDMI_CTRL_INX (240)
@@ -213,6 +258,80 @@ static uint tmds_encoder(const uint8_t d8) {
     return d_out;
 }
 
+//служебные слова синхры 240-243
+static void encode_sync_words(uint64_t* conv_color64) {
+    const uint16_t b0 = 0b1101010100;
+    const uint16_t b1 = 0b0010101011;
+    const uint16_t b2 = 0b0101010100;
+    const uint16_t b3 = 0b1010101011;
+    const int base_inx = BASE_HDMI_CTRL_INX;
+
+    conv_color64[2 * base_inx + 0] = get_ser_diff_data(b0, b0, b3);
+    conv_color64[2 * base_inx + 1] = get_ser_diff_data(b0, b0, b3);
+
+    conv_color64[2 * (base_inx + 1) + 0] = get_ser_diff_data(b0, b0, b2);
+    conv_color64[2 * (base_inx + 1) + 1] = get_ser_diff_data(b0, b0, b2);
+
+    conv_color64[2 * (base_inx + 2) + 0] = get_ser_diff_data(b0, b0, b1);
+    conv_color64[2 * (base_inx + 2) + 1] = get_ser_diff_data(b0, b0, b1);
+
+    conv_color64[2 * (base_inx + 3) + 0] = get_ser_diff_data(b0, b0, b0);
+    conv_color64[2 * (base_inx + 3) + 1] = get_ser_diff_data(b0, b0, b0);
+}
+
+// Closest colour in 0-239 for one of the reserved indices 240-243
+static uint8_t closest_low_color(const uint32_t* pal, const uint32_t color888) {
+    const int r = (color888 >> 16) & 0xff;
+    const int g = (color888 >> 8) & 0xff;
+    const int b = color888 & 0xff;
+    int best_match = 239;
+    int best_distance = 999999;
+
+    for (int j = 0; j < 240; j++) {
+        const int dr = r - (int)((pal[j] >> 16) & 0xff);
+        const int dg = g - (int)((pal[j] >> 8) & 0xff);
+        const int db = b - (int)(pal[j] & 0xff);
+        const int distance = dr * dr + dg * dg + db * db;
+
+        if (distance < best_distance) {
+            best_distance = distance;
+            best_match = j;
+        }
+    }
+    return best_match;
+}
+
+static inline void encode_color(uint64_t* conv_color64, const int i, const uint32_t color888) {
+    const uint8_t R = (color888 >> 16) & 0xff;
+    const uint8_t G = (color888 >> 8) & 0xff;
+    const uint8_t B = (color888 >> 0) & 0xff;
+    conv_color64[i * 2] = get_ser_diff_data(tmds_encoder(R), tmds_encoder(G), tmds_encoder(B));
+    conv_color64[i * 2 + 1] = conv_color64[i * 2] ^ 0x0003ffffffffffffl;
+}
+
+// Full conv table for one palette state, sync words included
+static void pal_encode_state(pal_state_t* st) {
+    for (int i = 0; i < 256; i++) {
+        if (i >= 240 && i <= 243) {
+            st->substitute[i - 240] = closest_low_color(st->colors, st->colors[i]);
+            continue;
+        }
+        encode_color(st->words, i, st->colors[i]);
+    }
+    encode_sync_words(st->words);
+}
+
+// Core 1: encode the states core 0 posts through the FIFO
+static void pal_core1_entry(void) {
+    for (;;) {
+        const uint32_t slot = multicore_fifo_pop_blocking();
+        if (slot >= PAL_CACHE_STATES) continue;
+        pal_encode_state(&pal_states[slot]);
+        __dmb();
+        pal_meta[slot].status = PAL_READY;
+    }
+}
+
 static void pio_set_x(PIO pio, const int sm, uint32_t v) {
     uint instr_shift = pio_encode_in(pio_x, 4);
     uint instr_mov = pio_encode_mov(pio_x, pio_isr);
@@ -235,6 +354,12 @@ static void dma_handler_HDMI() {
 
     if (line >= mode.h_total ) {
         line = 0;
+        //смена палитры, пока на линии только синхра
+        if (pal_flip_pending) {
+            memcpy(conv_color, conv_stage, sizeof(conv_stage));
+            memcpy(color_substitute, stage_substitute, sizeof(stage_substitute));
+            pal_flip_pending = false;
+        }
         vsync_handler();
     } else {
         ++line;
@@ -410,24 +535,7 @@ static inline bool hdmi_init() {
     }
 
     //240-243 служебные данные(синхра) напрямую вносим в массив -конвертер
-    uint64_t* conv_color64 = (uint64_t *)conv_color;
-    const uint16_t b0 = 0b1101010100;
-    const uint16_t b1 = 0b0010101011;
-    const uint16_t b2 = 0b0101010100;
-    const uint16_t b3 = 0b1010101011;
-    const int base_inx = BASE_HDMI_CTRL_INX;
-
-    conv_color64[2 * base_inx + 0] = get_ser_diff_data(b0, b0, b3);
-    conv_color64[2 * base_inx + 1] = get_ser_diff_data(b0, b0, b3);
-
-    conv_color64[2 * (base_inx + 1) + 0] = get_ser_diff_data(b0, b0, b2);
-    conv_color64[2 * (base_inx + 1) + 1] = get_ser_diff_data(b0, b0, b2);
-
-    conv_color64[2 * (base_inx + 2) + 0] = get_ser_diff_data(b0, b0, b1);
-    conv_color64[2 * (base_inx + 2) + 1] = get_ser_diff_data(b0, b0, b1);
-
-    conv_color64[2 * (base_inx + 3) + 0] = get_ser_diff_data(b0, b0, b0);
-    conv_color64[2 * (base_inx + 3) + 1] = get_ser_diff_data(b0, b0, b0);
+    encode_sync_words((uint64_t *)conv_color);
 
     //настройка PIO SM для конвертации
 
@@ -600,42 +708,101 @@ void graphics_set_palette_hdmi(uint8_t i, uint32_t color888) {
 
     // For HDMI sync control indices (240-243), find nearest color in range 0-239
     if (i >= 240 && i <= 243) {
-        uint8_t r = (color888 >> 16) & 0xff;
-        uint8_t g = (color888 >> 8) & 0xff;
-        uint8_t b = color888 & 0xff;
-        
-        int best_match = 239;
-        int best_distance = 999999;
-        
-        // Find closest color in palette 0-239
-        for (int j = 0; j < 240; j++) {
-            uint8_t pr = (palette[j] >> 16) & 0xff;
-            uint8_t pg = (palette[j] >> 8) & 0xff;
-            uint8_t pb = palette[j] & 0xff;
-            
-            int dr = r - pr;
-            int dg = g - pg;
-            int db = b - pb;
-            int distance = dr*dr + dg*dg + db*db;
-            
-            if (distance < best_distance) {
-                best_distance = distance;
-                best_match = j;
-            }
-        }
-        
-        color_substitute[i - 240] = best_match;
+        color_substitute[i - 240] = closest_low_color(palette, color888);
         return; // Don't set hardware palette for these indices
     }
 
-    uint64_t* conv_color64 = (uint64_t *)conv_color;
-    const uint8_t R = (color888 >> 16) & 0xff;
-    const uint8_t G = (color888 >> 8) & 0xff;
-    const uint8_t B = (color888 >> 0) & 0xff;
-    conv_color64[i * 2] = get_ser_diff_data(tmds_encoder(R), tmds_encoder(G), tmds_encoder(B));
-    conv_color64[i * 2 + 1] = conv_color64[i * 2] ^ 0x0003ffffffffffffl;
+    encode_color((uint64_t *)conv_color, i, color888);
 };
 
+// Copy a ready state to the staging table; the DMA handler applies it at vblank
+static void pal_stage(const int slot) {
+    const pal_state_t* st = &pal_states[slot];
+    pal_flip_pending = false;
+    __dmb();
+    memcpy(conv_stage, st->words, sizeof(conv_stage));
+    memcpy(stage_substitute, st->substitute, sizeof(stage_substitute));
+    __dmb();
+    pal_flip_pending = true;
+    pal_shown = slot;
+}
+
+// Uncached path: write the live table directly and drop any staged state
+static void pal_set_inline(void) {
+    pal_flip_pending = false;
+    pal_want = pal_shown = -1;
+    for (int i = 0; i < 256; i++) graphics_set_palette_hdmi(i, palette[i]);
+}
+
+void graphics_palette_update(void) {
+    if (pal_want < 0 || pal_want == pal_shown) return;
+    if (pal_meta[pal_want].status != PAL_READY) return;
+    __dmb();
+    pal_stage(pal_want);
+}
+
+void graphics_set_palette_all(const uint32_t* colors888) {
+    uint32_t key = 2166136261u;
+    for (int i = 0; i < 256; i++) {
+        palette[i] = colors888[i] & 0x00ffffff;
+        key = (key ^ palette[i]) * 16777619u;
+    }
+
+    if (!pal_states) {
+        pal_set_inline();
+        return;
+    }
+
+    int victim = -1;
+    for (int s = 0; s < PAL_CACHE_STATES; s++) {
+        pal_meta_t* m = &pal_meta[s];
+        if (m->status == PAL_EMPTY) {
+            if (victim < 0 || pal_meta[victim].status != PAL_EMPTY) victim = s;
+            continue;
+        }
+        if (m->status == PAL_ENCODING) {
+            if (m->key == key && !memcmp(pal_states[s].colors, palette, sizeof(palette))) {
+                m->used = ++pal_clock;
+                pal_want = s;
+                return;
+            }
+            continue;
+        }
+        if (m->key == key && !memcmp(pal_states[s].colors, palette, sizeof(palette))) {
+            m->used = ++pal_clock;
+            pal_want = s;
+            graphics_palette_update();
+            return;
+        }
+        if (victim < 0 || (pal_meta[victim].status != PAL_EMPTY && m->used < pal_meta[victim].used))
+            victim = s;
+    }
+
+    if (victim < 0) {
+        //все слоты заняты ядром 1 - кодируем здесь без кэша
+        pal_set_inline();
+        return;
+    }
+
+    pal_meta_t* m = &pal_meta[victim];
+    if (victim == pal_shown) pal_shown = -1;
+    memcpy(pal_states[victim].colors, palette, sizeof(palette));
+    m->key = key;
+    m->used = ++pal_clock;
+    pal_want = victim;
+
+    if (multicore_fifo_wready()) {
+        m->status = PAL_ENCODING;
+        __dmb();
+        multicore_fifo_push_blocking(victim);
+        return;
+    }
+
+    pal_encode_state(&pal_states[victim]);
+    m->status = PAL_READY;
+    graphics_palette_update();
+}
+
 #define RGB888(r, g, b) ((r<<16) | (g << 8 ) | b )
 
 void graphics_init_hdmi() {
@@ -648,6 +815,18 @@ void graphics_init_hdmi() {
     dma_chan_pal_conv = dma_claim_unused_channel(true);
 
     hdmi_init();
+
+    // Palette states live for the whole run; keep them out of the level/session arenas
+    const int prev_arena = psram_set_arena(PSRAM_ARENA_BOOT);
+    pal_states = (pal_state_t *)psram_malloc(sizeof(pal_state_t) * PAL_CACHE_STATES);
+    psram_set_arena(prev_arena);
+    if (pal_states) {
+        memset(pal_meta, 0, sizeof(pal_meta));
+        multicore_launch_core1(pal_core1_entry);
+    }
+    else {
+        printf("HDMI: no memory for palette cache, encoding inline\n");
+    }
 }
 
 void graphics_set_bgcolor_hdmi(uint32_t color888) //определяем зарезервированный цвет в палитре
@@ -657,24 +836,7 @@ void graphics_set_bgcolor_hdmi(uint32_t color888) //определяем зар
 
 void graphics_restore_sync_colors(void) {
     // Restore HDMI sync control colors after palette updates
-    uint64_t* conv_color64 = (uint64_t *)conv_color;
-    const uint16_t b0 = 0b1101010100;
-    const uint16_t b1 = 0b0010101011;
-    const uint16_t b2 = 0b0101010100;
-    const uint16_t b3 = 0b1010101011;
-    const int base_inx = BASE_HDMI_CTRL_INX;
-
-    conv_color64[2 * base_inx + 0] = get_ser_diff_data(b0, b0, b3);
-    conv_color64[2 * base_inx + 1] = get_ser_diff_data(b0, b0, b3);
-
-    conv_color64[2 * (base_inx + 1) + 0] = get_ser_diff_data(b0, b0, b2);
-    conv_color64[2 * (base_inx + 1) + 1] = get_ser_diff_data(b0, b0, b2);
-
-    conv_color64[2 * (base_inx + 2) + 0] = get_ser_diff_data(b0, b0, b1);
-    conv_color64[2 * (base_inx + 2) + 1] = get_ser_diff_data(b0, b0, b1);
-
-    conv_color64[2 * (base_inx + 3) + 0] = get_ser_diff_data(b0, b0, b0);
-    conv_color64[2 * (base_inx + 3) + 1] = get_ser_diff_data(b0, b0, b0);
+    encode_sync_words((uint64_t *)conv_color);
 }
 
 // Wrappers for existing API
@@ -59,7 +59,11 @@ uint32_t graphics_get_height(void);
 void graphics_set_res(int w, int h);
 void graphics_set_shift(int x, int y);
 void graphics_set_palette(uint8_t i, uint32_t color888);
+void graphics_set_palette_all(const uint32_t *colors888); // full 256-colour state, cached
+void graphics_palette_update(void); // stage a state core 1 has finished encoding
 void graphics_restore_sync_colors(void);
+uint32_t graphics_get_vsync_count(void); // frames scanned out since start
+uint32_t graphics_get_vsync_time(void);  // time_us_32() of the last vsync
 void startVIDEO(uint8_t vol);
 void set_palette(uint8_t n); // переключение палитр
 
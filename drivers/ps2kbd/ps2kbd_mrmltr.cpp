@@ -428,3 +428,11 @@ void Ps2Kbd_Mrmltr::init_gpio() {
     pio_sm_init(_pio, _sm, offset, &c);
     pio_sm_set_enabled(_pio, _sm, true);
 }
+
+// PIO IRQ 1 of the keyboard's PIO; IRQ 0 is left to other users of the block
+void Ps2Kbd_Mrmltr::init_irq(irq_handler_t handler) {
+    uint irq = (_pio == pio0) ? PIO0_IRQ_1 : PIO1_IRQ_1;
+    pio_set_irq1_source_enabled(_pio, (pio_interrupt_source)(pis_sm0_rx_fifo_not_empty + _sm), true);
+    irq_set_exclusive_handler(irq, handler);
+    irq_set_enabled(irq, true);
+}
@@ -12,6 +12,7 @@
 #include "hid_codes.h"
 #include "hardware/pio.h"
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
 #include <functional>
 
 
@@ -61,6 +62,9 @@ public:
     std::function<void(hid_keyboard_report_t *curr, hid_keyboard_report_t *prev)> keyHandler);
   
   void init_gpio();
+
+  // Run tick() from the PIO RX-not-empty interrupt instead of polling
+  void init_irq(irq_handler_t handler);
   
   void __not_in_flash_func(tick)();
 };
@@ -4,7 +4,8 @@
  */
 #include "ps2kbd_wrapper.h"
 #include "ps2kbd_mrmltr.h"
-#include <queue>
+#include "pico/time.h"
+#include "hardware/sync.h"
 
 // PS/2 keyboard pins (matching board_config.h)
 #ifndef PS2_PIN_DATA
@@ -114,11 +115,30 @@
 #define  sc_kpad_Enter   0x68
 
 struct KeyEvent {
-    int pressed;
+    uint32_t time_us;
+    uint8_t pressed;
     unsigned char key;
 };
 
-static std::queue<KeyEvent> event_queue;
+// Single-producer (PIO IRQ) / single-consumer (game loop) ring.
+// Each side only writes its own index, so no lock is needed.
+#define KEY_RING_SIZE 64
+
+static KeyEvent key_ring[KEY_RING_SIZE];
+static volatile uint32_t key_ring_head = 0;
+static volatile uint32_t key_ring_tail = 0;
+static uint32_t key_ring_time = 0;
+
+static void __not_in_flash_func(key_push)(int pressed, unsigned char key) {
+    uint32_t head = key_ring_head;
+    if (head - key_ring_tail >= KEY_RING_SIZE) return; // full, drop
+    KeyEvent *e = &key_ring[head & (KEY_RING_SIZE - 1)];
+    e->time_us = key_ring_time;
+    e->pressed = pressed;
+    e->key = key;
+    __dmb();
+    key_ring_head = head + 1;
+}
 
 // HID to Duke3D scancode mapping
 static unsigned char hid_to_duke3d(uint8_t code) {
@@ -219,17 +239,17 @@ static void key_handler(hid_keyboard_report_t *curr, hid_keyboard_report_t *prev
         // Ctrl
         if (changed_mods & (KEYBOARD_MODIFIER_LEFTCTRL | KEYBOARD_MODIFIER_RIGHTCTRL)) {
             int ctrl_pressed = (curr->modifier & (KEYBOARD_MODIFIER_LEFTCTRL | KEYBOARD_MODIFIER_RIGHTCTRL)) != 0;
-            event_queue.push({ctrl_pressed, sc_LeftControl});
+            key_push(ctrl_pressed, sc_LeftControl);
         }
         // Shift
         if (changed_mods & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT)) {
             int shift_pressed = (curr->modifier & (KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT)) != 0;
-            event_queue.push({shift_pressed, sc_LeftShift});
+            key_push(shift_pressed, sc_LeftShift);
         }
         // Alt
         if (changed_mods & (KEYBOARD_MODIFIER_LEFTALT | KEYBOARD_MODIFIER_RIGHTALT)) {
             int alt_pressed = (curr->modifier & (KEYBOARD_MODIFIER_LEFTALT | KEYBOARD_MODIFIER_RIGHTALT)) != 0;
-            event_queue.push({alt_pressed, sc_LeftAlt});
+            key_push(alt_pressed, sc_LeftAlt);
         }
     }
 
@@ -245,7 +265,7 @@ static void key_handler(hid_keyboard_report_t *curr, hid_keyboard_report_t *prev
             }
             if (!found) {
                 unsigned char k = hid_to_duke3d(curr->keycode[i]);
-                if (k != sc_None) event_queue.push({1, k});
+                if (k != sc_None) key_push(1, k);
             }
         }
     }
@@ -262,7 +282,7 @@ static void key_handler(hid_keyboard_report_t *curr, hid_keyboard_report_t *prev
             }
             if (!found) {
                 unsigned char k = hid_to_duke3d(prev->keycode[i]);
-                if (k != sc_None) event_queue.push({0, k});
+                if (k != sc_None) key_push(0, k);
             }
         }
     }
@@ -270,21 +290,36 @@ static void key_handler(hid_keyboard_report_t *curr, hid_keyboard_report_t *prev
 
 static Ps2Kbd_Mrmltr* kbd = nullptr;
 
+// Scancodes are decoded as they arrive, so a press and release inside one
+// slow frame both reach the ring with their own timestamps.
+static void __not_in_flash_func(ps2kbd_irq)(void) {
+    key_ring_time = time_us_32();
+    if (kbd) kbd->tick();
+}
+
 extern "C" void ps2kbd_init(void) {
     // Use pins from board config
     kbd = new Ps2Kbd_Mrmltr(pio0, PS2_PIN_DATA, key_handler);
     kbd->init_gpio();
+    kbd->init_irq(ps2kbd_irq);
 }
 
 extern "C" void ps2kbd_tick(void) {
-    if (kbd) kbd->tick();
+    // Decoding runs in ps2kbd_irq(); nothing to poll
 }
 
-extern "C" int ps2kbd_get_key(int* pressed, unsigned char* key) {
-    if (event_queue.empty()) return 0;
-    KeyEvent e = event_queue.front();
-    event_queue.pop();
-    *pressed = e.pressed;
-    *key = e.key;
+extern "C" int ps2kbd_get_key_time(int* pressed, unsigned char* key, uint32_t* time_us) {
+    uint32_t tail = key_ring_tail;
+    if (tail == key_ring_head) return 0;
+    __dmb();
+    const KeyEvent *e = &key_ring[tail & (KEY_RING_SIZE - 1)];
+    *pressed = e->pressed;
+    *key = e->key;
+    if (time_us) *time_us = e->time_us;
+    key_ring_tail = tail + 1;
     return 1;
 }
+
+extern "C" int ps2kbd_get_key(int* pressed, unsigned char* key) {
+    return ps2kbd_get_key_time(pressed, key, NULL);
+}
@@ -1,6 +1,8 @@
 #ifndef PS2KBD_WRAPPER_H
 #define PS2KBD_WRAPPER_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -8,6 +10,8 @@ extern "C" {
 void ps2kbd_init(void);
 void ps2kbd_tick(void);
 int ps2kbd_get_key(int* pressed, unsigned char* key);
+// Same, plus the time_us_32() at which the scancode arrived
+int ps2kbd_get_key_time(int* pressed, unsigned char* key, uint32_t* time_us);
 
 #ifdef __cplusplus
 }
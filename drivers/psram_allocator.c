@@ -1,5 +1,4 @@
 #include "psram_allocator.h"
-#include "psram_allocator.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -14,22 +13,236 @@
 #define PSRAM_BASE 0x11000000
 #define PSRAM_SIZE (8 * 1024 * 1024) // Assume 8MB
 
+// The linker places .psram_data/.psram_bss at the start of PSRAM; the heap
+// begins after them (memmap_psram.ld).
+extern uint8_t __psram_heap_start__[];
+
 static uint8_t *psram_start = (uint8_t *)PSRAM_BASE;
-// Reserve 512KB for scratch buffers at the beginning
-// 0-64KB: Scratch 1 (Decompression)
-// 64-128KB: Scratch 2 (Conversion)
-// 128-384KB: File Load Buffer (256KB)
+// Reserve 512KB for scratch buffers at the beginning of the heap
+// 0-128KB: Scratch 1 (Decompression)
+// 128-256KB: Scratch 2 (Conversion)
+// 256-512KB: File Load Buffer (256KB)
 #define SCRATCH_SIZE (512 * 1024)
-static size_t psram_offset = SCRATCH_SIZE;
+static uint8_t *psram_scratch;
 
 // Temp allocator support
 // Some MIDI files exceed available temp memory - game continues without music
 #define TEMP_SIZE (4 * 1024 * 1024) // 4MB for temp (music)
 #define PERM_SIZE (PSRAM_SIZE - TEMP_SIZE) // 4MB for permanent
 static size_t psram_temp_offset = 0;
+static size_t psram_temp_peak = 0;
 static int psram_temp_mode = 0;
 static int psram_sram_mode = 0; // Force SRAM allocation (proper malloc/free)
-static size_t psram_session_mark = 0; // Save point for game session memory
+static int psram_arena = PSRAM_ARENA_BOOT;
+
+/*
+ * Permanent region: two-level segregated fit (TLSF) heap.
+ *  Free blocks are kept in FL_COUNT x SL_COUNT size-class lists with a
+ *  bitmap per level, so malloc and free are a couple of bit scans plus
+ *  list splices. Neighbours are merged on free through the physical
+ *  links, and a zero-size used block at the end stops the merge.
+ *
+ *  Every block records its arena and the caller's return address, which
+ *  psram_print_stats() groups to show who holds the memory.
+ */
+typedef struct psram_block {
+    struct psram_block *prev_phys;  // previous block in memory
+    uint32_t size;                  // payload bytes | BLOCK_FREE | BLOCK_PREV_FREE
+    const void *site;               // allocating call site
+    uint8_t arena;
+    uint8_t pad[3];
+    // Only valid while the block is free (overlaps the payload)
+    struct psram_block *next_free;
+    struct psram_block *prev_free;
+} psram_block_t;
+
+#define BLOCK_HEADER     offsetof(psram_block_t, next_free)
+#define BLOCK_FREE       1u
+#define BLOCK_PREV_FREE  2u
+#define BLOCK_SIZE_MASK  (~7u)
+#define BLOCK_ALIGN      8
+#define BLOCK_MIN        (sizeof(psram_block_t) - BLOCK_HEADER)
+
+#define SL_LOG2   4
+#define SL_COUNT  (1 << SL_LOG2)
+#define FL_SHIFT  (SL_LOG2 + 3)      // below 128 bytes: linear 8-byte classes
+#define FL_COUNT  24
+
+static uint32_t heap_fl_bitmap;
+static uint32_t heap_sl_bitmap[FL_COUNT];
+static psram_block_t *heap_free_list[FL_COUNT][SL_COUNT];
+static psram_block_t *heap_first, *heap_last;
+static uint8_t *heap_lo, *heap_hi;
+static int heap_ready;
+
+static inline uint32_t block_size(const psram_block_t *b) { return b->size & BLOCK_SIZE_MASK; }
+static inline void *block_payload(psram_block_t *b) { return (uint8_t *)b + BLOCK_HEADER; }
+static inline psram_block_t *block_from_payload(void *p) { return (psram_block_t *)((uint8_t *)p - BLOCK_HEADER); }
+static inline psram_block_t *block_next(psram_block_t *b) {
+    return (psram_block_t *)((uint8_t *)block_payload(b) + block_size(b));
+}
+
+static inline int fls32(uint32_t x) { return 31 - __builtin_clz(x); }
+static inline int ffs32(uint32_t x) { return __builtin_ctz(x); }
+
+static void heap_mapping(uint32_t size, int *fl, int *sl) {
+    if (size < (1u << FL_SHIFT)) {
+        *fl = 0;
+        *sl = (int)(size >> 3);
+    } else {
+        int f = fls32(size);
+        *sl = (int)((size >> (f - SL_LOG2)) ^ (1u << SL_LOG2));
+        *fl = f - (FL_SHIFT - 1);
+    }
+}
+
+static void heap_insert(psram_block_t *b) {
+    int fl, sl;
+    heap_mapping(block_size(b), &fl, &sl);
+    b->prev_free = NULL;
+    b->next_free = heap_free_list[fl][sl];
+    if (b->next_free) b->next_free->prev_free = b;
+    heap_free_list[fl][sl] = b;
+    heap_fl_bitmap |= 1u << fl;
+    heap_sl_bitmap[fl] |= 1u << sl;
+}
+
+static void heap_remove(psram_block_t *b) {
+    int fl, sl;
+    heap_mapping(block_size(b), &fl, &sl);
+    if (b->prev_free) b->prev_free->next_free = b->next_free;
+    else heap_free_list[fl][sl] = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+    if (heap_free_list[fl][sl] == NULL) {
+        heap_sl_bitmap[fl] &= ~(1u << sl);
+        if (heap_sl_bitmap[fl] == 0) heap_fl_bitmap &= ~(1u << fl);
+    }
+}
+
+// Smallest non-empty list whose blocks are all >= size.
+static psram_block_t *heap_find(uint32_t size) {
+    int fl, sl;
+    uint32_t map;
+
+    if (size >= (1u << FL_SHIFT))
+        size += (1u << (fls32(size) - SL_LOG2)) - 1;
+    heap_mapping(size, &fl, &sl);
+    if (fl >= FL_COUNT) return NULL;
+
+    map = heap_sl_bitmap[fl] & (~0u << sl);
+    if (!map) {
+        map = heap_fl_bitmap & (fl + 1 < 32 ? (~0u << (fl + 1)) : 0);
+        if (!map) return NULL;
+        fl = ffs32(map);
+        map = heap_sl_bitmap[fl];
+    }
+    return heap_free_list[fl][ffs32(map)];
+}
+
+static void heap_set_free(psram_block_t *b) {
+    psram_block_t *n = block_next(b);
+    b->size |= BLOCK_FREE;
+    n->size |= BLOCK_PREV_FREE;
+    n->prev_phys = b;
+}
+
+// Cut b down to size bytes of payload; the tail becomes a free block.
+static void heap_split(psram_block_t *b, uint32_t size) {
+    psram_block_t *rest;
+    uint32_t total = block_size(b);
+
+    if (total < size + BLOCK_HEADER + BLOCK_MIN) return;
+    rest = (psram_block_t *)((uint8_t *)block_payload(b) + size);
+    rest->size = (total - size - BLOCK_HEADER) | BLOCK_FREE;
+    rest->prev_phys = b;
+    rest->site = NULL;
+    rest->arena = 0;
+    b->size = size | (b->size & ~BLOCK_SIZE_MASK);
+    heap_set_free(rest);
+    heap_insert(rest);
+}
+
+// Absorb the free block after b into b.
+static void heap_absorb(psram_block_t *b) {
+    psram_block_t *n = block_next(b);
+    heap_remove(n);
+    b->size += block_size(n) + BLOCK_HEADER;
+    block_next(b)->prev_phys = b;
+}
+
+static void heap_init(void) {
+    uint8_t *lo = (uint8_t *)(((uintptr_t)__psram_heap_start__ + 63) & ~(uintptr_t)63);
+    uint8_t *hi = psram_start + PERM_SIZE;
+
+    memset(heap_free_list, 0, sizeof(heap_free_list));
+    memset(heap_sl_bitmap, 0, sizeof(heap_sl_bitmap));
+    heap_fl_bitmap = 0;
+    heap_ready = 1;
+
+    psram_scratch = lo;
+    heap_lo = lo + SCRATCH_SIZE;
+    heap_hi = hi;
+    if (heap_hi < heap_lo + 2 * sizeof(psram_block_t)) {
+        printf("PSRAM: no room for heap (bss ends at %p)\n", (void *)__psram_heap_start__);
+        heap_first = heap_last = NULL;
+        return;
+    }
+
+    heap_first = (psram_block_t *)heap_lo;
+    heap_last = (psram_block_t *)(heap_hi - BLOCK_HEADER);
+    heap_first->prev_phys = NULL;
+    heap_first->size = (uint32_t)((uint8_t *)heap_last - (uint8_t *)block_payload(heap_first)) & BLOCK_SIZE_MASK;
+    heap_first->site = NULL;
+    heap_first->arena = 0;
+    heap_last = block_next(heap_first);
+    heap_last->size = 0;      // sentinel: used, never merged
+    heap_last->site = NULL;
+    heap_last->arena = PSRAM_ARENA_BOOT;
+    heap_set_free(heap_first);
+    heap_insert(heap_first);
+}
+
+static void *heap_alloc(size_t size, const void *site) {
+    psram_block_t *b;
+    uint32_t sz;
+
+    if (!heap_ready) heap_init();
+    if (!heap_first) return NULL;
+
+    sz = (uint32_t)((size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1));
+    if (sz < BLOCK_MIN) sz = BLOCK_MIN;
+
+    b = heap_find(sz);
+    if (!b) return NULL;
+    heap_remove(b);
+    heap_split(b, sz);
+    b->size &= ~BLOCK_FREE;
+    block_next(b)->size &= ~BLOCK_PREV_FREE;
+    b->site = site;
+    b->arena = (uint8_t)psram_arena;
+    return block_payload(b);
+}
+
+static void heap_release(psram_block_t *b) {
+    psram_block_t *p;
+
+    if (b->size & BLOCK_PREV_FREE) {
+        p = b->prev_phys;
+        heap_remove(p);
+        p->size += block_size(b) + BLOCK_HEADER;
+        b = p;
+    }
+    if (block_next(b)->size & BLOCK_FREE) {
+        heap_absorb(b);
+    }
+    heap_set_free(b);
+    block_next(b)->prev_phys = b;
+    heap_insert(b);
+}
+
+static inline int in_heap(const void *ptr) {
+    return heap_ready && (const uint8_t *)ptr >= heap_lo && (const uint8_t *)ptr < heap_hi;
+}
 
 void psram_set_temp_mode(int enable) {
     psram_temp_mode = enable;
@@ -51,19 +264,31 @@ void psram_set_temp_offset(size_t offset) {
     psram_temp_offset = offset;
 }
 
+int psram_set_arena(int arena) {
+    int prev = psram_temp_mode ? PSRAM_ARENA_TRANSIENT : psram_arena;
+
+    if (arena == PSRAM_ARENA_TRANSIENT) {
+        psram_temp_mode = 1;
+    } else if (arena >= 0 && arena < PSRAM_ARENA_COUNT) {
+        psram_temp_mode = 0;
+        psram_arena = arena;
+    }
+    return prev;
+}
+
 void *psram_malloc(size_t size) {
     // If SRAM mode is enabled, use regular malloc (for peels that need proper free)
     if (psram_sram_mode) {
         return malloc(size);
     }
-    
-    // Align to 4 bytes
-    size = (size + 3) & ~3;
-    
-    // Add header for size tracking (needed for realloc)
-    size_t total_size = size + sizeof(size_t);
 
     if (psram_temp_mode) {
+        // Align to 4 bytes
+        size = (size + 3) & ~3;
+
+        // Add header for size tracking (needed for realloc)
+        size_t total_size = size + sizeof(size_t);
+
         if (psram_temp_offset + total_size > TEMP_SIZE) {
             printf("PSRAM Temp OOM! Req %d, free %d\n", (int)size, (int)(TEMP_SIZE - psram_temp_offset));
             return NULL;
@@ -72,18 +297,13 @@ void *psram_malloc(size_t size) {
         *header = size;
         void *ptr = (void *)(header + 1);
         psram_temp_offset += total_size;
+        if (psram_temp_offset > psram_temp_peak) psram_temp_peak = psram_temp_offset;
         return ptr;
     } else {
-        if (psram_offset + total_size > PERM_SIZE) {
-            printf("PSRAM Perm OOM! Req %d, free %d\n", (int)size, (int)(PERM_SIZE - psram_offset));
-            return NULL;
+        void *ptr = heap_alloc(size, __builtin_return_address(0));
+        if (!ptr) {
+            printf("PSRAM Perm OOM! Req %d\n", (int)size);
         }
-        
-        size_t *header = (size_t *)(psram_start + psram_offset);
-        *header = size;
-        
-        void *ptr = (void *)(header + 1);
-        psram_offset += total_size;
         return ptr;
     }
 }
@@ -92,8 +312,35 @@ void *psram_realloc(void *ptr, size_t new_size) {
     if (ptr == NULL) return psram_malloc(new_size);
     if (new_size == 0) { psram_free(ptr); return NULL; }
 
+    if (in_heap(ptr)) {
+        psram_block_t *b = block_from_payload(ptr);
+        uint32_t old_size = block_size(b);
+        uint32_t sz = (uint32_t)((new_size + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1));
+
+        if (sz <= old_size) {
+            return ptr; // Shrink or same size: do nothing
+        }
+
+        // Grow in place into a free neighbour
+        psram_block_t *n = block_next(b);
+        if ((n->size & BLOCK_FREE) && old_size + BLOCK_HEADER + block_size(n) >= sz) {
+            heap_absorb(b);
+            heap_split(b, sz);
+            block_next(b)->size &= ~BLOCK_PREV_FREE;
+            return ptr;
+        }
+
+        void *new_ptr = psram_malloc(new_size);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, old_size);
+            block_from_payload(new_ptr)->site = b->site;
+            psram_free(ptr);
+        }
+        return new_ptr;
+    }
+
     if ((uintptr_t)ptr >= PSRAM_BASE && (uintptr_t)ptr < (PSRAM_BASE + PSRAM_SIZE)) {
-        // It's in PSRAM
+        // Temp region
         size_t *header = (size_t *)ptr - 1;
         size_t old_size = *header;
 
@@ -104,7 +351,6 @@ void *psram_realloc(void *ptr, size_t new_size) {
         void *new_ptr = psram_malloc(new_size);
         if (new_ptr) {
             memcpy(new_ptr, ptr, old_size);
-            // psram_free(ptr); // No-op for bump allocator
         }
         return new_ptr;
     }
@@ -115,12 +361,14 @@ void *psram_realloc(void *ptr, size_t new_size) {
 
 void *psram_get_scratch_1(size_t size) {
     if (size > 128 * 1024) return NULL;
-    return psram_start;
+    if (!heap_ready) heap_init();
+    return psram_scratch;
 }
 
 void *psram_get_scratch_2(size_t size) {
     if (size > 128 * 1024) return NULL;
-    return psram_start + (128 * 1024);
+    if (!heap_ready) heap_init();
+    return psram_scratch + (128 * 1024);
 }
 
 void *psram_get_file_buffer(size_t size) {
@@ -128,13 +376,24 @@ void *psram_get_file_buffer(size_t size) {
         printf("PSRAM File Buffer too small! Req: %d\n", (int)size);
         return NULL;
     }
-    return psram_start + (256 * 1024);
+    if (!heap_ready) heap_init();
+    return psram_scratch + (256 * 1024);
 }
 
 
 void psram_free(void *ptr) {
+    if (ptr == NULL) return;
+    if (in_heap(ptr)) {
+        psram_block_t *b = block_from_payload(ptr);
+        if (b->size & BLOCK_FREE) {
+            printf("PSRAM double free %p\n", ptr);
+            return;
+        }
+        heap_release(b);
+        return;
+    }
     if (ptr >= (void*)PSRAM_BASE && ptr < (void*)(PSRAM_BASE + PSRAM_SIZE)) {
-        // It's in PSRAM, do nothing (bump allocator)
+        // Temp region or scratch: released by psram_reset_temp()
         return;
     }
     // It's not in PSRAM, assume it's from malloc
@@ -142,24 +401,71 @@ void psram_free(void *ptr) {
 }
 
 void psram_reset(void) {
-    psram_offset = SCRATCH_SIZE; // Reset to after scratch area
+    heap_init();
     psram_temp_offset = 0;
-    psram_session_mark = 0;
+    psram_arena = PSRAM_ARENA_BOOT;
 }
 
 void psram_mark_session(void) {
-    psram_session_mark = psram_offset;
+    psram_arena = PSRAM_ARENA_SESSION;
 }
 
-void psram_restore_session(void) {
-    if (psram_session_mark == 0) {
-        return;
-    }
-    psram_offset = psram_session_mark;
-    psram_temp_offset = 0;
-}
+#define STATS_SITES 16
 
 void psram_print_stats(void) {
-    // Debug function - no output in release builds
-    (void)0;
+    static const char *arena_names[PSRAM_ARENA_COUNT] = { "boot", "session", "transient" };
+    uint32_t used[PSRAM_ARENA_COUNT] = {0}, count[PSRAM_ARENA_COUNT] = {0};
+    uint32_t free_bytes = 0, free_blocks = 0, largest = 0;
+    const void *site[STATS_SITES];
+    uint32_t site_bytes[STATS_SITES];
+    int nsites = 0, i, j;
+    psram_block_t *b;
+
+    if (!heap_ready) heap_init();
+    if (!heap_first) return;
+
+    for (b = heap_first; b != heap_last; b = block_next(b)) {
+        uint32_t sz = block_size(b);
+        if (b->size & BLOCK_FREE) {
+            free_bytes += sz;
+            free_blocks++;
+            if (sz > largest) largest = sz;
+            continue;
+        }
+        if (b->arena < PSRAM_ARENA_COUNT) {
+            used[b->arena] += sz;
+            count[b->arena]++;
+        }
+        for (i = 0; i < nsites && site[i] != b->site; i++);
+        if (i == nsites) {
+            if (nsites == STATS_SITES) continue;
+            site[nsites] = b->site;
+            site_bytes[nsites++] = 0;
+        }
+        site_bytes[i] += sz;
+    }
+    used[PSRAM_ARENA_TRANSIENT] = (uint32_t)psram_temp_offset;
+
+    printf("PSRAM heap %uKB at %p, bss+data %uKB, scratch %uKB\n",
+           (unsigned)((heap_hi - heap_lo) >> 10), (void *)heap_lo,
+           (unsigned)(((uint8_t *)__psram_heap_start__ - psram_start) >> 10),
+           (unsigned)(SCRATCH_SIZE >> 10));
+    for (i = 0; i < PSRAM_ARENA_COUNT; i++)
+        printf("  %-9s %7uKB in %u blocks\n", arena_names[i], (unsigned)(used[i] >> 10), (unsigned)count[i]);
+    printf("  temp peak %uKB of %uKB\n", (unsigned)(psram_temp_peak >> 10), (unsigned)(TEMP_SIZE >> 10));
+    printf("  free      %7uKB in %u blocks, largest %uKB, fragmentation %u%%\n",
+           (unsigned)(free_bytes >> 10), (unsigned)free_blocks, (unsigned)(largest >> 10),
+           free_bytes ? (unsigned)(100 - (uint64_t)largest * 100 / free_bytes) : 0u);
+
+    // Largest holders first; resolve the addresses with addr2line
+    for (i = 0; i < nsites && i < 8; i++) {
+        for (j = i + 1; j < nsites; j++) {
+            if (site_bytes[j] > site_bytes[i]) {
+                const void *ts = site[i]; uint32_t tb = site_bytes[i];
+                site[i] = site[j]; site_bytes[i] = site_bytes[j];
+                site[j] = ts; site_bytes[j] = tb;
+            }
+        }
+        printf("  site %p %7uKB\n", site[i], (unsigned)(site_bytes[i] >> 10));
+    }
 }
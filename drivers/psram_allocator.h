@@ -3,16 +3,27 @@
 
 #include <stddef.h>
 
+// Arena scopes. Every permanent block is tagged with the arena that was
+// current when it was allocated; psram_print_stats() reports per arena.
+// TRANSIENT is the upper 4MB bump region (temp mode).
+enum {
+    PSRAM_ARENA_BOOT = 0,     // engine tables, tiles, GRP index
+    PSRAM_ARENA_SESSION,      // everything after start-up
+    PSRAM_ARENA_TRANSIENT,    // music, dropped by psram_reset_temp()
+    PSRAM_ARENA_COUNT
+};
+
 void *psram_malloc(size_t size);
 void *psram_realloc(void *ptr, size_t size);
 void psram_free(void *ptr);
 void psram_reset(void);
-void psram_mark_session(void);    // Mark current offset for game session
-void psram_restore_session(void); // Restore to marked offset
+void psram_mark_session(void);    // Boot is done: new allocations go to SESSION
 void *psram_get_scratch_1(size_t size);
 void *psram_get_scratch_2(size_t size);
 void *psram_get_file_buffer(size_t size);
 
+int psram_set_arena(int arena);   // Returns the previous arena
+
 void psram_set_temp_mode(int enable);
 void psram_reset_temp(void);
 size_t psram_get_temp_offset(void);
@@ -226,16 +226,17 @@ static SDLKey duke3d_scancode_to_sdl_key(unsigned char key) {
 }
 
 void SDL_PumpEvents(void) {
-    // Poll keyboard and add events to queue
-    ps2kbd_tick();
+    // Move keyboard events from the PS/2 IRQ ring to the SDL queue
     
     int pressed;
     unsigned char key;
-    while (ps2kbd_get_key(&pressed, &key)) {
+    uint32_t time_us;
+    while (ps2kbd_get_key_time(&pressed, &key, &time_us)) {
         int next_head = (event_head + 1) % MAX_EVENTS;
         if (next_head != event_tail) {
             SDL_Event *ev = &event_queue[event_head];
             ev->type = pressed ? SDL_KEYDOWN : SDL_KEYUP;
+            ev->key.timestamp = time_us; /* microseconds, from the PS/2 IRQ */
             ev->key.keysym.sym = duke3d_scancode_to_sdl_key(key);
             ev->key.keysym.scancode = key;
             ev->key.keysym.mod = KMOD_NONE;
@@ -197,10 +197,15 @@ int SDL_SetPalette(SDL_Surface *surface, int flags, SDL_Color *colors, int first
     
     for (int i = 0; i < ncolors && (firstcolor + i) < 256; i++) {
         palette_colors[firstcolor + i] = colors[i];
-        uint32_t color888 = (colors[i].r << 16) | (colors[i].g << 8) | colors[i].b;
-        graphics_set_palette(firstcolor + i, color888);
     }
     
+    /* Submit the whole palette as one state so the HDMI driver can cache it */
+    uint32_t colors888[256];
+    for (int i = 0; i < 256; i++) {
+        colors888[i] = (palette_colors[i].r << 16) | (palette_colors[i].g << 8) | palette_colors[i].b;
+    }
+    graphics_set_palette_all(colors888);
+    
     return 1;
 }
 
@@ -214,6 +219,9 @@ int SDL_Flip(SDL_Surface *screen) {
     /* Copy from PSRAM render buffer to SRAM display buffer */
     memcpy(FRAME_BUF, vid_buffer, FRAME_SIZE);
     
+    /* Pick up a palette state core 1 finished since the last frame */
+    graphics_palette_update();
+    
     return 0;
 }
 
@@ -3,6 +3,14 @@
  * 
  * Loads ANM files in chunks from SD card instead of loading entire file to memory.
  * Uses PSRAM for frame buffers.
+ *
+ * A (page, offset) index for every frame is built at open time. Large pages
+ * are double-buffered: while one plays, the next one is read a chunk at a
+ * time by AnimStream_Prefetch() from the player's frame-pacing wait loop.
+ *
+ * Full-width 320x200 clips can be decoded straight into the screen
+ * (AnimStream_SetDirectOutput); otherwise frames go to a PSRAM image that
+ * the caller draws as a tile.
  */
 
 #include "anim_streaming.h"
@@ -10,6 +18,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "../drivers/psram_allocator.h"
+#include "pico/time.h"
 
 // Use Duke3D's file system
 extern int32_t TCkopen4load(const char *filename, int readfromGRP);
@@ -59,27 +68,55 @@ typedef struct {
 // Streaming Animation State
 //=============================================================================
 
+#define ANIM_PAGE_SIZE      0x10000
+#define ANIM_PAGE_BASE      0xb00   // First large page in the file
+#define ANIM_PREFETCH_CHUNK 8192    // Bytes read ahead per AnimStream_Prefetch()
+#define ANIM_WIDTH          320
+#define ANIM_HEIGHT         200
+
+// Decoder output: one linear image, or the rows of a taller screen
+typedef struct {
+    uint8_t *dst;               // Write position
+    uint8_t *rowEnd;            // End of the current row
+    int row;
+    uint8_t **rows;             // NULL for the linear image
+} anim_out_t;
+
+typedef struct {
+    uint16_t page;              // Large page holding the record (0xFFFF = none)
+    uint16_t offset;            // Byte offset of the record in the page buffer
+} anim_frame_t;
+
+typedef struct {
+    uint16_t lpNum;             // LP held or being read (0xFFFF = none)
+    int32_t loaded;             // Bytes read so far
+    int32_t size;               // Bytes in the page
+    uint8_t *data;              // 64KB page buffer
+} anim_page_t;
+
 typedef struct {
     int32_t handle;             // File handle (-1 if not open)
     
     // Header data (read once)
     lpfileheader_t header;
-    lp_descriptor_t lpArray[256];
+    lp_descriptor_t lpArray[256];   // Descriptors from the page headers
     uint8_t palette[768];
     
-    // File position info
-    uint32_t dataStartOffset;   // Offset where LP data begins
-    
-    // Current large page cache
-    uint16_t curLpNum;          // Current LP number (0xFFFF = none)
-    lp_descriptor_t curLp;      // Current LP descriptor
-    
-    // Buffers (in PSRAM)
-    uint16_t *pageBuffer;       // 32KB buffer for current large page
+    // Frame index and double-buffered pages (in PSRAM)
+    anim_frame_t *frames;
+    anim_page_t pages[2];
+    int curPage;                // pages[curPage] plays, the other is read ahead
     uint8_t *imageBuffer;       // 64KB buffer for decoded frame
     
+    // Direct output: first screen row of every ANM row
+    uint8_t *directRows[ANIM_HEIGHT];
+    uint8_t *directFrame;
+    int32_t directPitch, directHeight;
+    
     // Playback state
     int32_t currentFrame;
+    uint32_t pageLoads, pageStalls;
+    uint32_t decodeFrames, decodeUs, decodeMaxUs;
 } anim_stream_t;
 
 static anim_stream_t *animStream = NULL;
@@ -88,11 +125,31 @@ static anim_stream_t *animStream = NULL;
 // RunSkipDump Decompressor
 //=============================================================================
 
-static void CPlayRunSkipDump(uint8_t *srcP, uint8_t *dstP)
+// Skip (src == NULL, fill < 0), copy (src) or fill n pixels, splitting the
+// op at row ends when writing to screen rows.
+static void outOp(anim_out_t *o, const uint8_t *src, int fill, uint32_t n)
+{
+    uint32_t k;
+
+    while (n) {
+        k = o->rowEnd - o->dst;
+        if (k > n) k = n;
+        if (src) { memcpy(o->dst, src, k); src += k; }
+        else if (fill >= 0) memset(o->dst, fill, k);
+        o->dst += k;
+        n -= k;
+        if (o->dst == o->rowEnd) {
+            if (!o->rows || ++o->row >= ANIM_HEIGHT) return;
+            o->dst = o->rows[o->row];
+            o->rowEnd = o->dst + ANIM_WIDTH;
+        }
+    }
+}
+
+static void CPlayRunSkipDump(uint8_t *srcP, anim_out_t *o)
 {
     int8_t cnt;
     uint16_t wordCnt;
-    uint8_t pixel;
 
 nextOp:
     cnt = (int8_t)*srcP++;
@@ -104,30 +161,26 @@ nextOp:
     if (cnt == 0)
         goto longOp;
     // shortSkip
-    dstP += cnt;
+    outOp(o, NULL, -1, (uint8_t)cnt);
     goto nextOp;
     
 dump:
-    do {
-        *dstP++ = *srcP++;
-    } while (--cnt);
+    outOp(o, srcP, 0, cnt);
+    srcP += cnt;
     goto nextOp;
     
 run:
     wordCnt = (uint8_t)*srcP++;
-    pixel = *srcP++;
-    do {
-        *dstP++ = pixel;
-    } while (--wordCnt);
+    outOp(o, NULL, *srcP++, wordCnt ? wordCnt : 0x10000);
     goto nextOp;
     
 longOp:
-    wordCnt = *((uint16_t *)srcP);
+    wordCnt = srcP[0] | (srcP[1] << 8);
     srcP += sizeof(uint16_t);
     if ((int16_t)wordCnt <= 0)
         goto notLongSkip;
     // longSkip
-    dstP += wordCnt;
+    outOp(o, NULL, -1, wordCnt);
     goto nextOp;
 
 notLongSkip:
@@ -137,17 +190,13 @@ notLongSkip:
     if (wordCnt >= 0x4000)
         goto longRun;
     // longDump
-    do {
-        *dstP++ = *srcP++;
-    } while (--wordCnt);
+    outOp(o, srcP, 0, wordCnt ? wordCnt : 0x10000);
+    srcP += wordCnt ? wordCnt : 0x10000;
     goto nextOp;
 
 longRun:
     wordCnt -= 0x4000;
-    pixel = *srcP++;
-    do {
-        *dstP++ = pixel;
-    } while (--wordCnt);
+    outOp(o, NULL, *srcP++, wordCnt ? wordCnt : 0x10000);
     goto nextOp;
 
 stop:
@@ -158,64 +207,99 @@ stop:
 // Helper Functions
 //=============================================================================
 
-// Find which large page contains a given frame
-static uint16_t findPage(uint16_t frameNumber)
+// Begin (re)loading a large page into a buffer
+static void pageStart(anim_page_t *pg, uint16_t pageNumber)
 {
-    if (!animStream) return 0;
-    
-    for (uint16_t i = 0; i < animStream->header.nLps; i++) {
-        if (animStream->lpArray[i].baseRecord <= frameNumber &&
-            animStream->lpArray[i].baseRecord + animStream->lpArray[i].nRecords > frameNumber) {
-            return i;
-        }
+    lp_descriptor_t *lp = &animStream->lpArray[pageNumber];
+
+    pg->lpNum = pageNumber;
+    pg->loaded = 0;
+    pg->size = lp->nBytes + lp->nRecords * 2;
+    if (pg->size > ANIM_PAGE_SIZE) pg->size = ANIM_PAGE_SIZE;  // Safety limit
+}
+
+// Read up to 'limit' more bytes of a page. The descriptor and its 2-byte
+// padding are skipped: the buffer starts at the record size table.
+static void pageRead(anim_page_t *pg, int32_t limit)
+{
+    int32_t n = pg->size - pg->loaded;
+
+    if (n > limit) n = limit;
+    if (n <= 0) return;
+    klseek(animStream->handle, ANIM_PAGE_BASE + pg->lpNum * ANIM_PAGE_SIZE
+           + sizeof(lp_descriptor_t) + sizeof(uint16_t) + pg->loaded, SEEK_SET);
+    kread(animStream->handle, pg->data + pg->loaded, n);
+    pg->loaded += n;
+}
+
+// Make a large page current. Uses the read-ahead buffer when it holds the
+// page, finishing whatever the prefetch has not read yet.
+static uint8_t *loadPage(uint16_t pageNumber)
+{
+    anim_page_t *pg = &animStream->pages[animStream->curPage];
+
+    if (pg->lpNum == pageNumber) return pg->data;  // Already loaded
+
+    pg = &animStream->pages[animStream->curPage ^ 1];
+    if (pg->lpNum != pageNumber) pageStart(pg, pageNumber);
+    if (pg->loaded < pg->size) {
+        animStream->pageStalls++;
+        pageRead(pg, pg->size);
     }
-    return 0;
+    animStream->pageLoads++;
+    animStream->curPage ^= 1;
+
+    // The retired buffer reads ahead the following page
+    pg = &animStream->pages[animStream->curPage ^ 1];
+    if (pageNumber + 1 < animStream->header.nLps) pageStart(pg, pageNumber + 1);
+    else pg->lpNum = 0xFFFF;
+
+    return animStream->pages[animStream->curPage].data;
 }
 
-// Load a large page from file into pageBuffer
-static bool loadPage(uint16_t pageNumber)
+// Build the per-frame (page, offset) index from the page headers
+static bool buildIndex(void)
 {
-    if (!animStream || animStream->handle < 0) return false;
-    if (animStream->curLpNum == pageNumber) return true;  // Already loaded
-    
-    // Large pages are at fixed 64KB (0x10000) offsets after the header area
-    // Header area = 0xb00 (2816 bytes) = header (128) + palette (1024) + LP table (1536) + padding
-    // Each LP starts at: 0xb00 + (pageNumber * 0x10000)
-    uint32_t offset = 0xb00 + (pageNumber * 0x10000);
-    
-    // Seek to this large page
-    klseek(animStream->handle, offset, SEEK_SET);
-    
-    // Read LP descriptor (6 bytes)
-    kread(animStream->handle, &animStream->curLp, sizeof(lp_descriptor_t));
-    
-    // Skip the 2-byte padding after descriptor
-    klseek(animStream->handle, offset + sizeof(lp_descriptor_t) + sizeof(uint16_t), SEEK_SET);
-    
-    // Read LP data (record offsets + compressed data)
-    int32_t toRead = animStream->curLp.nBytes + (animStream->curLp.nRecords * 2);
-    if (toRead > 0x10000) toRead = 0x10000;  // Safety limit
-    kread(animStream->handle, animStream->pageBuffer, toRead);
-    
-    animStream->curLpNum = pageNumber;
+    uint8_t *scratch = animStream->pages[0].data;
+    uint16_t *sizes = (uint16_t *)(scratch + 8);
+    lp_descriptor_t *lp;
+    uint32_t offset, rec;
+
+    for (uint32_t i = 0; i < animStream->header.nRecords; i++)
+        animStream->frames[i].page = 0xFFFF;
+
+    for (uint16_t p = 0; p < animStream->header.nLps; p++) {
+        lp = &animStream->lpArray[p];
+        klseek(animStream->handle, ANIM_PAGE_BASE + p * ANIM_PAGE_SIZE, SEEK_SET);
+        kread(animStream->handle, scratch, 8);
+        memcpy(lp, scratch, sizeof(lp_descriptor_t));
+        if (lp->nRecords > 256) return false;
+        kread(animStream->handle, sizes, lp->nRecords * 2);
+
+        offset = lp->nRecords * 2;
+        for (uint16_t i = 0; i < lp->nRecords; i++) {
+            rec = lp->baseRecord + i;
+            if (rec < animStream->header.nRecords && offset < ANIM_PAGE_SIZE) {
+                animStream->frames[rec].page = p;
+                animStream->frames[rec].offset = offset;
+            }
+            offset += sizes[i];
+        }
+    }
     return true;
 }
 
-// Render a frame from the currently loaded large page
-static void renderFrame(uint16_t frameNumber)
+// Draw a single frame (internal)
+static void drawFrame(uint16_t frameNumber)
 {
-    if (!animStream) return;
-    
-    uint16_t destFrame = frameNumber - animStream->curLp.baseRecord;
-    uint16_t offset = 0;
-    
-    // Sum up offsets to find this frame's data
-    for (uint16_t i = 0; i < destFrame; i++) {
-        offset += animStream->pageBuffer[i];
-    }
-    
-    uint8_t *ppointer = (uint8_t *)animStream->pageBuffer;
-    ppointer += animStream->curLp.nRecords * 2 + offset;
+    anim_frame_t *f;
+    uint8_t *ppointer;
+
+    if (frameNumber >= animStream->header.nRecords) return;
+    f = &animStream->frames[frameNumber];
+    if (f->page == 0xFFFF) return;
+
+    ppointer = loadPage(f->page) + f->offset;
     
     // Handle frame header
     if (ppointer[1]) {
@@ -224,14 +308,37 @@ static void renderFrame(uint16_t frameNumber)
         ppointer += 4;
     }
     
-    CPlayRunSkipDump(ppointer, animStream->imageBuffer);
+    uint32_t t = time_us_32();
+    anim_out_t out;
+
+    if (animStream->directFrame) {
+        out.rows = animStream->directRows;
+        out.row = 0;
+        out.dst = out.rows[0];
+        out.rowEnd = out.dst + ANIM_WIDTH;
+    } else {
+        out.rows = NULL;
+        out.dst = animStream->imageBuffer;
+        out.rowEnd = out.dst + 0x10000;
+    }
+    CPlayRunSkipDump(ppointer, &out);
+
+    t = time_us_32() - t;
+    animStream->decodeFrames++;
+    animStream->decodeUs += t;
+    if (t > animStream->decodeMaxUs) animStream->decodeMaxUs = t;
 }
 
-// Draw a single frame (internal)
-static void drawFrame(uint16_t frameNumber)
+// Fill the screen rows between ANM rows by repeating the row above
+static void expandDirectRows(void)
 {
-    if (!loadPage(findPage(frameNumber))) return;
-    renderFrame(frameNumber);
+    uint8_t *row = animStream->directFrame;
+
+    for (int32_t y = 1; y < animStream->directHeight; y++) {
+        row += animStream->directPitch;
+        if (y * ANIM_HEIGHT / animStream->directHeight == (y - 1) * ANIM_HEIGHT / animStream->directHeight)
+            memcpy(row, row - animStream->directPitch, ANIM_WIDTH);
+    }
 }
 
 //=============================================================================
@@ -251,14 +358,15 @@ bool AnimStream_Open(const char *filename)
     }
     memset(animStream, 0, sizeof(anim_stream_t));
     animStream->handle = -1;
-    animStream->curLpNum = 0xFFFF;
+    animStream->pages[0].lpNum = animStream->pages[1].lpNum = 0xFFFF;
     animStream->currentFrame = -1;
     
     // Allocate buffers in PSRAM
-    animStream->pageBuffer = (uint16_t *)psram_malloc(0x10000);  // 64KB for LP
+    animStream->pages[0].data = (uint8_t *)psram_malloc(ANIM_PAGE_SIZE);
+    animStream->pages[1].data = (uint8_t *)psram_malloc(ANIM_PAGE_SIZE);
     animStream->imageBuffer = (uint8_t *)psram_malloc(0x10000);  // 64KB for frame
     
-    if (!animStream->pageBuffer || !animStream->imageBuffer) {
+    if (!animStream->pages[0].data || !animStream->pages[1].data || !animStream->imageBuffer) {
         printf("AnimStream: Failed to allocate buffers\n");
         AnimStream_Close();
         return false;
@@ -299,11 +407,19 @@ bool AnimStream_Open(const char *filename)
         // Skip byte 4 (alpha)
     }
     
-    // Seek to LP table (at lpfTableOffset, typically 1280)
-    klseek(animStream->handle, animStream->header.lpfTableOffset, SEEK_SET);
-    
-    // Read LP descriptors
-    kread(animStream->handle, animStream->lpArray, sizeof(lp_descriptor_t) * animStream->header.nLps);
+    // Index every frame, then start reading the first page ahead
+    if (animStream->header.nLps > 256 || animStream->header.nRecords == 0) {
+        printf("AnimStream: Bad header in %s\n", filename);
+        AnimStream_Close();
+        return false;
+    }
+    animStream->frames = (anim_frame_t *)psram_malloc(sizeof(anim_frame_t) * animStream->header.nRecords);
+    if (!animStream->frames || !buildIndex()) {
+        printf("AnimStream: Failed to index %s\n", filename);
+        AnimStream_Close();
+        return false;
+    }
+    pageStart(&animStream->pages[1], 0);
     
     return true;
 }
@@ -313,13 +429,55 @@ void AnimStream_Close(void)
     if (animStream) {
         if (animStream->handle >= 0) {
             kclose(animStream->handle);
+            printf("AnimStream: %u page loads, %u stalled on SD\n",
+                   animStream->pageLoads, animStream->pageStalls);
+            if (animStream->decodeFrames)
+                printf("AnimStream: %s decode %u us/frame avg, %u us max over %u frames\n",
+                       animStream->directFrame ? "direct" : "PSRAM",
+                       animStream->decodeUs / animStream->decodeFrames,
+                       animStream->decodeMaxUs, animStream->decodeFrames);
         }
-        // Note: PSRAM allocations are freed when PSRAM is reset
-        // For explicit cleanup, we'd need psram_free()
+        psram_free(animStream->frames);
+        psram_free(animStream->pages[0].data);
+        psram_free(animStream->pages[1].data);
+        psram_free(animStream->imageBuffer);
+        psram_free(animStream);
         animStream = NULL;
     }
 }
 
+bool AnimStream_SetDirectOutput(uint8_t *frame, int32_t pitch, int32_t width, int32_t height)
+{
+    if (!animStream) return false;
+    animStream->directFrame = NULL;
+    if (!frame || width != ANIM_WIDTH || height < ANIM_HEIGHT || pitch < ANIM_WIDTH ||
+        animStream->header.width != ANIM_WIDTH || animStream->header.height != ANIM_HEIGHT)
+        return false;
+
+    // ANM row y lands on the first screen row showing it
+    for (int32_t y = 0; y < ANIM_HEIGHT; y++)
+        animStream->directRows[y] = frame + ((y * height + ANIM_HEIGHT - 1) / ANIM_HEIGHT) * pitch;
+    for (int32_t y = 0; y < height; y++)
+        memset(frame + y * pitch, 0, ANIM_WIDTH);
+
+    animStream->directFrame = frame;
+    animStream->directPitch = pitch;
+    animStream->directHeight = height;
+    animStream->currentFrame = -1;
+    return true;
+}
+
+bool AnimStream_Prefetch(void)
+{
+    anim_page_t *pg;
+
+    if (!animStream || animStream->handle < 0) return false;
+    pg = &animStream->pages[animStream->curPage ^ 1];
+    if (pg->lpNum == 0xFFFF || pg->loaded >= pg->size) return false;
+    pageRead(pg, ANIM_PREFETCH_CHUNK);
+    return pg->loaded < pg->size;
+}
+
 int AnimStream_NumFrames(void)
 {
     if (!animStream) return 0;
@@ -352,6 +510,10 @@ uint8_t *AnimStream_DrawFrame(int framenumber)
     }
     
     animStream->currentFrame = framenumber;
+    if (animStream->directFrame) {
+        expandDirectRows();
+        return animStream->directFrame;
+    }
     return animStream->imageBuffer;
 }
 
@@ -32,6 +32,17 @@ uint8_t *AnimStream_GetPalette(void);
 // Frame numbers start at 1
 uint8_t *AnimStream_DrawFrame(int framenumber);
 
+// Decode frames straight into a width x height 8-bit screen instead of the
+// PSRAM image (320x200 clips, full-width screens of 200+ rows). Rows are
+// repeated to fill the height. The screen must be left alone between
+// frames, as skipped pixels keep the previous frame. Returns false if the
+// clip or screen does not qualify; DrawFrame then keeps the PSRAM path.
+bool AnimStream_SetDirectOutput(uint8_t *frame, int32_t pitch, int32_t width, int32_t height);
+
+// Read the next large page ahead by one chunk. Call while waiting for the
+// next frame time. Returns true while more of the page is pending.
+bool AnimStream_Prefetch(void);
+
 // Get animation dimensions
 int AnimStream_GetWidth(void);
 int AnimStream_GetHeight(void);
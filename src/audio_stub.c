@@ -365,6 +365,27 @@ int FX_PlayLoopedRaw(uint8_t *ptr, uint32_t length, char *loopstart,
 #endif
 }
 
+uint32_t FX_TranscodedSize(uint8_t *ptr, uint32_t length) {
+    return I_PicoSound_TranscodedSize(ptr, length);
+}
+
+int FX_Transcode(uint8_t *ptr, uint32_t length, uint8_t *out) {
+    return I_PicoSound_Transcode(ptr, length, out) ? FX_Ok : FX_Error;
+}
+
+uint32_t FX_StreamHeaderSize(uint8_t *head, uint32_t headlen, uint32_t filelength) {
+    return I_PicoSound_StreamHeaderSize(head, headlen, filelength);
+}
+
+int FX_StreamHeader(uint8_t *head, uint32_t headlen, uint32_t filelength,
+                    char *name, uint8_t *out) {
+    return I_PicoSound_StreamHeader(head, headlen, filelength, name, out) ? FX_Ok : FX_Error;
+}
+
+void FX_StreamStats(uint32_t *playing, uint32_t *bytes, uint32_t *underruns) {
+    I_PicoSound_StreamStats(playing, bytes, underruns);
+}
+
 int32_t FX_Pan3D(int handle, int angle, int distance) {
     I_PicoSound_Pan3D(handle, angle, distance);
     return FX_Ok;
@@ -11,6 +11,23 @@
 #define DRAM_ATTR
 #define WORD_ALIGNED_ATTR __attribute__((aligned(4)))
 
+// Profile-guided SRAM placement. HOT_CODE(name) marks a candidate for
+// SRAM; it only takes effect when hot_functions.h (written by
+// tools/hotplace.py from a profile and a size budget) defines
+// HOT_PLACE_name. Selected functions go to .time_critical, which crt0
+// copies to SRAM, and everything else stays in XIP flash.
+#include "hot_functions.h"
+#define HOT_ARG_PLACEHOLDER_1 0,
+#define HOT_TAKE_SECOND(ignored, val, ...) val
+#define HOT_IS_SET(x) HOT_IS_SET_(x)
+#define HOT_IS_SET_(val) HOT_IS_SET__(HOT_ARG_PLACEHOLDER_##val)
+#define HOT_IS_SET__(arg_or_junk) HOT_TAKE_SECOND(arg_or_junk 1, 0)
+#define HOT_SECTION_0(name)
+#define HOT_SECTION_1(name) __attribute__((section(".time_critical.hot." #name)))
+#define HOT_SECTION(set, name) HOT_SECTION_(set, name)
+#define HOT_SECTION_(set, name) HOT_SECTION_##set(name)
+#define HOT_CODE(name) HOT_SECTION(HOT_IS_SET(HOT_PLACE_##name), name)
+
 // ESP32 logging macros - redirect to printf
 #include <stdio.h>
 #define ESP_LOGE(tag, fmt, ...) printf("[E][%s] " fmt "\n", tag, ##__VA_ARGS__)
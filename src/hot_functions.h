@@ -0,0 +1,32 @@
+// Functions placed in SRAM instead of XIP flash, see HOT_CODE() in
+// esp_attr.h. Regenerate from a profile with tools/hotplace.py; this
+// default list holds the column/span drawers and the per-frame geometry
+// helpers, well inside the default 24 KiB budget.
+#ifndef HOT_FUNCTIONS_H
+#define HOT_FUNCTIONS_H
+
+#define HOT_PLACE_vlineasm1 1
+#define HOT_PLACE_vlineasm4 1
+#define HOT_PLACE_mvlineasm1 1
+#define HOT_PLACE_mvlineasm4 1
+#define HOT_PLACE_tvlineasm1 1
+#define HOT_PLACE_prevlineasm1 1
+#define HOT_PLACE_hlineasm4 1
+#define HOT_PLACE_rhlineasm4 1
+#define HOT_PLACE_rmhlineasm4 1
+#define HOT_PLACE_spritevline 1
+#define HOT_PLACE_mspritevline 1
+#define HOT_PLACE_DrawSpriteVerticalLine 1
+#define HOT_PLACE_blitrow 1
+#define HOT_PLACE_hline 1
+#define HOT_PLACE_wallfront 1
+#define HOT_PLACE_inside 1
+#define HOT_PLACE_getangle 1
+#define HOT_PLACE_getceilzofslope 1
+#define HOT_PLACE_getflorzofslope 1
+#define HOT_PLACE_getzsofslope 1
+#define HOT_PLACE_clipinsidebox 1
+#define HOT_PLACE_clipinsideboxline 1
+#define HOT_PLACE_clipmove 1
+
+#endif
@@ -13,6 +13,7 @@
 
 #include "i_picosound.h"
 #include "board_config.h"
+#include "psram_sections.h"
 
 #define none pico_audio_enum_none
 #include "pico/audio_i2s.h"
@@ -27,6 +28,12 @@
 #define INT16_MIN (-32768)
 #endif
 
+// Use Duke3D's file system for streamed sounds
+extern int32_t TCkopen4load(const char *filename, int readfromGRP);
+extern int32_t kread(int32_t handle, void *buffer, int32_t length);
+extern int32_t klseek(int32_t handle, int32_t offset, int whence);
+extern void kclose(int32_t handle);
+
 #ifndef PICO_AUDIO_I2S_DMA_CHANNEL
 #define PICO_AUDIO_I2S_DMA_CHANNEL 10
 #endif
@@ -44,6 +51,58 @@
 // Buffer is refilled during mixing when exhausted
 #define VOICE_BUFFER_SAMPLES 256
 
+// Transcoded 8-bit PCM is mixed straight from the cache, this many samples
+// at a time (keeps the 16.16 offset in range)
+#define VOICE_WINDOW_SAMPLES 16384
+
+// Mixer-native copy of a VOC or WAV made by I_PicoSound_Transcode():
+// this header, then signed 8-bit samples at the source rate (or Creative
+// ADPCM bytes with SOUND_KEEP_ADPCM). 24 bytes keeps the samples aligned.
+#define TRANSCODED_MAGIC 0x384D4350  // "PCM8"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rate;
+    uint32_t length;               // Bytes of sample data after the header
+    uint32_t loop_start;           // Byte offset looping restarts from
+    uint8_t codec;                 // 0 = signed 8-bit PCM, 4 = Creative ADPCM
+    uint8_t reserved[7];
+} transcoded_t;
+
+// Cache entry of a sound that is played from its file (I_PicoSound_StreamHeader)
+#define STREAM_MAGIC 0x4D525453  // "STRM"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t rate;
+    uint32_t offset;               // File offset of the first sample byte
+    uint32_t length;               // Bytes of sample data
+    uint8_t codec;                 // 0 = PCM, 4 = Creative ADPCM
+    uint8_t is_16bit;
+    uint8_t is_signed;
+    uint8_t reserved;
+    char name[16];                 // File the voice opens to play it
+} stream_header_t;
+
+// A streaming voice's open file and its ring of blocks. Blocks are read on
+// the game thread by refill_streams() ahead of the mixer, which only ever
+// takes blocks that are already there.
+typedef struct sound_stream_s {
+    int32_t handle;                // File handle (-1 = slot free)
+    int voice;                     // Voice slot playing it
+    uint32_t offset;               // File offset of the first sample byte
+    uint32_t length;               // Bytes of sample data
+    uint32_t pos;                  // Bytes read since the last (re)start
+    bool looping;                  // Seek back to the first sample at the end
+    bool eof;                      // Last block is in the ring
+    bool inuse;                    // Block at tail is being mixed
+    uint8_t head;                  // Next block to read into
+    uint8_t tail;                  // Oldest filled block
+    uint8_t count;                 // Filled blocks, including the one in use
+    uint16_t fill[SOUND_STREAM_BLOCKS];     // Bytes in each block
+    bool restart[SOUND_STREAM_BLOCKS];      // Block starts at the first sample
+} sound_stream_t;
+
 typedef struct voice_s {
     const uint8_t *data;           // Current position in source data (PSRAM)
     const uint8_t *data_end;       // End of sample data
@@ -52,7 +111,8 @@ typedef struct voice_s {
     
     // Local buffer for mixing (decompressed/converted samples)
     int8_t buffer[VOICE_BUFFER_SAMPLES];
-    uint16_t buffer_size;          // Number of valid samples in buffer
+    const int8_t *window;          // Samples being mixed: buffer, or the data itself
+    uint16_t buffer_size;          // Number of valid samples in window
     
     uint32_t offset;               // Current position in buffer (16.16 fixed point)
     uint32_t step;                 // Fixed-point step per output sample (16.16)
@@ -66,6 +126,8 @@ typedef struct voice_s {
     bool is_16bit;                 // Is sample 16-bit? (false = 8-bit)
     bool is_signed;                // Is sample signed?
     bool is_adpcm;                 // Is sample ADPCM compressed?
+    bool is_native;                // Transcoded signed 8-bit, mixed in place
+    sound_stream_t *stream;        // Blocks come from a file (NULL = in memory)
     
     // Creative ADPCM decoder state
     uint8_t adpcm_pred;            // ADPCM predictor (0-255, unsigned)
@@ -92,6 +154,12 @@ static bool reverse_stereo = false;
 static void (*sound_callback)(int32_t) = NULL;
 static void (*music_generator)(audio_buffer_t *buffer) = NULL;
 
+static sound_stream_t streams[SOUND_STREAMS];
+static uint8_t stream_ring[SOUND_STREAMS][SOUND_STREAM_BLOCKS][SOUND_STREAM_BLOCK]
+    __psram_bss("stream_ring");
+static uint32_t stream_bytes_read = 0;
+static uint32_t stream_underruns = 0;
+
 // Debug: track mix iterations
 static volatile uint32_t mix_iteration_count = 0;
 static volatile uint32_t last_reported_mix = 0;
@@ -256,6 +324,37 @@ static void process_pending_callbacks(void) {
 // Decompress/copy next block of samples into voice buffer
 // Called when buffer is exhausted during mixing (murmdoom pattern)
 static void decompress_buffer(voice_t *v) {
+    // Streaming voice: move on to the next block of the ring
+    if (v && v->stream && v->data >= v->data_end) {
+        sound_stream_t *st = v->stream;
+        
+        if (st->inuse) {
+            st->tail = (st->tail + 1) % SOUND_STREAM_BLOCKS;
+            st->count--;
+            st->inuse = false;
+        }
+        if (st->count == 0) {
+            if (st->eof) {
+                v->buffer_size = 0;
+                return;
+            }
+            // Refill fell behind: play silence rather than wait on SD
+            stream_underruns++;
+            memset(v->buffer, 0, VOICE_BUFFER_SAMPLES);
+            v->window = v->buffer;
+            v->buffer_size = VOICE_BUFFER_SAMPLES;
+            return;
+        }
+        
+        st->inuse = true;
+        v->data = stream_ring[st - streams][st->tail];
+        v->data_end = v->data + st->fill[st->tail];
+        if (st->restart[st->tail] && v->is_adpcm) {
+            v->adpcm_pred = 128;  // Placeholder (first byte will replace)
+            v->adpcm_step = -1;   // -1 = needs to read first byte
+        }
+    }
+    
     // Validate pointers
     if (!v || !v->data || !v->data_end || v->data_end < v->data) {
         printf("DECOMPRESS: invalid ptrs data=%p end=%p\n", 
@@ -278,6 +377,19 @@ static void decompress_buffer(voice_t *v) {
         }
     }
     
+    if (v->is_native) {
+        // Already signed 8-bit: just move the window along the data
+        uint32_t available = v->data_end - v->data;
+        if (available > VOICE_WINDOW_SAMPLES) {
+            available = VOICE_WINDOW_SAMPLES;
+        }
+        v->window = (const int8_t *)v->data;
+        v->data += available;
+        v->buffer_size = available;
+        return;
+    }
+    
+    v->window = v->buffer;
     int samples_decoded = 0;
     
     if (v->is_adpcm) {
@@ -364,8 +476,9 @@ static void stop_voice(int voice_idx, bool do_callback) {
     uint32_t cb_val = v->callback_val;
     bool was_active = v->active;
     
-    // Mark inactive
+    // Mark inactive; refill_streams() closes the file of a detached stream
     v->active = false;
+    v->stream = NULL;
     
     // Queue callback if sound was playing and callback requested
     if (was_active && do_callback && cb_val != 0) {
@@ -380,11 +493,13 @@ static void stop_voice(int voice_idx, bool do_callback) {
 // Parse VOC file header and return sample data info
 // VOC format: "Creative Voice File" header, then blocks
 // Codec: 0=PCM, 4=ADPCM (4-bit)
-static bool parse_voc(const uint8_t *data, uint32_t length,
+// Only the first avail bytes need to be present (avail = length for a
+// sound in memory, less when reading the header of a streamed file).
+static bool parse_voc(const uint8_t *data, uint32_t length, uint32_t avail,
                       const uint8_t **sample_data, uint32_t *sample_length,
                       uint32_t *sample_rate, bool *is_16bit, uint8_t *out_codec) {
     // Check for "Creative Voice File" header
-    if (length < 26) return false;
+    if (length < 26 || avail < 26) return false;
     if (memcmp(data, "Creative Voice File\x1a", 20) != 0) return false;
     
     uint16_t header_size = read_le16(data + 20);
@@ -392,12 +507,13 @@ static bool parse_voc(const uint8_t *data, uint32_t length,
     
     const uint8_t *block = data + header_size;
     const uint8_t *end = data + length;
+    const uint8_t *have = data + avail;
     
     *is_16bit = false;
     *out_codec = 0;
     
     // Parse blocks to find sound data
-    while (block < end) {
+    while (block < end && block < have) {
         uint8_t block_type = block[0];
         
         if (block_type == 0) {
@@ -405,7 +521,7 @@ static bool parse_voc(const uint8_t *data, uint32_t length,
             break;
         }
         
-        if (block + 4 > end) break;
+        if (block + 4 > end || block + 4 > have) break;
         
         uint32_t block_size = block[1] | (block[2] << 8) | (block[3] << 16);
         const uint8_t *block_data = block + 4;
@@ -414,7 +530,7 @@ static bool parse_voc(const uint8_t *data, uint32_t length,
         
         switch (block_type) {
             case 1: // Sound data
-                if (block_size < 2) break;
+                if (block_size < 2 || block_data + 2 > have) break;
                 {
                     uint8_t freq_div = block_data[0];
                     uint8_t codec = block_data[1];
@@ -433,7 +549,7 @@ static bool parse_voc(const uint8_t *data, uint32_t length,
                 }
                 
             case 9: // Sound data (new format)
-                if (block_size < 12) break;
+                if (block_size < 12 || block_data + 12 > have) break;
                 {
                     *sample_rate = read_le32(block_data);
                     uint8_t bits = block_data[4];
@@ -469,10 +585,10 @@ static bool parse_voc(const uint8_t *data, uint32_t length,
 }
 
 // Parse WAV file header
-static bool parse_wav(const uint8_t *data, uint32_t length,
+static bool parse_wav(const uint8_t *data, uint32_t length, uint32_t avail,
                       const uint8_t **sample_data, uint32_t *sample_length,
                       uint32_t *sample_rate, bool *is_16bit, bool *is_signed) {
-    if (length < 44) return false;
+    if (length < 44 || avail < 12) return false;
     
     // Check RIFF header
     if (memcmp(data, "RIFF", 4) != 0) return false;
@@ -480,6 +596,7 @@ static bool parse_wav(const uint8_t *data, uint32_t length,
     
     const uint8_t *ptr = data + 12;
     const uint8_t *end = data + length;
+    const uint8_t *have = data + avail;
     
     uint32_t fmt_sample_rate = 0;
     uint16_t bits_per_sample = 0;
@@ -487,7 +604,7 @@ static bool parse_wav(const uint8_t *data, uint32_t length,
     bool found_fmt = false;
     
     // Parse chunks
-    while (ptr + 8 <= end) {
+    while (ptr + 8 <= end && ptr + 8 <= have) {
         uint32_t chunk_id = read_le32(ptr);
         uint32_t chunk_size = read_le32(ptr + 4);
         const uint8_t *chunk_data = ptr + 8;
@@ -495,7 +612,7 @@ static bool parse_wav(const uint8_t *data, uint32_t length,
         if (chunk_data + chunk_size > end) break;
         
         if (chunk_id == 0x20746D66) {  // "fmt "
-            if (chunk_size < 16) return false;
+            if (chunk_size < 16 || chunk_data + 16 > have) return false;
             
             audio_format = read_le16(chunk_data);
             uint16_t channels = read_le16(chunk_data + 2);
@@ -532,6 +649,281 @@ static bool parse_wav(const uint8_t *data, uint32_t length,
     return false;
 }
 
+// Recognise a copy made by I_PicoSound_Transcode()
+static bool parse_transcoded(const uint8_t *data,
+                             const uint8_t **sample_data, uint32_t *sample_length,
+                             uint32_t *sample_rate, uint8_t *out_codec) {
+    const transcoded_t *h = (const transcoded_t *)data;
+    
+    if (!data || h->magic != TRANSCODED_MAGIC) return false;
+    
+    *sample_data = data + sizeof(transcoded_t);
+    *sample_length = h->length;
+    *sample_rate = h->rate;
+    *out_codec = h->codec;
+    return true;
+}
+
+// Parse either container into one description of the samples
+static bool parse_source(const uint8_t *data, uint32_t length, uint32_t avail,
+                         const uint8_t **sample_data, uint32_t *sample_length,
+                         uint32_t *sample_rate, bool *is_16bit, bool *is_signed,
+                         uint8_t *out_codec) {
+    if (parse_voc(data, length, avail, sample_data, sample_length, sample_rate, is_16bit, out_codec)) {
+        *is_signed = *is_16bit;
+        return true;
+    }
+    if (parse_wav(data, length, avail, sample_data, sample_length, sample_rate, is_16bit, is_signed)) {
+        *out_codec = 0;
+        return true;
+    }
+    return false;
+}
+
+// Samples (or ADPCM bytes) the transcoded copy holds
+static uint32_t transcoded_length(uint32_t sample_length, bool is_16bit, uint8_t codec) {
+    if (codec == 4) {
+#if SOUND_KEEP_ADPCM
+        return sample_length;
+#else
+        // First byte is the initial reference, then two nibbles per byte
+        return sample_length > 0 ? (sample_length - 1) * 2 : 0;
+#endif
+    }
+    return is_16bit ? sample_length / 2 : sample_length;
+}
+
+uint32_t I_PicoSound_TranscodedSize(const uint8_t *data, uint32_t length) {
+    const uint8_t *sample_data;
+    uint32_t sample_length, sample_rate;
+    bool is_16bit, is_signed;
+    uint8_t codec = 0;
+    
+    if (!data || length < 4) return 0;
+    if (!parse_source(data, length, length, &sample_data, &sample_length, &sample_rate,
+                      &is_16bit, &is_signed, &codec)) {
+        return 0;
+    }
+    return sizeof(transcoded_t) + transcoded_length(sample_length, is_16bit, codec);
+}
+
+bool I_PicoSound_Transcode(const uint8_t *data, uint32_t length, uint8_t *out) {
+    const uint8_t *src;
+    uint32_t sample_length, sample_rate;
+    bool is_16bit, is_signed;
+    uint8_t codec = 0;
+    
+    if (!data || !out || length < 4) return false;
+    if (!parse_source(data, length, length, &src, &sample_length, &sample_rate,
+                      &is_16bit, &is_signed, &codec)) {
+        return false;
+    }
+    
+    transcoded_t *h = (transcoded_t *)out;
+    int8_t *dst = (int8_t *)(out + sizeof(transcoded_t));
+    uint32_t count = transcoded_length(sample_length, is_16bit, codec);
+    
+    if (codec == 4) {
+#if SOUND_KEEP_ADPCM
+        memcpy(dst, src, count);
+#else
+        uint8_t reference = src[0];
+        int stepsize = 0;
+        for (uint32_t i = 1; i < sample_length; i++) {
+            *dst++ = (int8_t)(decode_creative_adpcm_nibble(src[i] >> 4, &reference, &stepsize) - 128);
+            *dst++ = (int8_t)(decode_creative_adpcm_nibble(src[i] & 0x0F, &reference, &stepsize) - 128);
+        }
+        codec = 0;
+#endif
+    } else if (is_16bit) {
+        for (uint32_t i = 0; i < count; i++) {
+            dst[i] = (int8_t)((int16_t)read_le16(src + i * 2) >> 8);
+        }
+    } else if (is_signed) {
+        memcpy(dst, src, count);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            dst[i] = (int8_t)(src[i] - 128);
+        }
+    }
+    
+    h->magic = TRANSCODED_MAGIC;
+    h->rate = sample_rate;
+    h->length = count;
+    // Duke3D's own loop offsets are file-relative and unusable, so looping
+    // sounds repeat from the first sample, as the untranscoded path does
+    h->loop_start = 0;
+    h->codec = codec;
+    memset(h->reserved, 0, sizeof(h->reserved));
+    return true;
+}
+
+//=============================================================================
+// Streamed Sounds
+//=============================================================================
+
+uint32_t I_PicoSound_StreamHeaderSize(const uint8_t *head, uint32_t headlen,
+                                      uint32_t filelength) {
+    const uint8_t *sample_data;
+    uint32_t sample_length, sample_rate;
+    bool is_16bit, is_signed;
+    uint8_t codec = 0;
+    
+    if (!head || headlen > filelength) return 0;
+    if (!parse_source(head, filelength, headlen, &sample_data, &sample_length,
+                      &sample_rate, &is_16bit, &is_signed, &codec)) {
+        return 0;
+    }
+    return sizeof(stream_header_t);
+}
+
+bool I_PicoSound_StreamHeader(const uint8_t *head, uint32_t headlen,
+                              uint32_t filelength, const char *name, uint8_t *out) {
+    const uint8_t *sample_data;
+    uint32_t sample_length, sample_rate;
+    bool is_16bit, is_signed;
+    uint8_t codec = 0;
+    
+    if (!head || !out || headlen > filelength) return false;
+    if (!parse_source(head, filelength, headlen, &sample_data, &sample_length,
+                      &sample_rate, &is_16bit, &is_signed, &codec)) {
+        return false;
+    }
+    
+    stream_header_t *h = (stream_header_t *)out;
+    h->magic = STREAM_MAGIC;
+    h->rate = sample_rate;
+    h->offset = sample_data - head;
+    h->length = sample_length;
+    h->codec = codec;
+    h->is_16bit = is_16bit;
+    h->is_signed = is_signed;
+    h->reserved = 0;
+    strncpy(h->name, name, sizeof(h->name) - 1);
+    h->name[sizeof(h->name) - 1] = 0;
+    return true;
+}
+
+void I_PicoSound_StreamStats(uint32_t *playing, uint32_t *bytes, uint32_t *underruns) {
+    uint32_t n = 0;
+    for (int i = 0; i < SOUND_STREAMS; i++) {
+        if (streams[i].handle >= 0 && voices[streams[i].voice].stream == &streams[i]) n++;
+    }
+    *playing = n;
+    *bytes = stream_bytes_read;
+    *underruns = stream_underruns;
+}
+
+static const stream_header_t *parse_stream(const uint8_t *data) {
+    const stream_header_t *h = (const stream_header_t *)data;
+    return (data && h->magic == STREAM_MAGIC) ? h : NULL;
+}
+
+static void close_stream(sound_stream_t *st) {
+    if (st->handle >= 0) {
+        kclose(st->handle);
+        st->handle = -1;
+    }
+}
+
+// Close the files of streams whose voice finished or was reused and
+// return a free slot, or NULL
+static sound_stream_t *free_stream_slot(void) {
+    sound_stream_t *slot = NULL;
+    for (int i = 0; i < SOUND_STREAMS; i++) {
+        sound_stream_t *st = &streams[i];
+        if (st->handle >= 0 && voices[st->voice].stream != st) {
+            close_stream(st);
+        }
+        if (st->handle < 0 && !slot) slot = st;
+    }
+    return slot;
+}
+
+// Read the next block at the ring's head; at the end of the data either
+// seek back to the first sample (looping) or mark the stream finished
+static void read_stream_block(sound_stream_t *st) {
+    int b = st->head;
+    
+    if (st->pos >= st->length) {
+        if (!st->looping) {
+            st->eof = true;
+            return;
+        }
+        klseek(st->handle, st->offset, SEEK_SET);
+        st->pos = 0;
+    }
+    
+    uint32_t n = st->length - st->pos;
+    if (n > SOUND_STREAM_BLOCK) n = SOUND_STREAM_BLOCK;
+    
+    int32_t got = kread(st->handle, stream_ring[st - streams][b], n);
+    if (got <= 0) {
+        st->eof = true;
+        return;
+    }
+    
+    st->fill[b] = got;
+    st->restart[b] = (st->pos == 0);
+    st->pos += got;
+    st->head = (b + 1) % SOUND_STREAM_BLOCKS;
+    st->count++;
+    stream_bytes_read += got;
+    
+    if (st->pos >= st->length && !st->looping) {
+        st->eof = true;
+    }
+}
+
+// Top up every playing stream's ring. Runs on the game thread from
+// I_PicoSound_Update() before mixing, so the mixer never reads the file.
+static void refill_streams(void) {
+    for (int i = 0; i < SOUND_STREAMS; i++) {
+        sound_stream_t *st = &streams[i];
+        if (st->handle < 0) continue;
+        
+        voice_t *v = &voices[st->voice];
+        if (!v->active || v->stream != st) {
+            if (v->stream == st) v->stream = NULL;
+            close_stream(st);
+            continue;
+        }
+        for (int reads = 0; reads < SOUND_STREAM_READS && !st->eof &&
+                            st->count < SOUND_STREAM_BLOCKS; reads++) {
+            read_stream_block(st);
+        }
+    }
+}
+
+// Open the file behind a stream header for voice slot and read the first
+// blocks, so playback starts without waiting for a refill
+static bool open_stream(int slot, const stream_header_t *h, bool looping) {
+    sound_stream_t *st = free_stream_slot();
+    if (!st) return false;
+    
+    st->handle = TCkopen4load(h->name, 0);
+    if (st->handle < 0) return false;
+    if (klseek(st->handle, h->offset, SEEK_SET) != (int32_t)h->offset) {
+        close_stream(st);
+        return false;
+    }
+    
+    st->voice = slot;
+    st->offset = h->offset;
+    st->length = h->length;
+    st->pos = 0;
+    st->looping = looping;
+    st->eof = false;
+    st->inuse = false;
+    st->head = st->tail = st->count = 0;
+    for (int i = 0; i < SOUND_STREAM_READS && !st->eof; i++) {
+        read_stream_block(st);
+    }
+    
+    voices[slot].stream = st;
+    return true;
+}
+
 //=============================================================================
 // Audio Mixing
 //=============================================================================
@@ -570,7 +962,7 @@ static void mix_audio_buffer(audio_buffer_t *buffer) {
         int16_t *out = samples;
         
         // Safety check - offset should never exceed buffer
-        if ((v->offset >> 16) >= VOICE_BUFFER_SAMPLES) {
+        if ((v->offset >> 16) >= v->buffer_size) {
             printf("MIX OVERFLOW: ch=%d offset=%u buf_size=%u\n", ch, v->offset >> 16, v->buffer_size);
             v->offset = 0;
         }
@@ -578,7 +970,7 @@ static void mix_audio_buffer(audio_buffer_t *buffer) {
 #if SOUND_LOW_PASS
         int alpha256 = v->alpha256;
         int beta256 = 256 - alpha256;
-        int sample = v->buffer[v->offset >> 16];
+        int sample = v->window[v->offset >> 16];
 #endif
         
         int decompress_calls = 0;  // Track decompress calls per voice per buffer
@@ -586,16 +978,16 @@ static void mix_audio_buffer(audio_buffer_t *buffer) {
         for (int s = 0; s < sample_count; s++) {
             // Bounds check buffer access
             uint32_t buf_idx = v->offset >> 16;
-            if (buf_idx >= VOICE_BUFFER_SAMPLES) {
+            if (buf_idx >= v->buffer_size) {
                 printf("MIX IDX OVERFLOW: ch=%d idx=%u\n", ch, buf_idx);
                 v->active = false;
                 break;
             }
             
 #if !SOUND_LOW_PASS
-            int sample = v->buffer[buf_idx];
+            int sample = v->window[buf_idx];
 #else
-            sample = (beta256 * sample + alpha256 * v->buffer[buf_idx]) / 256;
+            sample = (beta256 * sample + alpha256 * v->window[buf_idx]) / 256;
 #endif
             
             // Mix into output - both channels should get audio
@@ -692,6 +1084,9 @@ bool I_PicoSound_Init(int numvoices, int mixrate) {
     
     // Initialize voices
     memset(voices, 0, sizeof(voices));
+    for (int i = 0; i < SOUND_STREAMS; i++) {
+        streams[i].handle = -1;
+    }
     
     sound_initialized = true;
     return true;
@@ -720,6 +1115,9 @@ void I_PicoSound_Update(void) {
     }
 #endif
     
+    // Read streamed sounds ahead of the mixer
+    refill_streams();
+    
     // Process audio buffers - decompress_buffer is called inline during mixing
     // This is the murmdoom pattern: PSRAM access happens inside the mix loop
     audio_buffer_t *buffer;
@@ -749,11 +1147,19 @@ int I_PicoSound_PlayVOC(const uint8_t *data, uint32_t length,
     
     const uint8_t *sample_data;
     uint32_t sample_length, sample_rate;
-    bool is_16bit;
+    bool is_16bit = false;
     uint8_t codec = 0;
     
-    // Parse VOC header
-    if (!parse_voc(data, length, &sample_data, &sample_length, &sample_rate, &is_16bit, &codec)) {
+    // Stream header or transcoded copy from the cache, else parse the VOC header
+    const stream_header_t *stream = parse_stream(data);
+    bool is_native = !stream && parse_transcoded(data, &sample_data, &sample_length, &sample_rate, &codec);
+    if (stream) {
+        sample_data = NULL;
+        sample_length = 0;
+        sample_rate = stream->rate;
+        is_16bit = stream->is_16bit;
+        codec = stream->codec;
+    } else if (!is_native && !parse_voc(data, length, length, &sample_data, &sample_length, &sample_rate, &is_16bit, &codec)) {
         // Fallback: treat entire data as raw 8-bit unsigned samples
         sample_data = data;
         sample_length = length;
@@ -772,6 +1178,8 @@ int I_PicoSound_PlayVOC(const uint8_t *data, uint32_t length,
     voice_t *v = &voices[slot];
     stop_voice(slot, true);
     
+    if (stream && !open_stream(slot, stream, looping)) return 0;
+    
     v->data = sample_data;
     v->data_end = sample_data + sample_length;
     
@@ -782,8 +1190,9 @@ int I_PicoSound_PlayVOC(const uint8_t *data, uint32_t length,
     v->looping = looping;
     
     v->is_16bit = is_16bit;
-    v->is_signed = false;  // VOC 8-bit is unsigned
+    v->is_signed = stream ? stream->is_signed : is_native;  // VOC 8-bit is unsigned, transcoded PCM signed
     v->is_adpcm = is_adpcm;
+    v->is_native = is_native && !is_adpcm;
     
     // Initialize Creative ADPCM state
     if (is_adpcm) {
@@ -836,9 +1245,20 @@ int I_PicoSound_PlayWAV(const uint8_t *data, uint32_t length,
     
     const uint8_t *sample_data;
     uint32_t sample_length, sample_rate;
-    bool is_16bit, is_signed;
+    bool is_16bit = false, is_signed = true;
+    uint8_t codec = 0;
     
-    if (!parse_wav(data, length, &sample_data, &sample_length, &sample_rate, &is_16bit, &is_signed)) {
+    // Stream header or transcoded copy from the cache, else parse the WAV header
+    const stream_header_t *stream = parse_stream(data);
+    bool is_native = !stream && parse_transcoded(data, &sample_data, &sample_length, &sample_rate, &codec);
+    if (stream) {
+        sample_data = NULL;
+        sample_length = 0;
+        sample_rate = stream->rate;
+        is_16bit = stream->is_16bit;
+        is_signed = stream->is_signed;
+        codec = stream->codec;
+    } else if (!is_native && !parse_wav(data, length, length, &sample_data, &sample_length, &sample_rate, &is_16bit, &is_signed)) {
         printf("I_PicoSound_PlayWAV: Failed to parse WAV\n");
         return 0;
     }
@@ -850,6 +1270,8 @@ int I_PicoSound_PlayWAV(const uint8_t *data, uint32_t length,
     voice_t *v = &voices[slot];
     stop_voice(slot, true);  // Stop any previous sound
     
+    if (stream && !open_stream(slot, stream, looping)) return 0;
+    
     v->data = sample_data;
     v->data_end = sample_data + sample_length;
     
@@ -861,7 +1283,14 @@ int I_PicoSound_PlayWAV(const uint8_t *data, uint32_t length,
     
     v->is_16bit = is_16bit;
     v->is_signed = is_signed;
-    v->is_adpcm = false;  // WAV files are not ADPCM
+    v->is_adpcm = (codec == 4);  // Only a transcoded or streamed VOC can be ADPCM
+    v->is_native = is_native && codec == 0;
+    
+    // Initialize Creative ADPCM state
+    if (v->is_adpcm) {
+        v->adpcm_pred = 128;  // Placeholder (first byte will replace)
+        v->adpcm_step = -1;   // -1 = needs to read first byte
+    }
     
     // Decompress first buffer block
     decompress_buffer(v);
@@ -927,6 +1356,7 @@ int I_PicoSound_PlayRaw(const uint8_t *data, uint32_t length,
     v->is_16bit = false;  // Raw data assumed to be 8-bit unsigned
     v->is_signed = false;
     v->is_adpcm = false;  // Raw data is not ADPCM
+    v->is_native = false;
     
     // Decompress first buffer block
     decompress_buffer(v);
@@ -1022,6 +1452,9 @@ void I_PicoSound_EndLooping(int handle) {
     
     voices[slot].looping = false;
     voices[slot].loop_start = NULL;
+    if (voices[slot].stream) {
+        voices[slot].stream->looping = false;
+    }
 }
 
 void I_PicoSound_Pan3D(int handle, int angle, int distance) {
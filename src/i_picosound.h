@@ -39,6 +39,28 @@ typedef struct audio_buffer audio_buffer_t;
 #define SOUND_LOW_PASS 1
 #endif
 
+// Keep Creative ADPCM sounds compressed in the cache and decode them while
+// mixing (half the cache space) instead of expanding them to 8-bit PCM
+#ifndef SOUND_KEEP_ADPCM
+#define SOUND_KEEP_ADPCM 0
+#endif
+
+// Sounds played straight from their file (I_PicoSound_StreamHeader): how
+// many can play at once, and the ring of blocks each one is read through.
+// Up to SOUND_STREAM_READS blocks per stream are read per update.
+#ifndef SOUND_STREAMS
+#define SOUND_STREAMS 4
+#endif
+#ifndef SOUND_STREAM_BLOCK
+#define SOUND_STREAM_BLOCK 2048
+#endif
+#ifndef SOUND_STREAM_BLOCKS
+#define SOUND_STREAM_BLOCKS 4
+#endif
+#ifndef SOUND_STREAM_READS
+#define SOUND_STREAM_READS 2
+#endif
+
 // Enable increased I2S drive strength for cleaner signal
 #ifndef INCREASE_I2S_DRIVE_STRENGTH
 #define INCREASE_I2S_DRIVE_STRENGTH 1
@@ -90,6 +112,27 @@ int I_PicoSound_PlayRaw(const uint8_t *data, uint32_t length,
                         int priority, uint32_t callbackval,
                         bool looping, const uint8_t *loopstart, const uint8_t *loopend);
 
+// Size of the mixer-native copy of a VOC or WAV (header + signed 8-bit
+// samples), or 0 if the data is not a sound that can be converted
+uint32_t I_PicoSound_TranscodedSize(const uint8_t *data, uint32_t length);
+
+// Write the mixer-native copy into out (I_PicoSound_TranscodedSize bytes).
+// The Play functions recognise it in place of the original VOC or WAV.
+bool I_PicoSound_Transcode(const uint8_t *data, uint32_t length, uint8_t *out);
+
+// Size of the stream header for a VOC or WAV file of filelength bytes whose
+// first headlen bytes are in head, or 0 if it cannot be streamed
+uint32_t I_PicoSound_StreamHeaderSize(const uint8_t *head, uint32_t headlen,
+                                      uint32_t filelength);
+
+// Write the stream header into out. The Play functions recognise it and
+// play the sound by reading file name through a ring buffer.
+bool I_PicoSound_StreamHeader(const uint8_t *head, uint32_t headlen,
+                              uint32_t filelength, const char *name, uint8_t *out);
+
+// Streams playing, bytes read for them and blocks the mixer found missing
+void I_PicoSound_StreamStats(uint32_t *playing, uint32_t *bytes, uint32_t *underruns);
+
 // Stop a sound by voice handle
 int I_PicoSound_StopVoice(int handle);
 
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Pick the hottest functions that fit an SRAM budget and write
+src/hot_functions.h.
+
+Functions run from XIP flash unless they carry HOT_CODE(name) and
+hot_functions.h defines HOT_PLACE_name, in which case they land in
+.time_critical and crt0 copies them to SRAM.
+
+The profile is either a gprof flat profile (gprof -b -p, from a host
+build) or plain "name samples" lines, e.g. from PC sampling on the
+device. Sizes come from the firmware ELF. Functions are taken by samples
+per byte until the budget is spent.
+
+    tools/hotplace.py --elf build/murmduke3d.elf --profile prof.txt \\
+        --budget 24
+
+Compare the DebugRender "XIP hit" readout before and after flashing.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def read_profile(path):
+    samples = {}
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) >= 2 and re.match(r'^[A-Za-z_]\w*$', fields[-1]):
+                # gprof flat profile: "%time cumulative self ... name"
+                try:
+                    float(fields[0])
+                    value = float(fields[2]) if len(fields) >= 3 else float(fields[0])
+                except ValueError:
+                    continue
+                name = fields[-1]
+            elif len(fields) == 2 and re.match(r'^[A-Za-z_]\w*$', fields[0]):
+                try:
+                    value = float(fields[1])
+                except ValueError:
+                    continue
+                name = fields[0]
+            else:
+                continue
+            samples[name] = samples.get(name, 0.0) + value
+    return samples
+
+
+def read_sizes(elf, nm):
+    out = subprocess.check_output([nm, '-S', '--defined-only', elf]).decode()
+    sizes = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in 'tT':
+            sizes[fields[3]] = max(sizes.get(fields[3], 0), int(fields[1], 16))
+    return sizes
+
+
+def read_candidates(dirs):
+    marker = re.compile(r'^HOT_CODE\((\w+)\)', re.M)
+    names = set()
+    for d in dirs:
+        for base, _, files in os.walk(os.path.join(ROOT, d)):
+            for fn in files:
+                if fn.endswith(('.c', '.cpp')):
+                    with open(os.path.join(base, fn), errors='replace') as f:
+                        names.update(marker.findall(f.read()))
+    return names
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    ap.add_argument('--elf', required=True)
+    ap.add_argument('--profile', required=True)
+    ap.add_argument('--budget', type=float, default=24, help='KiB of SRAM')
+    ap.add_argument('--nm', default='arm-none-eabi-nm')
+    ap.add_argument('--src', nargs='*', default=['components', 'src'])
+    ap.add_argument('--out', default=os.path.join(ROOT, 'src', 'hot_functions.h'))
+    args = ap.parse_args()
+
+    samples = read_profile(args.profile)
+    sizes = read_sizes(args.elf, args.nm)
+    candidates = read_candidates(args.src)
+    total = sum(samples.values()) or 1.0
+    budget = int(args.budget*1024)
+
+    ranked = sorted((n for n in samples if n in candidates and sizes.get(n)),
+                    key=lambda n: samples[n]/sizes[n], reverse=True)
+    chosen, used = [], 0
+    for name in ranked:
+        size = (sizes[name]+3) & ~3
+        if used+size <= budget:
+            chosen.append(name)
+            used += size
+
+    with open(args.out, 'w') as f:
+        f.write('// Functions placed in SRAM instead of XIP flash, see HOT_CODE() in\n')
+        f.write('// esp_attr.h. Generated by tools/hotplace.py from %s,\n'
+                % os.path.basename(args.profile))
+        f.write('// %d of %d bytes of budget.\n' % (used, budget))
+        f.write('#ifndef HOT_FUNCTIONS_H\n#define HOT_FUNCTIONS_H\n\n')
+        for name in chosen:
+            f.write('#define HOT_PLACE_%s 1 // %.1f%%, %d bytes\n'
+                    % (name, samples[name]*100/total, sizes[name]))
+        f.write('\n#endif\n')
+
+    covered = sum(samples[n] for n in chosen)
+    print('%d functions, %d/%d bytes, %.1f%% of samples now in SRAM'
+          % (len(chosen), used, budget, covered*100/total))
+    missed = sorted((n for n in samples if n not in candidates and n in sizes),
+                    key=lambda n: samples[n], reverse=True)[:10]
+    for name in missed:
+        print('  not marked HOT_CODE: %s (%.1f%%, %d bytes)'
+              % (name, samples[name]*100/total, sizes[name]))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())